@@ -0,0 +1,125 @@
+//===-- CopyOnWriteVector.h -------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COPYONWRITEVECTOR_H
+#define KLEE_COPYONWRITEVECTOR_H
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace klee {
+
+  /// A vector whose copies share storage until they are written to.
+  ///
+  /// The elements live in fixed-size pages, and copying the vector only
+  /// copies the page pointers. Writing to an element, or appending to a
+  /// page, first clones the page if another copy still refers to it, so a
+  /// copy that is appended to costs one page, not the whole vector.
+  ///
+  /// Elements are read through the const accessors only; writes go through
+  /// getWriteable() and getWriteableBack() so that they can unshare their
+  /// page.
+  template<class T, std::size_t PageSize = 64>
+  class CopyOnWriteVector {
+    typedef std::vector<T> Page;
+
+    std::vector<std::shared_ptr<Page> > pages;
+    std::size_t numElements;
+
+    Page &writeablePage(std::size_t index) {
+      std::shared_ptr<Page> &page = pages[index];
+      // A page referred to by this vector alone cannot gain another owner
+      // behind our back, so a count of one is reliable.
+      if (page.use_count() != 1)
+        page = std::make_shared<Page>(*page);
+      return *page;
+    }
+
+    Page &appendablePage() {
+      if (numElements % PageSize == 0) {
+        pages.push_back(std::make_shared<Page>());
+        pages.back()->reserve(PageSize);
+        return *pages.back();
+      }
+      return writeablePage(pages.size() - 1);
+    }
+
+  public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+
+    CopyOnWriteVector() : numElements(0) {}
+
+    size_type size() const { return numElements; }
+    bool empty() const { return numElements == 0; }
+
+    const T &operator[](size_type index) const {
+      assert(index < numElements && "index out of range");
+      return (*pages[index / PageSize])[index % PageSize];
+    }
+
+    const T &back() const {
+      assert(!empty() && "back() on empty vector");
+      return pages.back()->back();
+    }
+
+    T &getWriteable(size_type index) {
+      assert(index < numElements && "index out of range");
+      return writeablePage(index / PageSize)[index % PageSize];
+    }
+
+    T &getWriteableBack() {
+      assert(!empty() && "getWriteableBack() on empty vector");
+      return writeablePage(pages.size() - 1).back();
+    }
+
+    void push_back(const T &value) {
+      appendablePage().push_back(value);
+      ++numElements;
+    }
+
+    template<class... Args>
+    void emplace_back(Args &&... args) {
+      appendablePage().emplace_back(std::forward<Args>(args)...);
+      ++numElements;
+    }
+
+    void clear() {
+      pages.clear();
+      numElements = 0;
+    }
+
+    /// Return the number of pages this vector shares with other copies.
+    size_type getNumSharedPages() const {
+      size_type shared = 0;
+      for (const auto &page : pages)
+        shared += page.use_count() != 1;
+      return shared;
+    }
+
+    bool operator==(const CopyOnWriteVector &b) const {
+      if (numElements != b.numElements)
+        return false;
+      for (size_type i = 0, e = pages.size(); i != e; ++i)
+        if (pages[i] != b.pages[i] && *pages[i] != *b.pages[i])
+          return false;
+      return true;
+    }
+
+    bool operator!=(const CopyOnWriteVector &b) const {
+      return !(*this == b);
+    }
+  };
+
+}
+
+#endif /* KLEE_COPYONWRITEVECTOR_H */
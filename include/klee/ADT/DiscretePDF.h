@@ -10,7 +10,18 @@
 #ifndef KLEE_DISCRETEPDF_H
 #define KLEE_DISCRETEPDF_H
 
+#include <cstddef>
+#include <unordered_map>
+#include <vector>
+
 namespace klee {
+  /// DiscretePDF - A set of weighted items, from which items are chosen with
+  /// probability proportional to their weight.
+  ///
+  /// Items and weights live in dense arrays, with a Fenwick tree of partial
+  /// sums over them, so that choosing and changing a weight take O(log n)
+  /// without any allocation per item. Removing an item moves the last one
+  /// into its place.
   template <class T>
   class DiscretePDF {
     // not perfectly parameterized, but float/double/int should work ok,
@@ -23,26 +34,39 @@ namespace klee {
     ~DiscretePDF();
 
     bool empty() const;
+    std::size_t size() const;
     void insert(T item, weight_type weight);
     void update(T item, weight_type newWeight);
     void remove(T item);
     bool inTree(T item);
     weight_type getWeight(T item);
-	
+
     /* pick a tree element according to its
      * weight. p should be in [0,1).
      */
     T choose(double p);
-    
+
+    /// Recompute the weight of every item as `weightOf(item)` and rebuild
+    /// the partial sums in one O(n) pass. With \arg numThreads > 1 the
+    /// weights are computed on that many threads, so `weightOf` has to be
+    /// safe to call concurrently.
+    template <class WeightFn>
+    void reweight(WeightFn weightOf, unsigned numThreads = 1);
+
   private:
-    class Node;
-    Node *m_root;
-    
-    Node **lookup(T item, Node **parent_out);
-    void split(Node *node);
-    void rotate(Node *node);
-    void lengthen(Node *node);
-    void propogateSumsUp(Node *n);
+    std::vector<T> items;
+    std::vector<weight_type> weights;
+    /// Fenwick tree: sums[i] is the sum of the weights of the items in
+    /// [i - (i & -i), i). sums[0] is unused.
+    std::vector<weight_type> sums;
+    std::unordered_map<T, std::size_t> indices;
+    /// Updates since the sums were last rebuilt. Adding differences makes
+    /// rounding errors pile up, so the sums are rebuilt from time to time.
+    std::size_t updatesSinceBuild;
+
+    void add(std::size_t index, weight_type delta);
+    void setWeight(std::size_t index, weight_type weight);
+    void buildSums();
   };
 
 }
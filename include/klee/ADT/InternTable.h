@@ -0,0 +1,121 @@
+//===-- InternTable.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_INTERNTABLE_H
+#define KLEE_INTERNTABLE_H
+
+#include "klee/ADT/Ref.h"
+
+#include "llvm/ADT/SmallVector.h"
+
+#include <cassert>
+#include <mutex>
+#include <vector>
+
+namespace klee {
+
+  /// Weak table of hash-consed, ref-managed objects.
+  ///
+  /// The objects are chained through a pointer they carry themselves, so
+  /// registering one does not allocate. The table is split into shards with
+  /// their own lock and bucket array, so threads interning objects rarely
+  /// contend and a lookup only walks the objects of one bucket.
+  ///
+  /// The table does not own its objects. Every registered object must
+  /// remove() itself when it is destroyed, and lookups skip objects whose
+  /// reference count already dropped to zero.
+  ///
+  /// \tparam Traits Provides `static T *&link(T &)`, the pointer chaining
+  /// the objects of a bucket, `static unsigned hash(const T &)` and
+  /// `static bool isEqual(const T &, const T &)`, telling whether two
+  /// objects with the same hash are interchangeable. `link` and `hash` are
+  /// also used on objects which are being destroyed, so they must not make
+  /// virtual calls. `isEqual` is called with the shard lock held.
+  template<class T, class Traits>
+  class InternTable {
+    static const unsigned NumShards = 64;
+    static const unsigned InitialBuckets = 64;
+
+    struct Shard {
+      std::mutex lock;
+      std::vector<T *> buckets;
+      size_t size;
+
+      Shard() : buckets(InitialBuckets, nullptr), size(0) {}
+    };
+
+    Shard shards[NumShards];
+
+    static T *&getBucket(Shard &shard, unsigned hash) {
+      // The low bits already picked the shard.
+      return shard.buckets[(hash / NumShards) & (shard.buckets.size() - 1)];
+    }
+
+    static void grow(Shard &shard) {
+      std::vector<T *> old(shard.buckets.size() * 2, nullptr);
+      old.swap(shard.buckets);
+      for (T *head : old) {
+        while (T *e = head) {
+          head = Traits::link(*e);
+          T *&bucket = getBucket(shard, Traits::hash(*e));
+          Traits::link(*e) = bucket;
+          bucket = e;
+        }
+      }
+    }
+
+  public:
+    /// Return the live object interchangeable with \a e if there is one,
+    /// and otherwise register \a e and return it.
+    ref<T> lookupOrInsert(T *e) {
+      unsigned hash = Traits::hash(*e);
+      // Objects pinned while searching are released after unlocking, as
+      // releasing the last reference destroys them, which takes the lock.
+      // Comparing hashes first means this rarely holds anything.
+      llvm::SmallVector<ref<T>, 4> mismatches;
+      Shard &shard = shards[hash % NumShards];
+      std::lock_guard<std::mutex> guard(shard.lock);
+      T *&bucket = getBucket(shard, hash);
+      for (T *c = bucket; c; c = Traits::link(*c)) {
+        // Objects being destroyed are still registered, so their hash can
+        // be read, but not necessarily anything else.
+        if (Traits::hash(*c) != hash)
+          continue;
+        ref<T> candidate = ref<T>::acquireIfAlive(c);
+        if (candidate.isNull())
+          continue;
+        if (Traits::isEqual(*candidate, *e))
+          return candidate;
+        mismatches.push_back(std::move(candidate));
+      }
+      Traits::link(*e) = bucket;
+      bucket = e;
+      if (++shard.size > shard.buckets.size())
+        grow(shard);
+      return e;
+    }
+
+    void remove(T *e) {
+      unsigned hash = Traits::hash(*e);
+      Shard &shard = shards[hash % NumShards];
+      std::lock_guard<std::mutex> guard(shard.lock);
+      for (T **p = &getBucket(shard, hash); *p; p = &Traits::link(**p)) {
+        if (*p == e) {
+          *p = Traits::link(*e);
+          --shard.size;
+          return;
+        }
+      }
+      assert(0 && "interned object missing from the table");
+    }
+  };
+
+}
+
+#endif /* KLEE_INTERNTABLE_H */
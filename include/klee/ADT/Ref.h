@@ -36,6 +36,7 @@ using llvm::cast_or_null;
 using llvm::dyn_cast;
 using llvm::dyn_cast_or_null;
 
+#include <atomic>
 #include <cassert>
 #include <iosfwd> // FIXME: Remove this when LLVM 4.0 support is removed!!!
 
@@ -49,12 +50,15 @@ template<class T>
 class ref;
 
 /// Reference counter to be used as part of a ref-managed struct or class
+///
+/// The counter is atomic so that objects (in particular expressions) can be
+/// shared between the interpreter and the solver worker threads.
 class ReferenceCounter {
   template<class T>
   friend class ref;
 
   /// Count how often the object has been referenced.
-  unsigned refCount = 0;
+  std::atomic<unsigned> refCount{0};
 
 public:
   ReferenceCounter() = default;
@@ -67,14 +71,14 @@ public:
 
   /// Returns the number of parallel references of this objects
   /// \return number of references on this object
-  unsigned getCount() {return refCount;}
+  unsigned getCount() {return refCount.load(std::memory_order_relaxed);}
 
   // Copy assignment operator
   ReferenceCounter &operator=(const ReferenceCounter &a) {
     if (this == &a)
       return *this;
     // The new copy won't be referenced
-    refCount = 0;
+    refCount.store(0, std::memory_order_relaxed);
     return *this;
   }
 
@@ -96,11 +100,12 @@ public:
 private:
   void inc() const {
     if (ptr)
-      ++ptr->_refCount.refCount;
+      ptr->_refCount.refCount.fetch_add(1, std::memory_order_relaxed);
   }
 
   void dec() const {
-    if (ptr && --ptr->_refCount.refCount == 0)
+    if (ptr && ptr->_refCount.refCount.fetch_sub(
+                   1, std::memory_order_acq_rel) == 1)
       delete ptr;
   }
 
@@ -136,6 +141,23 @@ public:
     return ptr;
   }
 
+  /// Create a reference to \a p unless its counter already dropped to zero,
+  /// i.e. unless it is about to be destroyed. Used by tables which keep
+  /// unreferenced pointers to live objects.
+  static ref<T> acquireIfAlive(T *p) {
+    std::atomic<unsigned> &count = p->_refCount.refCount;
+    unsigned current = count.load(std::memory_order_relaxed);
+    do {
+      if (!current)
+        return ref<T>();
+    } while (!count.compare_exchange_weak(current, current + 1,
+                                          std::memory_order_acquire,
+                                          std::memory_order_relaxed));
+    ref<T> result;
+    result.ptr = p;
+    return result;
+  }
+
   /* The copy assignment operator must also explicitly be defined,
    * despite a redundant template. */
   ref<T> &operator= (const ref<T> &r) {
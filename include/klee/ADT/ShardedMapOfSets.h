@@ -0,0 +1,243 @@
+//===-- ShardedMapOfSets.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SHARDEDMAPOFSETS_H
+#define KLEE_SHARDEDMAPOFSETS_H
+
+#include "klee/ADT/MapOfSets.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+namespace klee {
+
+  /// A MapOfSets which can be queried from several threads at once.
+  ///
+  /// Sets are distributed over a fixed number of shards by a signature of
+  /// their elements, so an exact lookup only ever locks a single shard.
+  /// Every stored set also carries a 64-bit bloom signature (two bits per
+  /// element); subset and superset searches use it to skip whole shards and
+  /// to reject individual candidates before doing any element comparison.
+  ///
+  /// Values are returned by copy since a pointer into a shard is not stable
+  /// once its lock has been released. Predicates are invoked with the shard
+  /// lock held and must not call back into the map.
+  ///
+  /// \tparam Hash Functor mapping an element to an unsigned hash value.
+  template<class K, class V, class Hash>
+  class ShardedMapOfSets {
+  public:
+    typedef uint64_t signature_ty;
+
+    explicit ShardedMapOfSets(unsigned numShards = 16);
+
+    void clear();
+
+    void insert(const std::set<K> &set, const V &value);
+
+    bool lookup(const std::set<K> &set, V &result) const;
+
+    /// Find a value stored for a superset of \a set satisfying \a p.
+    template<class Predicate>
+    bool findSuperset(const std::set<K> &set, const Predicate &p,
+                      V &result) const;
+
+    /// Find a value stored for a subset of \a set satisfying \a p.
+    template<class Predicate>
+    bool findSubset(const std::set<K> &set, const Predicate &p,
+                    V &result) const;
+
+    /// Invoke \a f on every stored value until it returns true.
+    template<class Function>
+    bool forEachValue(const Function &f) const;
+
+    unsigned getNumShards() const { return shards.size(); }
+
+    static signature_ty bloomSignature(const std::set<K> &set);
+
+  private:
+    struct Entry {
+      signature_ty bloom;
+      std::set<K> set;
+      V value;
+
+      Entry(signature_ty _bloom, const std::set<K> &_set, const V &_value)
+        : bloom(_bloom), set(_set), value(_value) {}
+    };
+
+    struct Shard {
+      mutable std::mutex lock;
+      /// Exact and subset lookups reuse the UBTree search.
+      MapOfSets<K, V> trie;
+      /// Flat copy of all sets in this shard, scanned for supersets.
+      std::vector<Entry> entries;
+      /// Bitwise or/and of the bloom signatures of all sets in this shard.
+      signature_ty unionBloom;
+      signature_ty intersectionBloom;
+
+      Shard() : unionBloom(0), intersectionBloom(~signature_ty(0)) {}
+    };
+
+    std::vector<std::unique_ptr<Shard> > shards;
+
+    static unsigned setHash(const std::set<K> &set);
+
+    Shard &shardFor(const std::set<K> &set) const {
+      return *shards[setHash(set) % shards.size()];
+    }
+  };
+
+  /***/
+
+  template<class K, class V, class Hash>
+  ShardedMapOfSets<K,V,Hash>::ShardedMapOfSets(unsigned numShards) {
+    assert(numShards && "invalid number of shards");
+    shards.reserve(numShards);
+    for (unsigned i = 0; i < numShards; ++i)
+      shards.emplace_back(new Shard());
+  }
+
+  template<class K, class V, class Hash>
+  typename ShardedMapOfSets<K,V,Hash>::signature_ty
+  ShardedMapOfSets<K,V,Hash>::bloomSignature(const std::set<K> &set) {
+    signature_ty bloom = 0;
+    Hash hasher;
+    for (auto const& element : set) {
+      unsigned h = hasher(element);
+      bloom |= signature_ty(1) << (h & 63);
+      bloom |= signature_ty(1) << ((h >> 6) & 63);
+    }
+    return bloom;
+  }
+
+  template<class K, class V, class Hash>
+  unsigned ShardedMapOfSets<K,V,Hash>::setHash(const std::set<K> &set) {
+    // Order independent so that it only depends on the set contents.
+    unsigned res = set.size();
+    Hash hasher;
+    for (auto const& element : set)
+      res += hasher(element) * 0x9E3779B1u;
+    return res ^ (res >> 16);
+  }
+
+  template<class K, class V, class Hash>
+  void ShardedMapOfSets<K,V,Hash>::insert(const std::set<K> &set,
+                                          const V &value) {
+    signature_ty bloom = bloomSignature(set);
+    Shard &shard = shardFor(set);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    V *existing = shard.trie.lookup(set);
+    shard.trie.insert(set, value);
+    if (existing) {
+      for (auto &entry : shard.entries) {
+        if (entry.bloom == bloom && entry.set == set) {
+          entry.value = value;
+          return;
+        }
+      }
+      assert(0 && "trie and entry list out of sync");
+    }
+
+    shard.entries.emplace_back(bloom, set, value);
+    shard.unionBloom |= bloom;
+    shard.intersectionBloom &= bloom;
+  }
+
+  template<class K, class V, class Hash>
+  bool ShardedMapOfSets<K,V,Hash>::lookup(const std::set<K> &set,
+                                          V &result) const {
+    Shard &shard = shardFor(set);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    if (V *res = shard.trie.lookup(set)) {
+      result = *res;
+      return true;
+    }
+    return false;
+  }
+
+  template<class K, class V, class Hash>
+  template<class Predicate>
+  bool ShardedMapOfSets<K,V,Hash>::findSuperset(const std::set<K> &set,
+                                                const Predicate &p,
+                                                V &result) const {
+    signature_ty bloom = bloomSignature(set);
+    for (auto const& shardPtr : shards) {
+      Shard &shard = *shardPtr;
+      std::lock_guard<std::mutex> guard(shard.lock);
+      // Some element of the query is in none of the stored sets.
+      if (bloom & ~shard.unionBloom)
+        continue;
+      for (auto const& entry : shard.entries) {
+        if ((bloom & ~entry.bloom) || entry.set.size() < set.size())
+          continue;
+        if (std::includes(entry.set.begin(), entry.set.end(),
+                          set.begin(), set.end()) &&
+            p(entry.value)) {
+          result = entry.value;
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+
+  template<class K, class V, class Hash>
+  template<class Predicate>
+  bool ShardedMapOfSets<K,V,Hash>::findSubset(const std::set<K> &set,
+                                              const Predicate &p,
+                                              V &result) const {
+    signature_ty bloom = bloomSignature(set);
+    for (auto const& shardPtr : shards) {
+      Shard &shard = *shardPtr;
+      std::lock_guard<std::mutex> guard(shard.lock);
+      // Every stored set has an element which is not in the query.
+      if (shard.entries.empty() || (shard.intersectionBloom & ~bloom))
+        continue;
+      if (V *res = shard.trie.findSubset(set, p)) {
+        result = *res;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  template<class K, class V, class Hash>
+  template<class Function>
+  bool ShardedMapOfSets<K,V,Hash>::forEachValue(const Function &f) const {
+    for (auto const& shardPtr : shards) {
+      Shard &shard = *shardPtr;
+      std::lock_guard<std::mutex> guard(shard.lock);
+      for (auto const& entry : shard.entries)
+        if (f(entry.value))
+          return true;
+    }
+    return false;
+  }
+
+  template<class K, class V, class Hash>
+  void ShardedMapOfSets<K,V,Hash>::clear() {
+    for (auto const& shardPtr : shards) {
+      Shard &shard = *shardPtr;
+      std::lock_guard<std::mutex> guard(shard.lock);
+      shard.trie.clear();
+      shard.entries.clear();
+      shard.unionBloom = 0;
+      shard.intersectionBloom = ~signature_ty(0);
+    }
+  }
+
+}
+
+#endif /* KLEE_SHARDEDMAPOFSETS_H */
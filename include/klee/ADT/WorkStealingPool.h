@@ -0,0 +1,98 @@
+//===-- WorkStealingPool.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_WORKSTEALINGPOOL_H
+#define KLEE_WORKSTEALINGPOOL_H
+
+#include <algorithm>
+#include <cassert>
+#include <deque>
+#include <vector>
+
+namespace klee {
+
+  /// A pool of work items distributed over a fixed number of owners.
+  ///
+  /// Every owner has a deque of its own. An owner pushes and takes items at
+  /// the back of its deque (LIFO, so it keeps working on what it produced
+  /// last), and once its deque runs dry it steals the oldest item of the
+  /// owner with the most items queued.
+  ///
+  /// The pool does no locking of its own; callers have to serialise
+  /// accesses.
+  template<class T>
+  class WorkStealingPool {
+    std::vector<std::deque<T> > queues;
+    size_t numItems;
+
+  public:
+    explicit WorkStealingPool(unsigned numOwners)
+      : queues(numOwners), numItems(0) {
+      assert(numOwners && "pool without owners");
+    }
+
+    unsigned getNumOwners() const { return queues.size(); }
+    size_t size() const { return numItems; }
+    bool empty() const { return numItems == 0; }
+    size_t size(unsigned owner) const { return queues[owner].size(); }
+
+    void push(unsigned owner, const T &item) {
+      queues[owner].push_back(item);
+      ++numItems;
+    }
+
+    /// Take the next item for \a owner, stealing from other owners if its
+    /// own deque is empty. Returns false if the pool is empty.
+    bool take(unsigned owner, T &result) {
+      std::deque<T> *queue = &queues[owner];
+      if (!queue->empty()) {
+        result = queue->back();
+        queue->pop_back();
+        --numItems;
+        return true;
+      }
+
+      if (!numItems)
+        return false;
+      queue = &*std::max_element(
+          queues.begin(), queues.end(),
+          [](const std::deque<T> &a, const std::deque<T> &b) {
+            return a.size() < b.size();
+          });
+      result = queue->front();
+      queue->pop_front();
+      --numItems;
+      return true;
+    }
+
+    /// Remove \a item from whichever deque it is queued in. Returns false
+    /// if it is not in the pool.
+    bool remove(const T &item) {
+      for (auto &queue : queues) {
+        auto it = std::find(queue.begin(), queue.end(), item);
+        if (it != queue.end()) {
+          queue.erase(it);
+          --numItems;
+          return true;
+        }
+      }
+      return false;
+    }
+
+    template<class Function>
+    void forEach(const Function &f) const {
+      for (auto const& queue : queues)
+        for (auto const& item : queue)
+          f(item);
+    }
+  };
+
+}
+
+#endif /* KLEE_WORKSTEALINGPOOL_H */
@@ -0,0 +1,145 @@
+//===-- CompiledExpr.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_COMPILEDEXPR_H
+#define KLEE_COMPILEDEXPR_H
+
+#include "klee/Expr/Expr.h"
+
+#include <cstdint>
+#include <iterator>
+#include <unordered_map>
+#include <vector>
+
+namespace klee {
+  class Assignment;
+
+  /// CompiledExpr - A set of expressions lowered to straight-line code over
+  /// 64-bit registers, for evaluating the same expressions under many
+  /// assignments.
+  ///
+  /// Every distinct subexpression becomes one instruction writing its own
+  /// register, so shared subexpressions are evaluated once per assignment
+  /// and evaluation needs neither virtual dispatch nor expression
+  /// allocation. Expressions wider than 64 bits are not compiled, in which
+  /// case (and for assignments allowing free values, or whenever evaluation
+  /// divides by zero) the AssignmentEvaluator is used instead.
+  class CompiledExpr {
+  public:
+    /// Number of assignments findSatisfying() evaluates at once.
+    static const unsigned BatchSize = 16;
+
+    /// The values of the compiled expressions under an assignment, in the
+    /// order they were given.
+    typedef std::vector<uint64_t> values_ty;
+
+  private:
+    struct Instruction {
+      Expr::Kind kind;
+      /// Width of the result.
+      Expr::Width width;
+      /// Width of the first operand (Concat: of the second operand).
+      Expr::Width operandWidth;
+      /// Registers holding the operands.
+      unsigned operands[3];
+      /// Constant value, Extract offset, or Read update chain.
+      uint64_t immediate;
+    };
+
+    /// One update of a compiled update list, newest first.
+    struct UpdateChain {
+      unsigned index, value;
+      /// Next older update, or -1 at the end of the list.
+      int next;
+    };
+
+    std::vector<ref<Expr> > roots;
+    std::vector<unsigned> rootRegisters;
+    std::vector<Instruction> instructions;
+    std::vector<UpdateChain> updateChains;
+    std::vector<const Array *> arrays;
+    bool valid;
+
+    /// Scratch space for evaluation, batches use BatchSize lanes per
+    /// register and array.
+    mutable std::vector<uint64_t> registers;
+    mutable std::vector<uint64_t> batchRegisters;
+    mutable std::vector<std::pair<const unsigned char *, size_t> > bindings;
+
+    std::unordered_map<const Expr *, unsigned> exprRegisters;
+    std::unordered_map<const UpdateNode *, int> chainIds;
+    std::unordered_map<const Array *, unsigned> arraySlots;
+
+    unsigned compile(const ref<Expr> &e);
+    int compileUpdates(const UpdateNode *head);
+    unsigned getArraySlot(const Array *array);
+
+    /// Run the program on the first `n` assignments of `batch`, one lane
+    /// each. Returns the mask of lanes which divided by zero.
+    template <unsigned Lanes>
+    unsigned execute(const Assignment *const *batch, unsigned n,
+                     uint64_t *regs) const;
+
+    /// Run the program, returns false on division by zero.
+    bool run(const Assignment &a) const;
+
+    /// Index of the first of `n` assignments satisfying all expressions,
+    /// or -1.
+    int findSatisfyingInBatch(Assignment *const *batch, unsigned n) const;
+
+  public:
+    explicit CompiledExpr(const std::vector<ref<Expr> > &exprs);
+
+    template <typename InputIterator>
+    CompiledExpr(InputIterator begin, InputIterator end)
+        : CompiledExpr(std::vector<ref<Expr> >(begin, end)) {}
+
+    /// Whether all expressions could be compiled.
+    bool isValid() const { return valid; }
+
+    unsigned getNumInstructions() const { return instructions.size(); }
+
+    /// Evaluate all expressions under `a`. Returns false if that was not
+    /// possible without the AssignmentEvaluator (see above).
+    bool evaluate(const Assignment &a, values_ty &values) const;
+
+    /// Whether all expressions, which must be boolean, evaluate to true
+    /// under `a`. Equivalent to `a.satisfies()` on the expressions.
+    bool isSatisfiedBy(Assignment &a) const;
+
+    /// Return the first assignment in [begin, end), a range of Assignment
+    /// pointers, satisfying all expressions, or end if there is none.
+    ///
+    /// Assignments are evaluated BatchSize at a time with one lane each, so
+    /// every instruction runs as a loop over contiguous lanes which the
+    /// compiler can vectorize.
+    template <typename InputIterator>
+    InputIterator findSatisfying(InputIterator begin, InputIterator end) const;
+  };
+
+  template <typename InputIterator>
+  InputIterator CompiledExpr::findSatisfying(InputIterator begin,
+                                             InputIterator end) const {
+    Assignment *batch[BatchSize];
+    while (begin != end) {
+      InputIterator first = begin;
+      unsigned n = 0;
+      for (; begin != end && n != BatchSize; ++begin)
+        batch[n++] = *begin;
+      int lane = findSatisfyingInBatch(batch, n);
+      if (lane >= 0) {
+        std::advance(first, lane);
+        return first;
+      }
+    }
+    return end;
+  }
+}
+
+#endif /* KLEE_COMPILEDEXPR_H */
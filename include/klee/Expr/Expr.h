@@ -19,6 +19,7 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <atomic>
 #include <sstream>
 #include <set>
 #include <vector>
@@ -90,7 +91,7 @@ Todo: Shouldn't bool \c Xor just be written as not equal?
 
 class Expr {
     public:
-        static unsigned count;
+        static std::atomic<unsigned> count;
         static const unsigned MAGIC_HASH_CONSTANT = 39;
 
         /// The type of an expression is simply its width, in bits. 
@@ -179,6 +180,18 @@ class Expr {
     protected:  
         unsigned hashValue;
 
+    private:
+        /// Whether this expression is the registered representative of its
+        /// structure (see createCachedExpr()).
+        bool isCached = false;
+
+        /// Next expression in the same bucket of the cache.
+        Expr *nextCached = nullptr;
+
+        friend struct ExprCacheTraits;
+
+    protected:
+
         /// Compares `b` to `this` Expr and determines how they are ordered
         /// (ignoring their kid expressions - i.e. those returned by `getKid()`).
         ///
@@ -205,7 +218,13 @@ class Expr {
 
     public:
         Expr() { Expr::count++; }
-        virtual ~Expr() { Expr::count--; } 
+        virtual ~Expr();
+
+        /// Expression nodes are short-lived and allocated in bulk, so their
+        /// memory is recycled through per-thread free lists instead of going
+        /// back to malloc every time.
+        static void *operator new(size_t size);
+        static void operator delete(void *p, size_t size);
 
         virtual Kind getKind() const = 0;
         virtual Width getWidth() const = 0;
@@ -240,6 +259,18 @@ class Expr {
         /// `<` and `>` are binary relations that express the total order.
         int compare(const Expr &b) const;
 
+        /// Returns the live expression structurally equal to `e` if there is
+        /// one, and otherwise registers `e` as the representative of its
+        /// structure.
+        ///
+        /// Every `alloc()` passes its result through this, so structurally
+        /// equivalent expressions are always the same object and share all
+        /// of their subexpressions. The table only keeps weak pointers; an
+        /// expression is dropped from it when it is destroyed.
+        ///
+        /// `e` must have its hash computed and its kids must be cached.
+        static ref<Expr> createCachedExpr(ref<Expr> e);
+
         // Given an array of new kids return a copy of the expression
         // but using those children. 
         virtual ref<Expr> rebuild(ref<Expr> kids[/* getNumKids() */]) const = 0;
@@ -284,10 +315,6 @@ class Expr {
         static bool needsResultType() { return false; }
 
         static bool classof(const Expr *) { return true; }
-
-    private:
-        typedef llvm::DenseSet<std::pair<const Expr *, const Expr *> > ExprEquivSet;
-        int compare(const Expr &b, ExprEquivSet &equivs) const;
 };
 
 struct Expr::CreateArg {
@@ -417,7 +444,7 @@ class NotOptimizedExpr : public NonConstantExpr {
         static ref<Expr> alloc(const ref<Expr> &src) {
             ref<Expr> r(new NotOptimizedExpr(src));
             r->computeHash();
-            return r;
+            return createCachedExpr(r);
         }
 
         static ref<Expr> create(ref<Expr> src);
@@ -447,6 +474,8 @@ class NotOptimizedExpr : public NonConstantExpr {
 };
 
 
+struct ConcreteUpdateIndex;
+
 /// Class representing a byte update of an array.
 class UpdateNode {
     friend class UpdateList;
@@ -454,6 +483,11 @@ class UpdateNode {
     // cache instead of recalc
     unsigned hashValue;
 
+    /// Lookup table over the updates with concrete indices starting at this
+    /// node, built on first use. Only every FlattenInterval-th node of a
+    /// list carries one (see findUpdate()).
+    mutable std::atomic<const ConcreteUpdateIndex *> concreteIndex{nullptr};
+
     public:
     const ref<UpdateNode> next;
     ref<Expr> index, value;
@@ -465,9 +499,33 @@ class UpdateNode {
     /// size of this update sequence, including this update
     unsigned size;
 
+    /// The array updated, only used to tell apart cached nodes of different
+    /// arrays, since solver builders cache the arrays of update nodes.
+    const Array *root;
+
+    /// Whether this node is the registered representative of its update
+    /// sequence (see create()).
+    bool isCached = false;
+
+    /// Next node in the same bucket of the cache.
+    UpdateNode *nextCached = nullptr;
+
+    friend struct UpdateNodeCacheTraits;
+
+    UpdateNode(const Array *_root, const ref<UpdateNode> &_next,
+               const ref<Expr> &_index, const ref<Expr> &_value);
+
     public:
-    UpdateNode(const ref<UpdateNode> &_next, const ref<Expr> &_index,
-            const ref<Expr> &_value);
+    /// Returns the live node writing `value` at `index` of `root` after the
+    /// updates `next` if there is one, and a new node otherwise.
+    ///
+    /// Like expressions, update sequences are hash-consed: equal sequences of
+    /// the same array are the same object, so lists can be compared by
+    /// their head.
+    static ref<UpdateNode> create(const Array *root,
+                                  const ref<UpdateNode> &next,
+                                  const ref<Expr> &index,
+                                  const ref<Expr> &value);
 
     unsigned getSize() const { return size; }
 
@@ -475,9 +533,24 @@ class UpdateNode {
     unsigned hash() const { return hashValue; }
 
     UpdateNode() = delete;
-    ~UpdateNode() = default;
+    ~UpdateNode();
 
     unsigned computeHash();
+
+    /// Number of updates between two nodes carrying a ConcreteUpdateIndex.
+    static const unsigned FlattenInterval = 64;
+
+    /// Returns the first update in the list starting at `un` which either
+    /// writes to the concrete index `index` or has a symbolic index, or null
+    /// if there is no such update.
+    ///
+    /// Updates with concrete indices are skipped a whole block at a time
+    /// using the lookup tables of every FlattenInterval-th node, which are
+    /// shared by all lists extending that node.
+    static UpdateNode *findUpdate(const UpdateNode *un, uint64_t index);
+
+    private:
+    const ConcreteUpdateIndex *getConcreteIndex() const;
 };
 
 class Array {
@@ -577,7 +650,7 @@ class ReadExpr : public NonConstantExpr {
         static ref<Expr> alloc(const UpdateList &updates, const ref<Expr> &index) {
             ref<Expr> r(new ReadExpr(updates, index));
             r->computeHash();
-            return r;
+            return createCachedExpr(r);
         }
 
         static ref<Expr> create(const UpdateList &updates, ref<Expr> i);
@@ -622,7 +695,7 @@ class SelectExpr : public NonConstantExpr {
                 const ref<Expr> &f) {
             ref<Expr> r(new SelectExpr(c, t, f));
             r->computeHash();
-            return r;
+            return createCachedExpr(r);
         }
 
         static ref<Expr> create(ref<Expr> c, ref<Expr> t, ref<Expr> f);
@@ -680,12 +753,13 @@ class ConcatExpr : public NonConstantExpr {
     private:
         Width width;
         ref<Expr> left, right;  
+        const ReadExpr *wideReadBase;
 
     public:
         static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {
             ref<Expr> c(new ConcatExpr(l, r));
             c->computeHash();
-            return c;
+            return createCachedExpr(c);
         }
 
         static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);
@@ -695,6 +769,14 @@ class ConcatExpr : public NonConstantExpr {
         ref<Expr> getLeft() const { return left; }
         ref<Expr> getRight() const { return right; }
 
+        /// getWideReadBase - If this expression is a little-endian load of
+        /// width/8 bytes at consecutive indices of one update list, the
+        /// right-leaning chain ObjectState::read builds, return the read of
+        /// the lowest byte, otherwise null. Such loads are recognized on
+        /// creation, so that evaluation and the solver builders can treat
+        /// them as a single read.
+        const ReadExpr *getWideReadBase() const { return wideReadBase; }
+
         unsigned getNumKids() const { return numKids; }
         ref<Expr> getKid(unsigned i) const { 
             if (i == 0) return left; 
@@ -714,10 +796,14 @@ class ConcatExpr : public NonConstantExpr {
         virtual ref<Expr> rebuild(ref<Expr> kids[]) const { return create(kids[0], kids[1]); }
 
     private:
-        ConcatExpr(const ref<Expr> &l, const ref<Expr> &r) : left(l), right(r) {
+        ConcatExpr(const ref<Expr> &l, const ref<Expr> &r)
+            : left(l), right(r), wideReadBase(findWideReadBase(l, r)) {
             width = l->getWidth() + r->getWidth();
         }
 
+        static const ReadExpr *findWideReadBase(const ref<Expr> &l,
+                                                const ref<Expr> &r);
+
     public:
         static bool classof(const Expr *E) {
             return E->getKind() == Expr::Concat;
@@ -752,7 +838,7 @@ class ExtractExpr : public NonConstantExpr {
         static ref<Expr> alloc(const ref<Expr> &e, unsigned o, Width w) {
             ref<Expr> r(new ExtractExpr(e, o, w));
             r->computeHash();
-            return r;
+            return createCachedExpr(r);
         }
 
         /// Creates an ExtractExpr with the given bit offset and width
@@ -803,7 +889,7 @@ class NotExpr : public NonConstantExpr {
         static ref<Expr> alloc(const ref<Expr> &e) {
             ref<Expr> r(new NotExpr(e));
             r->computeHash();
-            return r;
+            return createCachedExpr(r);
         }
 
         static ref<Expr> create(const ref<Expr> &e);
@@ -880,7 +966,7 @@ public:                                                          \
     static ref<Expr> alloc(const ref<Expr> &e, Width w) {        \
       ref<Expr> r(new _class_kind ## Expr(e, w));                \
       r->computeHash();                                          \
-      return r;                                                  \
+      return createCachedExpr(r);                                \
     }                                                            \
     static ref<Expr> create(const ref<Expr> &e, Width w);        \
     Kind getKind() const { return _class_kind; }                 \
@@ -913,7 +999,7 @@ CAST_EXPR_CLASS(ZExt)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return createCachedExpr(res);                                            \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Width getWidth() const { return left->getWidth(); }                        \
@@ -962,7 +1048,7 @@ ARITHMETIC_EXPR_CLASS(AShr)
     static ref<Expr> alloc(const ref<Expr> &l, const ref<Expr> &r) {           \
       ref<Expr> res(new _class_kind##Expr(l, r));                              \
       res->computeHash();                                                      \
-      return res;                                                              \
+      return createCachedExpr(res);                                            \
     }                                                                          \
     static ref<Expr> create(const ref<Expr> &l, const ref<Expr> &r);           \
     Kind getKind() const { return _class_kind; }                               \
@@ -1064,10 +1150,30 @@ class ConstantExpr : public Expr {
         static ref<Expr> fromMemory(void *address, Width w);
         void toMemory(void *address);
 
-        static ref<ConstantExpr> alloc(const llvm::APInt &v) {
+    private:
+        /// Number of values per width kept in the small constant table.
+        static const unsigned NumSmallConstants = 256;
+
+        /// Returns the preallocated constant for value `v` of width `w`, or
+        /// null if `v` is not in the small constant table. The table covers
+        /// both booleans and the values below NumSmallConstants at widths 8,
+        /// 16, 32 and 64, so the most common constants need neither an
+        /// allocation nor a cache lookup.
+        static ConstantExpr *getSmallConstant(uint64_t v, Width w);
+
+        static ref<ConstantExpr> allocNode(const llvm::APInt &v) {
             ref<ConstantExpr> r(new ConstantExpr(v));
             r->computeHash();
-            return r;
+            return cast<ConstantExpr>(createCachedExpr(r));
+        }
+
+    public:
+        static ref<ConstantExpr> alloc(const llvm::APInt &v) {
+            if (v.getBitWidth() <= 64)
+                if (ConstantExpr *c = getSmallConstant(v.getZExtValue(),
+                                                       v.getBitWidth()))
+                    return c;
+            return allocNode(v);
         }
 
         static ref<ConstantExpr> alloc(const llvm::APFloat &f) {
@@ -1075,7 +1181,9 @@ class ConstantExpr : public Expr {
         }
 
         static ref<ConstantExpr> alloc(uint64_t v, Width w) {
-            return alloc(llvm::APInt(w, v));
+            if (ConstantExpr *c = getSmallConstant(v, w))
+                return c;
+            return allocNode(llvm::APInt(w, v));
         }
 
         static ref<ConstantExpr> create(uint64_t v, Width w) {
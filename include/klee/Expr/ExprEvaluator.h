@@ -18,6 +18,7 @@ namespace klee {
   protected:
     Action evalRead(const UpdateList &ul, unsigned index);
     Action visitRead(const ReadExpr &re);
+    Action visitConcat(const ConcatExpr &ce);
     Action visitExpr(const Expr &e);
       
     Action protectedDivOperation(const BinaryExpr &e);
@@ -12,8 +12,13 @@
 
 #include "klee/Expr/Expr.h"
 
-#include <unordered_map>
-#include <unordered_set>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 namespace klee {
 
@@ -21,22 +26,344 @@ namespace klee {
     struct ExprHash  {
       unsigned operator()(const ref<Expr> &e) const { return e->hash(); }
     };
-    
+
     struct ExprCmp {
       bool operator()(const ref<Expr> &a, const ref<Expr> &b) const {
         return a==b;
       }
     };
+
+    struct ExprSetKey {
+      const ref<Expr> &operator()(const ref<Expr> &e) const { return e; }
+    };
+
+    template <class T> struct ExprMapKey {
+      const ref<Expr> &
+      operator()(const std::pair<const ref<Expr>, T> &v) const {
+        return v.first;
+      }
+    };
+
+    /// ExprHashTable - A hash table with expression keys, using open
+    /// addressing with linear probing.
+    ///
+    /// Entries live in one flat array instead of separately allocated
+    /// nodes, with a parallel array of flags marking the occupied slots.
+    /// Values are only ever constructed and destroyed in place, never
+    /// assigned, so value types with stateful assignment (e.g. handles
+    /// which must not be assigned across solver contexts) are safe to
+    /// store. Erasing moves the following entries of the probe sequence
+    /// back, so there are no tombstones and lookups never get slower
+    /// through deletions.
+    ///
+    /// Inserting may move entries, which invalidates iterators, pointers
+    /// and references into the table.
+    template <class Value, class KeyOfValue> class ExprHashTable {
+    public:
+      typedef ref<Expr> key_type;
+      typedef Value value_type;
+      typedef std::size_t size_type;
+
+      template <class V> class iterator_base {
+        friend class ExprHashTable;
+        V *slot, *last;
+        const bool *used;
+
+        iterator_base(V *_slot, V *_last, const bool *_used)
+            : slot(_slot), last(_last), used(_used) {
+          skipEmpty();
+        }
+
+        void skipEmpty() {
+          while (slot != last && !*used) {
+            ++slot;
+            ++used;
+          }
+        }
+
+      public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef V value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef V *pointer;
+        typedef V &reference;
+
+        iterator_base() : slot(nullptr), last(nullptr), used(nullptr) {}
+
+        // Conversion from iterator to const_iterator.
+        template <class U>
+        iterator_base(const iterator_base<U> &it)
+            : slot(it.slot), last(it.last), used(it.used) {}
+
+        V &operator*() const { return *slot; }
+        V *operator->() const { return slot; }
+
+        iterator_base &operator++() {
+          ++slot;
+          ++used;
+          skipEmpty();
+          return *this;
+        }
+        iterator_base operator++(int) {
+          iterator_base result = *this;
+          ++*this;
+          return result;
+        }
+
+        bool operator==(const iterator_base &b) const { return slot == b.slot; }
+        bool operator!=(const iterator_base &b) const { return slot != b.slot; }
+
+        template <class U> friend class iterator_base;
+      };
+
+      typedef iterator_base<Value> iterator;
+      typedef iterator_base<const Value> const_iterator;
+
+    private:
+      static const size_type MinCapacity = 16;
+
+      typedef typename std::aligned_storage<sizeof(Value), alignof(Value)>::type
+          Storage;
+
+      std::unique_ptr<Storage[]> slots;
+      std::unique_ptr<bool[]> used;
+      size_type capacity = 0;
+      size_type numEntries = 0;
+      /// Shift turning a 64-bit hash into a slot index.
+      unsigned shift = 64;
+
+      static const ref<Expr> &keyOf(const Value &v) { return KeyOfValue()(v); }
+
+      Value *data() { return reinterpret_cast<Value *>(slots.get()); }
+      const Value *data() const {
+        return reinterpret_cast<const Value *>(slots.get());
+      }
+      Value &at(size_type i) { return data()[i]; }
+      const Value &at(size_type i) const { return data()[i]; }
+
+      size_type mask() const { return capacity - 1; }
+
+      /// Home slot of `key`. The cached expression hash is spread over all
+      /// bits first, so that runs of similar hashes don't form clusters.
+      size_type home(const ref<Expr> &key) const {
+        return (size_type) ((key->hash() * UINT64_C(0x9E3779B97F4A7C15)) >>
+                            shift);
+      }
+
+      static bool equals(const ref<Expr> &a, const ref<Expr> &b) {
+        // Expressions are hash-consed, so equal keys are usually the same
+        // node.
+        return a.get() == b.get() || (a->hash() == b->hash() && a == b);
+      }
+
+      /// Slot holding `key`, or the empty slot where it would be inserted.
+      /// The table must not be empty.
+      size_type findSlot(const ref<Expr> &key) const {
+        size_type i = home(key);
+        while (used[i] && !equals(keyOf(at(i)), key))
+          i = (i + 1) & mask();
+        return i;
+      }
+
+      /// Allocate empty slots for a table of `n` entries.
+      void allocate(size_type n) {
+        slots.reset(new Storage[n]);
+        used.reset(new bool[n]());
+        capacity = n;
+        shift = 64;
+        for (size_type c = n; c > 1; c >>= 1)
+          --shift;
+      }
+
+      void destroyAll() {
+        for (size_type i = 0; i != capacity; ++i) {
+          if (used[i]) {
+            at(i).~Value();
+            used[i] = false;
+          }
+        }
+        numEntries = 0;
+      }
+
+      void rehash(size_type n) {
+        std::unique_ptr<Storage[]> previousSlots = std::move(slots);
+        std::unique_ptr<bool[]> previousUsed = std::move(used);
+        size_type previousCapacity = capacity;
+        allocate(n);
+
+        Value *previous = reinterpret_cast<Value *>(previousSlots.get());
+        for (size_type i = 0; i != previousCapacity; ++i) {
+          if (!previousUsed[i])
+            continue;
+          size_type j = findSlot(keyOf(previous[i]));
+          new (&at(j)) Value(std::move(previous[i]));
+          used[j] = true;
+          previous[i].~Value();
+        }
+      }
+
+      /// Grow the table so that `n` entries stay below 3/4 load.
+      void grow(size_type n) {
+        size_type c = capacity ? capacity : MinCapacity;
+        while (n * 4 > c * 3)
+          c *= 2;
+        if (c != capacity)
+          rehash(c);
+      }
+
+      template <class V> std::pair<iterator, bool> insertValue(V &&v) {
+        grow(numEntries + 1);
+        size_type i = findSlot(keyOf(v));
+        bool inserted = !used[i];
+        if (inserted) {
+          new (&at(i)) Value(std::forward<V>(v));
+          used[i] = true;
+          ++numEntries;
+        }
+        return std::make_pair(iterator(&at(i), data() + capacity, &used[i]),
+                              inserted);
+      }
+
+    public:
+      ExprHashTable() = default;
+
+      /// Create a table for about `n` entries, e.g. the number of nodes of
+      /// the expressions which are going to be visited.
+      explicit ExprHashTable(size_type n) { reserve(n); }
+
+      ExprHashTable(const ExprHashTable &b) {
+        if (!b.capacity)
+          return;
+        // Same capacity, so every entry keeps its slot.
+        allocate(b.capacity);
+        for (size_type i = 0; i != capacity; ++i) {
+          if (b.used[i]) {
+            new (&at(i)) Value(b.at(i));
+            used[i] = true;
+          }
+        }
+        numEntries = b.numEntries;
+      }
+
+      ExprHashTable(ExprHashTable &&b) noexcept { swap(b); }
+
+      ExprHashTable &operator=(ExprHashTable b) {
+        swap(b);
+        return *this;
+      }
+
+      ~ExprHashTable() { destroyAll(); }
+
+      void swap(ExprHashTable &b) noexcept {
+        std::swap(slots, b.slots);
+        std::swap(used, b.used);
+        std::swap(capacity, b.capacity);
+        std::swap(numEntries, b.numEntries);
+        std::swap(shift, b.shift);
+      }
+
+      size_type size() const { return numEntries; }
+      bool empty() const { return numEntries == 0; }
+
+      /// Make room for `n` entries without further rehashing.
+      void reserve(size_type n) { grow(n); }
+
+      void clear() {
+        if (numEntries)
+          destroyAll();
+      }
+
+      iterator begin() {
+        return iterator(data(), data() + capacity, used.get());
+      }
+      iterator end() {
+        Value *last = data() + capacity;
+        return iterator(last, last, used.get() + capacity);
+      }
+      const_iterator begin() const {
+        return const_iterator(data(), data() + capacity, used.get());
+      }
+      const_iterator end() const {
+        const Value *last = data() + capacity;
+        return const_iterator(last, last, used.get() + capacity);
+      }
+
+      iterator find(const ref<Expr> &key) {
+        if (!numEntries)
+          return end();
+        size_type i = findSlot(key);
+        if (!used[i])
+          return end();
+        return iterator(&at(i), data() + capacity, &used[i]);
+      }
+      const_iterator find(const ref<Expr> &key) const {
+        return const_cast<ExprHashTable *>(this)->find(key);
+      }
+
+      size_type count(const ref<Expr> &key) const {
+        return find(key) != end();
+      }
+
+      std::pair<iterator, bool> insert(const Value &v) {
+        return insertValue(v);
+      }
+      std::pair<iterator, bool> insert(Value &&v) {
+        return insertValue(std::move(v));
+      }
+      template <class P> std::pair<iterator, bool> insert(P &&v) {
+        return insertValue(Value(std::forward<P>(v)));
+      }
+
+      size_type erase(const ref<Expr> &key) {
+        if (!numEntries)
+          return 0;
+        size_type i = findSlot(key);
+        if (!used[i])
+          return 0;
+
+        at(i).~Value();
+        // Move back every following entry of the run whose home slot does
+        // not lie between the hole and the entry itself.
+        for (size_type j = (i + 1) & mask(); used[j]; j = (j + 1) & mask()) {
+          size_type k = home(keyOf(at(j)));
+          bool stays = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+          if (!stays) {
+            new (&at(i)) Value(std::move(at(j)));
+            at(j).~Value();
+            i = j;
+          }
+        }
+        used[i] = false;
+        --numEntries;
+        return 1;
+      }
+    };
   }
 
   template <class T>
   class ExprHashMap
-      : public std::unordered_map<ref<Expr>, T, klee::util::ExprHash,
-                                  klee::util::ExprCmp> {};
+      : public util::ExprHashTable<std::pair<const ref<Expr>, T>,
+                                   util::ExprMapKey<T> > {
+    // Keys are const, like in the standard containers, so that they cannot
+    // be changed in place behind the table's back.
+    typedef util::ExprHashTable<std::pair<const ref<Expr>, T>,
+                                util::ExprMapKey<T> >
+        base;
+
+  public:
+    typedef T mapped_type;
+
+    using base::base;
+
+    T &operator[](const ref<Expr> &key) {
+      auto it = this->find(key);
+      if (it == this->end())
+        it = this->insert(std::make_pair(key, T())).first;
+      return it->second;
+    }
+  };
 
-  typedef std::unordered_set<ref<Expr>, klee::util::ExprHash,
-                             klee::util::ExprCmp>
-      ExprHashSet;
+  typedef util::ExprHashTable<ref<Expr>, util::ExprSetKey> ExprHashSet;
 } // namespace klee
 
 #endif /* KLEE_EXPRHASHMAP_H */
@@ -0,0 +1,156 @@
+//===-- ExprPatternMatch.h --------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Matchers for writing expression patterns declaratively, in the style of
+// llvm/IR/PatternMatch.h:
+//
+//   ref<Expr> x;
+//   unsigned offset;
+//   if (match(e, m_Extract(m_ZExt(m_Expr(x)), offset)))
+//     ...
+//
+// Patterns are plain structs, so the compiler turns each of them into
+// straight-line matching code. Binding matchers assign their argument as
+// soon as their subpattern matches, even if the pattern as a whole fails.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRPATTERNMATCH_H
+#define KLEE_EXPRPATTERNMATCH_H
+
+#include "klee/Expr/Expr.h"
+
+namespace klee {
+namespace PatternMatch {
+
+template <typename Pattern>
+bool match(const ref<Expr> &e, const Pattern &p) {
+  return p.match(e);
+}
+
+/// Matches any expression and binds it.
+struct ExprBinder {
+  ref<Expr> &bound;
+  bool match(const ref<Expr> &e) const {
+    bound = e;
+    return true;
+  }
+};
+inline ExprBinder m_Expr(ref<Expr> &e) { return ExprBinder{e}; }
+
+/// Matches a constant and binds it.
+struct ConstantBinder {
+  ref<ConstantExpr> &bound;
+  bool match(const ref<Expr> &e) const {
+    if (ConstantExpr *ce = dyn_cast<ConstantExpr>(e)) {
+      bound = ce;
+      return true;
+    }
+    return false;
+  }
+};
+inline ConstantBinder m_Constant(ref<ConstantExpr> &c) {
+  return ConstantBinder{c};
+}
+
+/// Matches one specific expression. Expressions are hash-consed, so this is
+/// a pointer comparison.
+struct SpecificMatcher {
+  const ref<Expr> &expected;
+  bool match(const ref<Expr> &e) const { return e.get() == expected.get(); }
+};
+inline SpecificMatcher m_Specific(const ref<Expr> &e) {
+  return SpecificMatcher{e};
+}
+
+/// Matches the zero constant of any width.
+struct ZeroMatcher {
+  bool match(const ref<Expr> &e) const {
+    const ConstantExpr *ce = dyn_cast<ConstantExpr>(e);
+    return ce && ce->isZero();
+  }
+};
+inline ZeroMatcher m_Zero() { return ZeroMatcher(); }
+
+template <Expr::Kind K, typename Sub> struct UnaryMatcher {
+  Sub sub;
+  bool match(const ref<Expr> &e) const {
+    return e->getKind() == K && sub.match(e->getKid(0));
+  }
+};
+
+template <Expr::Kind K, typename LHS, typename RHS> struct BinaryMatcher {
+  LHS lhs;
+  RHS rhs;
+  bool match(const ref<Expr> &e) const {
+    return e->getKind() == K && lhs.match(e->getKid(0)) &&
+           rhs.match(e->getKid(1));
+  }
+};
+
+/// Matches an Extract and binds its offset. The width is the width of the
+/// matched expression.
+template <typename Sub> struct ExtractMatcher {
+  Sub sub;
+  unsigned &offset;
+  bool match(const ref<Expr> &e) const {
+    if (const ExtractExpr *ee = dyn_cast<ExtractExpr>(e)) {
+      if (sub.match(ee->expr)) {
+        offset = ee->offset;
+        return true;
+      }
+    }
+    return false;
+  }
+};
+template <typename Sub>
+ExtractMatcher<Sub> m_Extract(const Sub &sub, unsigned &offset) {
+  return ExtractMatcher<Sub>{sub, offset};
+}
+
+#define KLEE_UNARY_MATCHER(_kind)                                              \
+  template <typename Sub>                                                      \
+  UnaryMatcher<Expr::_kind, Sub> m_##_kind(const Sub &sub) {                   \
+    return UnaryMatcher<Expr::_kind, Sub>{sub};                                \
+  }
+
+KLEE_UNARY_MATCHER(ZExt)
+KLEE_UNARY_MATCHER(SExt)
+KLEE_UNARY_MATCHER(Not)
+
+#undef KLEE_UNARY_MATCHER
+
+#define KLEE_BINARY_MATCHER(_kind)                                             \
+  template <typename LHS, typename RHS>                                        \
+  BinaryMatcher<Expr::_kind, LHS, RHS> m_##_kind(const LHS &l, const RHS &r) { \
+    return BinaryMatcher<Expr::_kind, LHS, RHS>{l, r};                         \
+  }
+
+KLEE_BINARY_MATCHER(Concat)
+KLEE_BINARY_MATCHER(Add)
+KLEE_BINARY_MATCHER(Sub)
+KLEE_BINARY_MATCHER(Mul)
+KLEE_BINARY_MATCHER(And)
+KLEE_BINARY_MATCHER(Or)
+KLEE_BINARY_MATCHER(Xor)
+KLEE_BINARY_MATCHER(Shl)
+KLEE_BINARY_MATCHER(LShr)
+KLEE_BINARY_MATCHER(AShr)
+KLEE_BINARY_MATCHER(Eq)
+KLEE_BINARY_MATCHER(Ult)
+KLEE_BINARY_MATCHER(Ule)
+KLEE_BINARY_MATCHER(Slt)
+KLEE_BINARY_MATCHER(Sle)
+
+#undef KLEE_BINARY_MATCHER
+
+} // namespace PatternMatch
+} // namespace klee
+
+#endif /* KLEE_EXPRPATTERNMATCH_H */
@@ -0,0 +1,41 @@
+//===-- ExprRewriter.h ------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_EXPRREWRITER_H
+#define KLEE_EXPRREWRITER_H
+
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprVisitor.h"
+
+namespace klee {
+  /// ExprRewriter - Simplifies expressions with the rewrite rules listed in
+  /// ExprRewriter.cpp, which go beyond the folding done by the
+  /// `Expr::create` functions: chains of extracts and casts, extracts and
+  /// concatenations over bytes of wider expressions, and comparisons of
+  /// extended values.
+  ///
+  /// Rules are applied bottom-up until none matches. Results are memoized
+  /// by the visitor, so a rewriter may be kept to share work between
+  /// expressions.
+  class ExprRewriter : public ExprVisitor {
+  protected:
+    Action visitExprPost(const Expr &e);
+
+  public:
+    ExprRewriter() : ExprVisitor(true) {}
+
+    ref<Expr> rewrite(const ref<Expr> &e) { return visit(e); }
+
+    /// Apply the rules to the root of `e` only. Returns `e` if none
+    /// matches.
+    static ref<Expr> rewriteRoot(const ref<Expr> &e);
+  };
+}
+
+#endif /* KLEE_EXPRREWRITER_H */
@@ -12,6 +12,8 @@
 
 #include "ExprHashMap.h"
 
+#include <vector>
+
 namespace klee {
   class ExprVisitor {
   protected:
@@ -85,11 +87,45 @@ namespace klee {
     visited_ty visited;
     bool recursive;
 
-    ref<Expr> visitActual(const ref<Expr> &e);
+    /// One pending visit of the explicit traversal stack.
+    struct Frame {
+      enum Stage {
+        Pre,     ///< Nothing called yet.
+        Kids,    ///< Visiting the children.
+        Rebuilt, ///< Visiting the expression rebuilt from new children.
+        Post     ///< Calling visitExprPost on `current`.
+      };
+
+      ref<Expr> e;
+      /// The expression after visiting the children.
+      ref<Expr> current;
+      ref<Expr> kids[8];
+      Stage stage;
+      unsigned nextKid;
+      bool rebuild;
+
+      explicit Frame(const ref<Expr> &_e)
+          : e(_e), current(_e), stage(Pre), nextKid(0), rebuild(false) {}
+
+      void setKid(const ref<Expr> &kid) {
+        if (kid != e->getKid(nextKid))
+          rebuild = true;
+        kids[nextKid++] = kid;
+      }
+    };
+    std::vector<Frame> stack;
+
+    /// Result of visiting `e` without calling the visitor, which is known
+    /// for constants and for memoized expressions.
+    bool lookup(const ref<Expr> &e, ref<Expr> &result) const;
+    Action visitKind(const Expr &ep);
     
   public:
     // apply the visitor to the expression and return a possibly
     // modified new expression.
+    //
+    // Every subexpression is visited once per visitor, however often it is
+    // shared, unless --use-visitor-hash is disabled.
     ref<Expr> visit(const ref<Expr> &e);
   };
 
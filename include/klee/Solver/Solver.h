@@ -221,6 +221,18 @@ namespace klee {
     /// \param s - The underlying solver to use.
     Solver *createAssignmentValidatingSolver(Solver *s);
 
+    /// createTimeoutPredictingSolver - Create a solver which learns which
+    /// kinds of queries time out in the underlying solver, fails such
+    /// queries without running them and adapts the timeout of each query to
+    /// the solving times seen for similar queries.
+    /// \param s - The underlying solver to use.
+    Solver *createTimeoutPredictingSolver(Solver *s);
+
+    /// createRewritingSolver - Create a solver which simplifies queries with
+    /// the rewrite rules of ExprRewriter before passing them on.
+    /// \param s - The underlying solver to use.
+    Solver *createRewritingSolver(Solver *s);
+
     /// createCachingSolver - Create a solver which will cache the queries in
     /// memory (without eviction).
     ///
@@ -26,6 +26,8 @@ namespace stats {
   extern Statistic queryConstructs;
   extern Statistic queryCounterexamples;
   extern Statistic queryTime;
+  extern Statistic queryTimeouts;
+  extern Statistic queryTimeoutsPredicted;
   
 #ifdef KLEE_ARRAY_DEBUG
   extern Statistic arrayHashTime;
@@ -46,6 +46,9 @@ namespace klee {
     StatisticRecord *contextStats;
     unsigned index;
 
+    /// Per-thread redirection of increments, see setThreadRecord().
+    static thread_local StatisticRecord *threadRecord;
+
   public:
     StatisticManager();
     ~StatisticManager();
@@ -55,6 +58,14 @@ namespace klee {
     StatisticRecord *getContext();
     void setContext(StatisticRecord *sr); /* null to reset */
 
+    /// Collect all increments made by the calling thread in \a sr instead
+    /// of the shared counters (null to reset). Worker threads use this so
+    /// that their statistics can be merged back by the main thread.
+    static void setThreadRecord(StatisticRecord *sr) { threadRecord = sr; }
+
+    /// Add the values collected in \a sr to the current statistics.
+    void mergeStatistics(const StatisticRecord &sr);
+
     void setIndex(unsigned i) { index = i; }
     unsigned getIndex() { return index; }
     unsigned getNumStatistics() { return stats.size(); }
@@ -76,6 +87,10 @@ namespace klee {
   inline void StatisticManager::incrementStatistic(Statistic &s, 
                                                    uint64_t addend) {
     if (enabled) {
+      if (StatisticRecord *sr = threadRecord) {
+        sr->data[s.id] += addend;
+        return;
+      }
       globalStats[s.id] += addend;
       if (indexedStats) {
         indexedStats[index*stats.size() + s.id] += addend;
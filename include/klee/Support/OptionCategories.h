@@ -20,6 +20,7 @@ namespace klee {
   extern llvm::cl::OptionCategory DebugCat;
   extern llvm::cl::OptionCategory MergeCat;
   extern llvm::cl::OptionCategory ModuleCat;
+  extern llvm::cl::OptionCategory ParallelCat;
   extern llvm::cl::OptionCategory SeedingCat;
   extern llvm::cl::OptionCategory SolvingCat;
   extern llvm::cl::OptionCategory TerminationCat;
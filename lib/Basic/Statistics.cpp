@@ -40,6 +40,22 @@ void StatisticManager::registerStatistic(Statistic &s) {
   memset(globalStats, 0, sizeof(*globalStats)*stats.size());
 }
 
+void StatisticManager::mergeStatistics(const StatisticRecord &sr) {
+  if (!enabled)
+    return;
+  for (unsigned i=0; i<stats.size(); i++) {
+    uint64_t addend = sr.data[i];
+    if (!addend)
+      continue;
+    globalStats[i] += addend;
+    if (indexedStats) {
+      indexedStats[index*stats.size() + i] += addend;
+      if (contextStats)
+        contextStats->data[i] += addend;
+    }
+  }
+}
+
 int StatisticManager::getStatisticID(const std::string &name) const {
   for (unsigned i=0; i<stats.size(); i++)
     if (stats[i]->getName() == name)
@@ -55,6 +71,7 @@ Statistic *StatisticManager::getStatisticByName(const std::string &name) const {
 }
 
 StatisticManager *klee::theStatisticManager = 0;
+thread_local StatisticRecord *StatisticManager::threadRecord = nullptr;
 
 static StatisticManager &getStatisticManager() {
   static StatisticManager sm;
@@ -47,6 +47,16 @@ namespace stats {
   /// distance to a function return.
   extern Statistic minDistToReturn;
 
+  /// Instruction level statistic tracking the minimum distance to an
+  /// exploit sink: a store through a pointer, an indirect call or a call
+  /// writing to memory, like memcpy. Unlike the distances above, this one
+  /// also counts sinks reached through calls. Sinks don't change during
+  /// execution, so this is computed once.
+  extern Statistic minDistToExploitSink;
+
+  /// Number of round trips to the native memory agent.
+  extern Statistic nmeRequests;
+
 }
 }
 
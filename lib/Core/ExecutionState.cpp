@@ -71,16 +71,17 @@ ExecutionState::ExecutionState(KFunction *kf) :
 
     depth(0),
 
+    replayPathPosition(0),
     instsSinceCovNew(0),
     coveredNew(false),
     forkDisabled(false),
-    ptreeNode(0),
+    ptreeNode(PTree::None),
     steppedInstructions(0){
   pushFrame(0, kf);
 }
 
 ExecutionState::ExecutionState(const std::vector<ref<Expr> > &assumptions)
-    : constraints(assumptions), ptreeNode(0) {}
+    : constraints(assumptions), ptreeNode(PTree::None) {}
 
 ExecutionState::~ExecutionState() {
     for (auto cur_mergehandler: openMergeStack){
@@ -107,6 +108,8 @@ ExecutionState::ExecutionState(const ExecutionState& state):
 
     pathOS(state.pathOS),
     symPathOS(state.symPathOS),
+    replayPathPosition(state.replayPathPosition),
+    replayPath(state.replayPath),
 
     instsSinceCovNew(state.instsSinceCovNew),
     coveredNew(state.coveredNew),
@@ -124,9 +127,13 @@ ExecutionState::ExecutionState(const ExecutionState& state):
 ExecutionState *ExecutionState::branch() {
     depth++;
 
+    // The lines covered so far stay with this state, so keep them out of
+    // the copy rather than copying and clearing them.
+    std::map<const std::string *, std::set<unsigned> > lines;
+    lines.swap(coveredLines);
     ExecutionState *falseState = new ExecutionState(*this);
+    coveredLines.swap(lines);
     falseState->coveredNew = false;
-    falseState->coveredLines.clear();
 
     return falseState;
 }
@@ -175,6 +182,11 @@ bool ExecutionState::merge(const ExecutionState &b) {
     if (symbolics != b.symbolics)
         return false;
 
+    // With native memory emulation, the native heap of both states has to
+    // look the same, it can't hold an ite of two layouts.
+    if (!hasSameHeapLayout(b))
+        return false;
+
     {
         std::vector<StackFrame>::const_iterator itA = stack.begin();
         std::vector<StackFrame>::const_iterator itB = b.stack.begin();
@@ -324,6 +336,18 @@ bool ExecutionState::merge(const ExecutionState &b) {
     return true;
 }
 
+bool ExecutionState::hasSameHeapLayout(const ExecutionState &b) const {
+    if (heap_allocs.size() != b.heap_allocs.size())
+        return false;
+    for (unsigned i = 0; i < heap_allocs.size(); ++i) {
+        const HeapAlloc &ha = heap_allocs[i], &hb = b.heap_allocs[i];
+        if (ha != hb || ha.alignment != hb.alignment ||
+                ha.nativeAddress != hb.nativeAddress)
+            return false;
+    }
+    return true;
+}
+
 void ExecutionState::dumpStack(llvm::raw_ostream &out) const {
   unsigned idx = 0;
   const KInstruction *target = prevPC;
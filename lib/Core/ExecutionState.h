@@ -12,7 +12,10 @@
 
 #include "AddressSpace.h"
 #include "MergeHandler.h"
+#include "PTree.h"
 
+#include "klee/ADT/CopyOnWriteVector.h"
+#include "klee/ADT/ImmutableSet.h"
 #include "klee/ADT/TreeStream.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
@@ -20,6 +23,7 @@
 #include "klee/System/Time.h"
 
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -30,7 +34,7 @@ struct Cell;
 struct KFunction;
 struct KInstruction;
 class MemoryObject;
-class PTreeNode;
+class ExecutionState;
 struct InstructionInfo;
 
 llvm::raw_ostream &operator<<(llvm::raw_ostream &os, const MemoryMap &mm);
@@ -62,6 +66,14 @@ struct StackFrame {
   ~StackFrame();
 };
 
+/// Where a searcher keeps a state, see ExecutionState::searcherSlots.
+struct SearcherSlot {
+  /// Neighbours in a searcher's list of states.
+  ExecutionState *prev = nullptr, *next = nullptr;
+  /// Position in a searcher's array of states.
+  std::size_t index = 0;
+};
+
 /* Jiaqi */
 struct HeapAlloc {
     // llvm::Value* allocSite;
@@ -121,7 +133,8 @@ class ExecutionState {
     public:
         typedef std::vector<StackFrame> stack_ty;
         /* Jiaqi */
-        typedef std::vector<HeapAlloc> heap_alloc;
+        /// Shared between forks until one of them allocates or frees
+        typedef CopyOnWriteVector<HeapAlloc> heap_alloc;
         // heap_alloc heap_allocs;
         // int native_idx; // indicate to which heap_alloc in the vector has been natively executed. 
         /* /Jiaqi */
@@ -178,6 +191,15 @@ class ExecutionState {
         /// taken to reach/create this state
         TreeOStream symPathOS;
 
+        /// @brief Number of entries of the replay path (if any) which this
+        /// state has followed so far
+        unsigned replayPathPosition;
+
+        /// @brief Branch decisions this state follows before it explores on
+        /// its own, set when re-executing a spilled state (see
+        /// --spill-states). Takes precedence over the executor's replay path.
+        std::shared_ptr<const std::vector<bool> > replayPath;
+
         /// @brief Counts how many instructions were executed since the last new
         /// instruction was covered.
         unsigned instsSinceCovNew;
@@ -191,16 +213,14 @@ class ExecutionState {
         /// @brief Set containing which lines in which files are covered by this state
         std::map<const std::string *, std::set<unsigned> > coveredLines;
 
-        /// @brief Pointer to the process tree of the current state
-        PTreeNode *ptreeNode;
+        /// @brief Node of the current state in the process tree
+        PTreeNodeID ptreeNode;
 
         /// @brief Ordered list of symbolics: used to generate test cases.
-        //
-        // FIXME: Move to a shared list structure (not critical).
-        std::vector<std::pair<ref<const MemoryObject>, const Array *>> symbolics;
+        CopyOnWriteVector<std::pair<ref<const MemoryObject>, const Array *>> symbolics;
 
         /// @brief Set of used array names for this state.  Used to avoid collisions.
-        std::set<std::string> arrayNames;
+        ImmutableSet<std::string> arrayNames;
 
         // The objects handling the klee_open_merge calls this state ran through
         std::vector<ref<MergeHandler> > openMergeStack;
@@ -208,8 +228,19 @@ class ExecutionState {
         // The numbers of times this state has run through Executor::stepInstruction
         std::uint64_t steppedInstructions;
 
+        /// @brief Positions of this state in the searchers holding it,
+        /// indexed by the searchers' slot numbers, so that they can remove
+        /// it in constant time. Not copied on branch.
+        std::vector<SearcherSlot> searcherSlots;
+
+        SearcherSlot &searcherSlot(unsigned slot) {
+            if (slot >= searcherSlots.size())
+                searcherSlots.resize(slot + 1);
+            return searcherSlots[slot];
+        }
+
     private:
-        ExecutionState() : ptreeNode(0) {}
+        ExecutionState() : ptreeNode(PTree::None) {}
 
     public:
         ExecutionState(KFunction *kf);
@@ -231,6 +262,11 @@ class ExecutionState {
         void addConstraint(ref<Expr> e) { constraints.addConstraint(e); }
 
         bool merge(const ExecutionState &b);
+
+        /// @brief Whether this state and \arg b made the same heap requests
+        /// and got the same native addresses for them
+        bool hasSameHeapLayout(const ExecutionState &b) const;
+
         void dumpStack(llvm::raw_ostream &out) const;
 };
 }
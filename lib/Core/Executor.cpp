@@ -80,6 +80,7 @@
 #include <sstream>
 #include <string>
 #include <sys/mman.h>
+#include <thread>
 #include <vector>
 
 //Haoxin for AEG
@@ -108,12 +109,25 @@ cl::OptionCategory
 cl::OptionCategory TestGenCat("Test generation options",
                               "These options impact test generation.");
 
+cl::OptionCategory ParallelCat("Parallel exploration options",
+                               "These options control spreading the "
+                               "exploration over several threads or "
+                               "processes.");
+
 cl::opt<std::string> MaxTime(
     "max-time",
     cl::desc("Halt execution after the specified duration.  "
              "Set to 0s to disable (default=0s)"),
     cl::init("0s"),
     cl::cat(TerminationCat));
+
+cl::opt<unsigned> WriteWorkUnits(
+    "write-work-units", cl::init(0),
+    cl::desc("Stop exploring once there are this many states and write the "
+             "branch history of each to a work unit (unitNNNNNN.path) in the "
+             "output directory.  Requires --write-paths.  Set to 0 to "
+             "disable (default=0)"),
+    cl::cat(ParallelCat));
 } // namespace klee
 
 namespace {
@@ -162,6 +176,38 @@ cl::opt<bool>
                                   "querying the solver (default=true)"),
                          cl::cat(SolvingCat));
 
+cl::opt<unsigned> SolverWorkers(
+    "solver-workers", cl::init(0),
+    cl::desc("Number of threads deciding symbolic branches in the background "
+             "while other states keep executing. Requires the Z3 core "
+             "solver.  Set to 0 to disable (default=0)"),
+    cl::cat(SolvingCat));
+
+
+/*** Parallel exploration options ***/
+
+cl::opt<unsigned> ExecThreads(
+    "exec-threads", cl::init(1),
+    cl::desc("Number of threads executing states.  Instructions are "
+             "interpreted one thread at a time, only solver queries "
+             "overlap with interpretation and with each other.  Requires "
+             "the Z3 core solver and disables the "
+             "searcher, each thread explores depth-first and steals the "
+             "oldest state of another thread when it runs out (default=1)"),
+    cl::cat(ParallelCat));
+
+cl::opt<unsigned> ExecThreadQuantum(
+    "exec-thread-quantum", cl::init(10000),
+    cl::desc("Number of instructions a thread executes of the same state "
+             "before picking the next one (default=10000)"),
+    cl::cat(ParallelCat));
+
+cl::opt<bool> ReplayPathPrefix(
+    "replay-path-prefix", cl::init(false),
+    cl::desc("Treat the --replay-path as a prefix: follow it to its end and "
+             "explore all paths below it from there on (default=false)"),
+    cl::cat(ParallelCat));
+
 
 /*** External call policy options ***/
 
@@ -317,6 +363,15 @@ cl::opt<bool> MaxMemoryInhibit(
     cl::init(true),
     cl::cat(TerminationCat));
 
+cl::opt<bool> SpillStates(
+    "spill-states",
+    cl::desc("Instead of terminating states at the memory cap, keep their "
+             "paths on disk and re-execute them from the initial state once "
+             "memory is available again. Requires --write-paths "
+             "(default=false)"),
+    cl::init(false),
+    cl::cat(TerminationCat));
+
 cl::opt<unsigned> RuntimeMaxStackFrames(
     "max-stack-frames",
     cl::desc("Terminate a state after this many stack frames.  Set to 0 to "
@@ -451,11 +506,20 @@ extern uint8_t* nme_store;//nme returned content array for an overflow read oper
 
 ExecutionState* last_state;
 
+/// Index of the interpreter thread, see Executor::runParallel().
+static thread_local unsigned interpreterThreadID = 0;
+/// Interpreter lock held by the calling thread, null unless exploring on
+/// several threads.
+static thread_local std::unique_lock<std::mutex> *interpreterGuard = nullptr;
+
+thread_local std::vector<ExecutionState *> Executor::addedStates;
+thread_local std::vector<ExecutionState *> Executor::removedStates;
+
 void emulate_nme_req (ExecutionState* state, bool new_alloc)
 {
     unsigned long addr = n_heap_l + 0x10*(heap_idx*2);//one for data, one for next meta data
     // state->heap_allocs.back().nativeAddress = n_heap_l + 0x10*heap_idx + 0x10;
-    state->heap_allocs.back().nativeAddress = addr;
+    state->heap_allocs.getWriteableBack().nativeAddress = addr;
     heap_idx++;
     last_state = state;
     printf ("state: %p, return native address: %lx. \n", state, addr);
@@ -581,6 +645,7 @@ void nme_req (ExecutionState* state, bool new_alloc)
     // kn_indicator->num = req_num;
     kn_indicator->num = v.size();
     kn_indicator->flag = 1;
+    ++stats::nmeRequests;
 
     asm volatile("mfence; \n\t");
     t0 = rdtsc();
@@ -600,7 +665,7 @@ void nme_req (ExecutionState* state, bool new_alloc)
     {
         // only the last req in state.heap_allocs has not been natively executed.
         printf ("update nativeAddress as: %lx. \n", nme_buf[(kn_indicator->num)-1].nativeAddress);
-        state->heap_allocs.back().nativeAddress = nme_buf[(kn_indicator->num)-1].nativeAddress;
+        state->heap_allocs.getWriteableBack().nativeAddress = nme_buf[(kn_indicator->num)-1].nativeAddress;
     }
 
     for (i = 0; i < v.size(); i ++ )
@@ -654,6 +719,21 @@ Executor::Executor(LLVMContext &ctx, const InterpreterOptions &opts,
   this->solver = new TimingSolver(solver, EqualitySubstitution);
   memory = new MemoryManager(&arrayCache);
 
+  if (SolverWorkers) {
+    if (CoreSolverToUse != Z3_SOLVER) {
+      klee_warning("--solver-workers requires the Z3 core solver, "
+                   "deciding branches synchronously");
+    } else {
+      // Each worker owns a separate chain, solver chains are not
+      // thread-safe.
+      this->solver->startWorkers(SolverWorkers, [this](unsigned id) {
+        return createThreadSolver("worker" + std::to_string(id));
+      });
+      klee_message("Deciding branches on %u solver workers",
+                   (unsigned) SolverWorkers);
+    }
+  }
+
   initializeSearchOptions();
 
   if (OnlyOutputStatesCoveringNew && !StatsTracker::useIStats())
@@ -1118,6 +1198,17 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
         seedMap.find(&current);
     bool isSeeding = it != seedMap.end();
 
+    // The branch may already have been decided while the state was parked.
+    std::unique_ptr<PendingBranch> pending;
+    if (!pendingBranches.empty()) {
+        auto pit = pendingBranches.find(&current);
+        if (pit != pendingBranches.end()) {
+            assert(!pit->second.parked && "forking a parked state");
+            pending.reset(new PendingBranch(std::move(pit->second)));
+            pendingBranches.erase(pit);
+        }
+    }
+
     if (!isSeeding && !isa<ConstantExpr>(condition) &&
             (MaxStaticForkPct!=1. || MaxStaticSolvePct != 1. ||
              MaxStaticCPForkPct!=1. || MaxStaticCPSolvePct != 1.) &&
@@ -1148,9 +1239,15 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     time::Span timeout = coreSolverTimeout;
     if (isSeeding)
         timeout *= static_cast<unsigned>(it->second.size());
-    solver->setTimeout(timeout);
-    bool success = solver->evaluate(current, condition, res);
-    solver->setTimeout(time::Span());
+    bool success;
+    if (pending && pending->validity.valid() &&
+            pending->condition == condition) {
+        success = solver->collect(current, pending->validity, res);
+    } else {
+        solver->setTimeout(timeout);
+        success = solver->evaluate(current, condition, res);
+        solver->setTimeout(time::Span());
+    }
     if (!success) {
         current.pc = current.prevPC;
         terminateStateEarly(current, "Query timed out (fork).");
@@ -1158,16 +1255,24 @@ Executor::fork(ExecutionState &current, ref<Expr> condition, bool isInternal) {
     }
 
     if (!isSeeding) {
-        if (replayPath && !isInternal) {
-            assert(replayPosition<replayPath->size() &&
+        // Spilled states follow their own path, as a prefix.
+        const std::vector<bool> *path =
+            current.replayPath ? current.replayPath.get() : replayPath;
+        bool isPrefix = ReplayPathPrefix || current.replayPath;
+        if (path && !isInternal &&
+                (!isPrefix || current.replayPathPosition < path->size())) {
+            assert(current.replayPathPosition<path->size() &&
                     "ran out of branches in replay path mode");
-            bool branch = (*replayPath)[replayPosition++];
-
-            if (res==Solver::True) {
-                assert(branch && "hit invalid branch in replay path mode");
-            } else if (res==Solver::False) {
-                assert(!branch && "hit invalid branch in replay path mode");
-            } else {
+            bool branch = (*path)[current.replayPathPosition++];
+
+            if ((res==Solver::True && !branch) ||
+                    (res==Solver::False && branch)) {
+                // States created by a multi-way branch all follow the
+                // prefix, only the one that matches it survives.
+                assert(isPrefix && "hit invalid branch in replay path mode");
+                terminateState(current);
+                return StatePair(0, 0);
+            } else if (res==Solver::Unknown) {
                 // add constraints
                 if(branch) {
                     res = Solver::True;
@@ -1364,6 +1469,13 @@ void Executor::addConstraint(ExecutionState &state, ref<Expr> condition) {
       klee_warning("seeds patched for violating constraint");
   }
 
+  // An answer computed for the old constraints may no longer hold.
+  if (!pendingBranches.empty()) {
+    auto pending = pendingBranches.find(&state);
+    if (pending != pendingBranches.end())
+      pending->second.validity = AsyncSolverQuery<Solver::Validity>();
+  }
+
   state.addConstraint(condition);
   if (ivcEnabled)
     doImpliedValueConcretization(state, condition,
@@ -1946,19 +2058,8 @@ void Executor::executeInstruction(ExecutionState &state, KInstruction *ki) {
                                       ref<Expr> cond = eval(ki, 0, state).value;
 
                                       cond = optimizer.optimizeExpr(cond, false);
-                                      Executor::StatePair branches = fork(state, cond, false);
-
-                                      // NOTE: There is a hidden dependency here, markBranchVisited
-                                      // requires that we still be in the context of the branch
-                                      // instruction (it reuses its statistic id). Should be cleaned
-                                      // up with convenient instruction specific data.
-                                      if (statsTracker && state.stack.back().kf->trackCoverage)
-                                          statsTracker->markBranchVisited(branches.first, branches.second);
-
-                                      if (branches.first)
-                                          transferToBasicBlock(bi->getSuccessor(0), bi->getParent(), *branches.first);
-                                      if (branches.second)
-                                          transferToBasicBlock(bi->getSuccessor(1), bi->getParent(), *branches.second);
+                                      if (!parkOnBranch(state, ki, cond))
+                                          executeBranch(state, ki, cond);
                                   }
                                   break;
                               }
@@ -3808,8 +3909,39 @@ std::pair<uint64_t, u_int64_t> setAAWTarget(std::map<std::string, ref<Expr>> Fun
 
 
 void Executor::updateStates(ExecutionState *current) {
+  if (!deferredRemovals.empty()) {
+    removedStates.insert(removedStates.end(), deferredRemovals.begin(),
+                         deferredRemovals.end());
+    deferredRemovals.clear();
+  }
+
+  if (joinPointMerger)
+    joinPointMerger->removeStates(removedStates);
+
+  if (statePool) {
+    for (auto es : addedStates)
+      statePool->push(interpreterThreadID, es);
+    if (!addedStates.empty())
+      statePoolChanged.notify_all();
+  }
+
   if (searcher) {
-    searcher->update(current, addedStates, removedStates);
+    if (pendingBranches.empty()) {
+      searcher->update(current, addedStates, removedStates);
+    } else {
+      // Parked states are unknown to the searcher.
+      auto isParked = [this](ExecutionState *es) {
+        auto it = pendingBranches.find(es);
+        return it != pendingBranches.end() && it->second.parked;
+      };
+      if (current && isParked(current))
+        current = nullptr;
+      std::vector<ExecutionState *> removed;
+      for (auto es : removedStates)
+        if (!isParked(es))
+          removed.push_back(es);
+      searcher->update(current, addedStates, removed);
+    }
   }
 
   states.insert(addedStates.begin(), addedStates.end());
@@ -3819,6 +3951,15 @@ void Executor::updateStates(ExecutionState *current) {
                                                ie = removedStates.end();
        it != ie; ++it) {
     ExecutionState *es = *it;
+    if (statePool) {
+      // Only the thread running a state may delete it.
+      if (es != current && runningStates.count(es)) {
+        deferredRemovals.push_back(es);
+        continue;
+      }
+      if (!runningStates.erase(es))
+        statePool->remove(es);
+    }
     std::set<ExecutionState*>::iterator it2 = states.find(es);
     assert(it2!=states.end());
     states.erase(it2);
@@ -3826,12 +3967,256 @@ void Executor::updateStates(ExecutionState *current) {
       seedMap.find(es);
     if (it3 != seedMap.end())
       seedMap.erase(it3);
+    // A still running query is simply abandoned.
+    pendingBranches.erase(es);
     processTree->remove(es->ptreeNode);
     delete es;
   }
   removedStates.clear();
 }
 
+bool Executor::parkOnBranch(ExecutionState &state, KInstruction *ki,
+                            ref<Expr> condition) {
+  if (!searcher || !solver->hasWorkers() || isa<ConstantExpr>(condition) ||
+      seedMap.count(&state) || pendingBranches.count(&state))
+    return false;
+
+  PendingBranch &pending = pendingBranches[&state];
+  pending.ki = ki;
+  pending.condition = condition;
+  pending.validity = solver->evaluateAsync(state, condition, coreSolverTimeout);
+  pending.parked = true;
+
+  // The branch is completed by completeParkedBranch() once the answer is
+  // in, fork() picks it up.
+  searcher->removeState(&state);
+  return true;
+}
+
+void Executor::executeBranch(ExecutionState &state, KInstruction *ki,
+                             ref<Expr> condition) {
+  BranchInst *bi = cast<BranchInst>(ki->inst);
+  Executor::StatePair branches = fork(state, condition, false);
+
+  // NOTE: There is a hidden dependency here, markBranchVisited
+  // requires that we still be in the context of the branch
+  // instruction (it reuses its statistic id). Should be cleaned
+  // up with convenient instruction specific data.
+  if (statsTracker && state.stack.back().kf->trackCoverage)
+    statsTracker->markBranchVisited(branches.first, branches.second);
+
+  if (branches.first)
+    transferToBasicBlock(bi->getSuccessor(0), bi->getParent(), *branches.first);
+  if (branches.second)
+    transferToBasicBlock(bi->getSuccessor(1), bi->getParent(), *branches.second);
+}
+
+void Executor::completeParkedBranch(ExecutionState &state) {
+  KInstruction *ki = pendingBranches.at(&state).ki;
+  // The branch was stepped and counted when the state parked, only its
+  // statistics context is restored.
+  if (statsTracker)
+    statsTracker->resumeInstruction(state, ki);
+
+  // Evaluated again in case the state changed while parked; fork() only
+  // uses the answer if the condition is still the same.
+  ref<Expr> cond = eval(ki, 0, state).value;
+  cond = optimizer.optimizeExpr(cond, false);
+  executeBranch(state, ki, cond);
+}
+
+void Executor::resumeParkedState(ExecutionState &state) {
+  auto it = pendingBranches.find(&state);
+  assert(it != pendingBranches.end() && it->second.parked);
+  if (it->second.validity.valid())
+    it->second.validity.wait();
+  it->second.parked = false;
+  searcher->addState(&state);
+}
+
+void Executor::resumeParkedStates() {
+  ExecutionState *oldest = nullptr;
+  for (auto &pending : pendingBranches) {
+    if (!pending.second.parked)
+      continue;
+    if (!pending.second.validity.valid() ||
+        pending.second.validity.wait_for(std::chrono::seconds(0)) ==
+            std::future_status::ready) {
+      pending.second.parked = false;
+      searcher->addState(pending.first);
+    } else if (!oldest) {
+      oldest = pending.first;
+    }
+  }
+
+  // Everything runnable is waiting for the solver.
+  if (oldest && searcher->empty())
+    resumeParkedState(*oldest);
+}
+
+void Executor::writeWorkUnits() {
+  std::set<std::string> prefixes;
+  for (auto es : states) {
+    std::vector<unsigned char> path;
+    pathWriter->readStream(es->pathOS.getID(), path);
+    prefixes.insert(std::string(path.begin(), path.end()));
+  }
+
+  // A unit covers everything below its prefix, so units extending
+  // another one are dropped. Those directly follow it in the ordering.
+  unsigned numUnits = 0;
+  const std::string *last = nullptr;
+  for (auto const &prefix : prefixes) {
+    if (last && prefix.compare(0, last->size(), *last) == 0)
+      continue;
+    last = &prefix;
+
+    std::stringstream name;
+    name << "unit" << std::setfill('0') << std::setw(6) << ++numUnits
+         << ".path";
+    auto f = interpreterHandler->openOutputFile(name.str());
+    if (!f)
+      klee_error("unable to write work unit %s", name.str().c_str());
+    for (auto branch : prefix)
+      *f << branch << '\n';
+  }
+  klee_message("wrote %u work units for %u states", numUnits,
+               (unsigned) states.size());
+
+  for (auto es : states)
+    terminateState(*es);
+  updateStates(nullptr);
+}
+
+void Executor::spillState(ExecutionState &state) {
+  // The path writer already has the path on disk, its ID is all we keep.
+  spilledPaths.push_back(state.pathOS.getID());
+  terminateState(state);
+}
+
+void Executor::restoreSpilledState() {
+  std::vector<unsigned char> branches;
+  pathWriter->readStream(spilledPaths.front(), branches);
+  spilledPaths.pop_front();
+
+  auto path = std::make_shared<std::vector<bool> >();
+  path->reserve(branches.size());
+  for (auto branch : branches)
+    path->push_back(branch == '1');
+
+  ExecutionState *es = new ExecutionState(*spillOrigin);
+  es->pathOS = pathWriter->open();
+  if (symPathWriter)
+    es->symPathOS = symPathWriter->open();
+  es->replayPath = std::move(path);
+  // Every branch of the path was a fork, the state belongs that deep in
+  // the process tree.
+  processTree->insert(es, es->replayPath->size());
+  addedStates.push_back(es);
+}
+
+Solver *Executor::createThreadSolver(const std::string &name) {
+  // Query logs are written per thread.
+  auto logFile = [this, &name](const char *file) {
+    return interpreterHandler->getOutputFilename(name + "-" + file);
+  };
+  return constructSolverChain(klee::createCoreSolver(CoreSolverToUse),
+                              logFile(ALL_QUERIES_SMT2_FILE_NAME),
+                              logFile(SOLVER_QUERIES_SMT2_FILE_NAME),
+                              logFile(ALL_QUERIES_KQUERY_FILE_NAME),
+                              logFile(SOLVER_QUERIES_KQUERY_FILE_NAME));
+}
+
+void Executor::runParallel(unsigned numThreads) {
+  klee_message("Exploring on %u threads", numThreads);
+
+  std::vector<std::unique_ptr<Solver> > threadSolvers;
+  for (unsigned i = 0; i < numThreads; ++i)
+    threadSolvers.emplace_back(createThreadSolver("thread" + std::to_string(i)));
+
+  statePool.reset(new WorkStealingPool<ExecutionState *>(numThreads));
+  for (auto es : states)
+    statePool->push(0, es);
+
+  std::vector<std::thread> threads;
+  for (unsigned i = 0; i < numThreads; ++i)
+    threads.emplace_back(&Executor::runInterpreterThread, this, i,
+                         threadSolvers[i].get());
+  for (auto &thread : threads)
+    thread.join();
+
+  assert(runningStates.empty() && !activeThreads);
+  // Delete the states terminated while a thread was running them.
+  updateStates(nullptr);
+  statePool.reset();
+}
+
+void Executor::runInterpreterThread(unsigned id, Solver *threadSolver) {
+  std::unique_lock<std::mutex> guard(interpreterLock);
+  interpreterThreadID = id;
+  interpreterGuard = &guard;
+  solver->bindThread(threadSolver, &guard);
+
+  while (!haltExecution) {
+    ExecutionState *state;
+    if (!statePool->take(id, state)) {
+      // Nobody left who could fork new states.
+      if (!activeThreads)
+        break;
+      statePoolChanged.wait(guard);
+      continue;
+    }
+
+    ++activeThreads;
+    runningStates.insert(state);
+    for (unsigned i = 0; i < ExecThreadQuantum && !haltExecution; ++i) {
+      KInstruction *ki = state->pc;
+      stepInstruction(*state);
+
+      executeInstruction(*state, ki);
+      if (nativeHeapThread == (int) id) {
+        nativeHeapThread = -1;
+        statePoolChanged.notify_all();
+      }
+      timers.invoke();
+      if (::dumpStates) dumpStates();
+      if (::dumpPTree) dumpPTree();
+
+      checkMemoryUsage();
+
+      updateStates(state);
+      if (!runningStates.count(state))
+        break;
+    }
+    if (runningStates.erase(state)) {
+      // Terminated by another thread meanwhile, delete it rather than
+      // handing it out again.
+      if (std::find(deferredRemovals.begin(), deferredRemovals.end(),
+                    state) != deferredRemovals.end())
+        updateStates(nullptr);
+      else
+        statePool->push(id, state);
+    }
+    --activeThreads;
+    statePoolChanged.notify_all();
+  }
+
+  solver->bindThread(nullptr, nullptr);
+  interpreterGuard = nullptr;
+  statePoolChanged.notify_all();
+}
+
+void Executor::acquireNativeHeap() {
+  if (!interpreterGuard)
+    return;
+  // The lock may have been released for a solver query in the middle of
+  // the holder's instruction, the heap still reflects its state.
+  while (nativeHeapThread != -1 &&
+         nativeHeapThread != (int) interpreterThreadID)
+    statePoolChanged.wait(*interpreterGuard);
+  nativeHeapThread = interpreterThreadID;
+}
+
 template <typename TypeIt>
 void Executor::computeOffsets(KGEPInstruction *kgepi, TypeIt ib, TypeIt ie) {
   ref<ConstantExpr> constantOffset =
@@ -3923,8 +4308,13 @@ void Executor::checkMemoryUsage() {
         // just guess at how many to kill
         unsigned numStates = states.size();
         unsigned toKill = std::max(1U, numStates - numStates * MaxMemory / mbs);
-        klee_warning("killing %d states (over memory cap)", toKill);
-        std::vector<ExecutionState *> arr(states.begin(), states.end());
+        klee_warning("%s %d states (over memory cap)",
+                     spillOrigin ? "spilling" : "killing", toKill);
+        // States run by other interpreter threads are left alone.
+        std::vector<ExecutionState *> arr;
+        for (auto es : states)
+          if (!runningStates.count(es))
+            arr.push_back(es);
         for (unsigned i = 0, N = arr.size(); N && i < toKill; ++i, --N) {
           unsigned idx = rand() % N;
           // Make two pulls to try and not hit a state that
@@ -3933,12 +4323,19 @@ void Executor::checkMemoryUsage() {
             idx = rand() % N;
 
           std::swap(arr[idx], arr[N - 1]);
-          terminateStateEarly(*arr[N - 1], "Memory limit exceeded.");
+          if (spillOrigin)
+            spillState(*arr[N - 1]);
+          else
+            terminateStateEarly(*arr[N - 1], "Memory limit exceeded.");
         }
       }
       atMemoryLimit = true;
     } else {
       atMemoryLimit = false;
+      // Bring spilled states back one at a time while well below the cap,
+      // so that they are not spilled again right away.
+      if (!spilledPaths.empty() && mbs < MaxMemory / 4 * 3)
+        restoreSpilledState();
     }
   }
 }
@@ -3959,6 +4356,15 @@ void Executor::run(ExecutionState &initialState) {
     // Delay init till now so that ticks don't accrue during optimization and such.
     timers.reset();
 
+    if (SpillStates) {
+        if (!pathWriter) {
+            klee_warning("--spill-states requires --write-paths, ignoring");
+        } else {
+            spillOrigin.reset(new ExecutionState(initialState));
+            spillOrigin->ptreeNode = PTree::None;
+        }
+    }
+
     states.insert(&initialState);
 
     if (usingSeeds) {
@@ -4024,13 +4430,67 @@ void Executor::run(ExecutionState &initialState) {
         }
     }
 
+    if (ExecThreads > 1) {
+        if (CoreSolverToUse != Z3_SOLVER) {
+            klee_warning("--exec-threads requires the Z3 core solver, "
+                         "running a single thread");
+        } else if (UseMerge || UseAutoMerge) {
+            klee_warning("--exec-threads does not support merging, "
+                         "running a single thread");
+        } else {
+            if (spillOrigin) {
+                klee_warning("--exec-threads does not support --spill-states, "
+                             "ignoring");
+                spillOrigin.reset();
+            }
+            runParallel(ExecThreads);
+            doDumpStates();
+            return;
+        }
+    }
+
+    if (WriteWorkUnits && !pathWriter)
+        klee_warning("--write-work-units requires --write-paths, ignoring");
+    if (spillOrigin && usingSeeds) {
+        klee_warning("--spill-states does not support seeding, ignoring");
+        spillOrigin.reset();
+    }
+
     searcher = constructUserSearcher(*this);
+    if (UseAutoMerge)
+        joinPointMerger.reset(new JoinPointMerger(this));
 
     std::vector<ExecutionState *> newStates(states.begin(), states.end());
     searcher->update(0, newStates, std::vector<ExecutionState *>());
 
-    while (!states.empty() && !haltExecution) {
+    while ((!states.empty() || !spilledPaths.empty()) && !haltExecution) {
+        if (!pendingBranches.empty())
+            resumeParkedStates();
+        // States waiting at join points only run once nothing else can.
+        if (joinPointMerger && searcher->empty())
+            joinPointMerger->releaseStates();
+        if (!spilledPaths.empty() && searcher->empty()) {
+            restoreSpilledState();
+            updateStates(nullptr);
+        }
         ExecutionState &state = searcher->selectState();
+        // A state waiting for its branch is in the middle of the branch
+        // instruction, so it finishes that before it can be merged.
+        if (!pendingBranches.empty()) {
+            auto pending = pendingBranches.find(&state);
+            if (pending != pendingBranches.end()) {
+                // Searchers walking the process tree also see parked states.
+                if (pending->second.parked)
+                    resumeParkedState(state);
+                completeParkedBranch(state);
+                updateStates(&state);
+                continue;
+            }
+        }
+        if (joinPointMerger && joinPointMerger->reachedJoinPoint(state)) {
+            updateStates(nullptr);
+            continue;
+        }
         KInstruction *ki = state.pc;
         stepInstruction(state);
 
@@ -4042,11 +4502,20 @@ void Executor::run(ExecutionState &initialState) {
         checkMemoryUsage();
 
         updateStates(&state);
+
+        if (WriteWorkUnits && states.size() >= WriteWorkUnits && pathWriter)
+            writeWorkUnits();
     }
 
+    joinPointMerger.reset();
     delete searcher;
     searcher = 0;
 
+    if (!spilledPaths.empty()) {
+        klee_warning("%u spilled states were not re-executed",
+                     (unsigned) spilledPaths.size());
+        spilledPaths.clear();
+    }
     doDumpStates();
 }
 
@@ -4529,6 +4998,7 @@ void Executor::executeAlloc(ExecutionState &state,
                 HeapAlloc* heap_alloc = new HeapAlloc(mo, 1, CE->getZExtValue(), allocationAlignment, NULL);
                 state.heap_allocs.push_back(*heap_alloc);
                 printf ("issue nme_req for malloc. \n");
+                acquireNativeHeap();
                 nme_req(&state, 1);
                 // emulate_nme_req(&state, 1);
                 mo->nativeAddress = state.heap_allocs.back().nativeAddress;
@@ -4698,6 +5168,7 @@ void Executor::executeFree(ExecutionState &state,
                     HeapAlloc* heap_alloc = new HeapAlloc(Mo, 2, Mo->size, 0, Mo->address);
                     it->second->heap_allocs.push_back(*heap_alloc);
                     printf ("issue nme_req for free. \n");
+                    acquireNativeHeap();
                     nme_req(&state, 1);
                     // emulate_nme_req(&state, 1);
                     printf ("in free, mo->name: %s. mo->kleeAddress: %lx, mo->nativeAddress: %lx. \n", mo->name, mo->kleeAddress, mo->nativeAddress);
@@ -5144,9 +5615,10 @@ void Executor::executeMakeSymbolic(ExecutionState &state,
         // or if that fails try adding a unique identifier.
         unsigned id = 0;
         std::string uniqueName = name;
-        while (!state.arrayNames.insert(uniqueName).second) {
+        while (state.arrayNames.count(uniqueName)) {
             uniqueName = name + "_" + llvm::utostr(++id);
         }
+        state.arrayNames = state.arrayNames.insert(uniqueName);
         const Array *array = arrayCache.CreateArray(uniqueName, mo->size);
         bindObjectInState(state, mo, false, array);
         state.addSymbolic(mo, array);
@@ -5305,6 +5777,7 @@ void Executor::runFunctionAsMain(Function *f,
 
     processTree = std::make_unique<PTree>(state);
     run(*state);
+    spillOrigin = nullptr;
     processTree = nullptr;
 
     // hack to clear memory objects
@@ -16,7 +16,9 @@
 #define KLEE_EXECUTOR_H
 
 #include "ExecutionState.h"
+#include "TimingSolver.h"
 
+#include "klee/ADT/WorkStealingPool.h"
 #include "klee/Core/Interpreter.h"
 #include "klee/Expr/ArrayCache.h"
 #include "klee/Expr/ArrayExprOptimizer.h"
@@ -28,8 +30,11 @@
 #include "llvm/ADT/Twine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <vector>
@@ -90,6 +95,7 @@ namespace klee {
         friend class SpecialFunctionHandler;
         friend class StatsTracker;
         friend class MergeHandler;
+        friend class JoinPointMerger;
 
         public:
         typedef std::pair<ExecutionState*,ExecutionState*> StatePair;
@@ -133,15 +139,68 @@ namespace klee {
         std::string indirect_name = "";
 
         /// Used to track states that have been added during the current
-        /// instructions step.
+        /// instructions step. Kept per interpreter thread, so that states
+        /// forked by an instruction only become visible to other threads
+        /// once updateStates() runs after it.
         /// \invariant \ref addedStates is a subset of \ref states.
         /// \invariant \ref addedStates and \ref removedStates are disjoint.
-        std::vector<ExecutionState *> addedStates;
+        static thread_local std::vector<ExecutionState *> addedStates;
         /// Used to track states that have been removed during the current
-        /// instructions step.
+        /// instructions step. Kept per interpreter thread, like
+        /// \ref addedStates.
         /// \invariant \ref removedStates is a subset of \ref states.
         /// \invariant \ref addedStates and \ref removedStates are disjoint.
-        std::vector<ExecutionState *> removedStates;
+        static thread_local std::vector<ExecutionState *> removedStates;
+
+        /// States removed while another interpreter thread was running
+        /// them. They are deleted by the first updateStates() after that
+        /// thread let go of them.
+        std::vector<ExecutionState *> deferredRemovals;
+
+        /// A conditional branch whose condition is being decided by one of
+        /// the solver workers.
+        struct PendingBranch {
+            /// The branch instruction, which the state has already stepped.
+            KInstruction *ki;
+            ref<Expr> condition;
+            AsyncSolverQuery<Solver::Validity> validity;
+            /// Whether the state is still removed from the searcher.
+            bool parked;
+        };
+
+        /// States which reached a symbolic branch while solver workers are
+        /// enabled. They are removed from the searcher until the answer is
+        /// in, and the branch is then completed using it, without stepping
+        /// the instruction again. The answer is dropped if constraints are
+        /// added to the state meanwhile. \see parkOnBranch()
+        std::map<ExecutionState *, PendingBranch> pendingBranches;
+
+        /// States waiting for an interpreter thread, null unless
+        /// exploring on several threads. \see runParallel()
+        std::unique_ptr<WorkStealingPool<ExecutionState *> > statePool;
+
+        /// States currently run by an interpreter thread.
+        std::set<ExecutionState *> runningStates;
+
+        /// Number of interpreter threads currently running a state.
+        unsigned activeThreads = 0;
+
+        /// Held by an interpreter thread while it executes instructions
+        /// and released while it waits for the solver. Guards all other
+        /// members when exploring on several threads. Interpretation is
+        /// therefore serialised, the threads only overlap solving with
+        /// interpreting.
+        std::mutex interpreterLock;
+
+        /// Notified when states are added to \ref statePool, a thread stops
+        /// running a state or the native heap is released.
+        std::condition_variable statePoolChanged;
+
+        /// Interpreter thread whose current instruction uses the native
+        /// heap, or -1. Other threads wait for the instruction to complete
+        /// before they switch the heap to their own state. \see
+        /// acquireNativeHeap()
+        int nativeHeapThread = -1;
 
         /// When non-empty the Executor is running in "seed" mode. The
         /// states in this map will be executed in an arbitrary order
@@ -219,6 +278,16 @@ namespace klee {
         /// `nullptr` if merging is disabled
         MergingSearcher *mergingSearcher = nullptr;
 
+        /// Merges states at join points with --auto-merge.
+        std::unique_ptr<JoinPointMerger> joinPointMerger;
+
+        /// Copy of the initial state, from which spilled states are
+        /// re-executed. Null unless --spill-states is in effect.
+        std::unique_ptr<ExecutionState> spillOrigin;
+
+        /// Path stream IDs of the spilled states, oldest first.
+        std::deque<TreeStreamID> spilledPaths;
+
         llvm::Function* getTargetFunction(llvm::Value *calledVal,
                 ExecutionState &state);
 
@@ -238,6 +307,55 @@ namespace klee {
 
         void stepInstruction(ExecutionState &state);
         void updateStates(ExecutionState *current);
+
+        /// Submit the query for a symbolic branch to the solver workers and
+        /// park \a state until it is answered. Returns false if the branch
+        /// has to be decided synchronously (no workers, seeding, or the
+        /// answer for this branch is already available).
+        bool parkOnBranch(ExecutionState &state, KInstruction *ki,
+                ref<Expr> condition);
+
+        /// Fork \a state on the condition of the conditional branch \a ki
+        /// and transfer the resulting states to its successors.
+        void executeBranch(ExecutionState &state, KInstruction *ki,
+                ref<Expr> condition);
+
+        /// Finish the branch \a state is parked on, once it was handed back
+        /// to the searcher.
+        void completeParkedBranch(ExecutionState &state);
+
+        /// Hand parked states whose branch query has been answered back to
+        /// the searcher. Blocks if no other state is left to run.
+        void resumeParkedStates();
+
+        /// Hand \a state back to the searcher, waiting for its query.
+        void resumeParkedState(ExecutionState &state);
+
+        /// Write the branch history of all states as work units to the
+        /// output directory and terminate them. \see --write-work-units
+        void writeWorkUnits();
+
+        /// Terminate \a state over the memory cap, keeping only its path
+        /// so that it can be re-executed later. \see --spill-states
+        void spillState(ExecutionState &state);
+
+        /// Re-execute the oldest spilled state from the initial state,
+        /// following its path.
+        void restoreSpilledState();
+
+        /// Create a separate solver chain, logging queries to files
+        /// prefixed with \a name.
+        Solver *createThreadSolver(const std::string &name);
+
+        /// Run all states on \a numThreads threads until they are done or
+        /// execution is halted.
+        void runParallel(unsigned numThreads);
+        void runInterpreterThread(unsigned id, Solver *threadSolver);
+
+        /// Reserve the native heap for the current instruction of the
+        /// calling interpreter thread, waiting while another thread's
+        /// instruction holds it.
+        void acquireNativeHeap();
         void transferToBasicBlock(llvm::BasicBlock *dst,
                 llvm::BasicBlock *src,
                 ExecutionState &state);
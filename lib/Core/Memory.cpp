@@ -371,8 +371,7 @@ ref<Expr> ObjectState::read8(unsigned offset) const {
     }    
 }
 
-ref<Expr> ObjectState::read8(ref<Expr> offset) const {
-    assert(!isa<ConstantExpr>(offset) && "constant offset passed to symbolic read8");
+const UpdateList &ObjectState::getUpdatesForRead(ref<Expr> offset) const {
     unsigned base, size;
     fastRangeCheckOffset(offset, &base, &size);
     flushRangeForRead(base, size);
@@ -385,7 +384,13 @@ ref<Expr> ObjectState::read8(ref<Expr> offset) const {
                 allocInfo.c_str());
     }
 
-    return ReadExpr::create(getUpdates(), ZExtExpr::create(offset, Expr::Int32));
+    return getUpdates();
+}
+
+ref<Expr> ObjectState::read8(ref<Expr> offset) const {
+    assert(!isa<ConstantExpr>(offset) && "constant offset passed to symbolic read8");
+    return ReadExpr::create(getUpdatesForRead(offset),
+                            ZExtExpr::create(offset, Expr::Int32));
 }
 
 void ObjectState::write8(unsigned offset, uint8_t value) {
@@ -440,15 +445,18 @@ ref<Expr> ObjectState::read(ref<Expr> offset, Expr::Width width) const {
   if (width == Expr::Bool)
     return ExtractExpr::create(read8(offset), 0, Expr::Bool);
 
-  // Otherwise, follow the slow general case.
+  // Otherwise, follow the slow general case. The range is flushed once and
+  // all bytes read from the same updates, which lets little-endian loads be
+  // recognized as one wide read (see ConcatExpr::getWideReadBase).
   unsigned NumBytes = width / 8;
   assert(width == NumBytes * 8 && "Invalid read size!");
+  const UpdateList &ul = getUpdatesForRead(offset);
   ref<Expr> Res(0);
   for (unsigned i = 0; i != NumBytes; ++i) {
     unsigned idx = Context::get().isLittleEndian() ? i : (NumBytes - i - 1);
-    ref<Expr> Byte = read8(AddExpr::create(offset, 
-                                           ConstantExpr::create(idx, 
-                                                                Expr::Int32)));
+    ref<Expr> Byte = ReadExpr::create(ul, AddExpr::create(offset, 
+                                                          ConstantExpr::create(idx, 
+                                                                               Expr::Int32)));
     Res = i ? ConcatExpr::create(Byte, Res) : Byte;
   }
 
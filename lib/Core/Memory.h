@@ -268,6 +268,9 @@ class ObjectState {
 
     private:
         const UpdateList &getUpdates() const;
+        /// Flush the bytes a read at the symbolic \arg offset may touch and
+        /// return the updates to read from.
+        const UpdateList &getUpdatesForRead(ref<Expr> offset) const;
 
         void makeConcrete();
 
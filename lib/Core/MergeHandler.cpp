@@ -14,6 +14,13 @@
 #include "Executor.h"
 #include "Searcher.h"
 
+#include "klee/Module/KInstruction.h"
+
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Instructions.h"
+
+#include <algorithm>
+
 namespace klee {
 
 /*** Test generation options ***/
@@ -42,6 +49,19 @@ llvm::cl::opt<bool> DebugLogIncompleteMerge(
     llvm::cl::desc("Debug information for incomplete path merging (default=false)"),
     llvm::cl::cat(klee::MergeCat));
 
+llvm::cl::opt<bool> UseAutoMerge(
+    "auto-merge", llvm::cl::init(false),
+    llvm::cl::desc("Merge states where control flow joins, if their heap "
+                   "allocation histories and native heap layouts are "
+                   "identical (default=false)"),
+    llvm::cl::cat(klee::MergeCat));
+
+llvm::cl::opt<unsigned> AutoMergeMaxWaiting(
+    "auto-merge-max-waiting", llvm::cl::init(4),
+    llvm::cl::desc("Number of states which may wait at one join point for "
+                   "--auto-merge, before the oldest is released (default=4)"),
+    llvm::cl::cat(klee::MergeCat));
+
 double MergeHandler::getMean() {
   if (closedStateCount == 0)
     return 0;
@@ -150,4 +170,113 @@ MergeHandler::~MergeHandler() {
 
   releaseStates();
 }
+
+/// Whether \arg ki starts a block which control flow enters from several
+/// places.
+static bool isJoinPoint(const KInstruction *ki) {
+  llvm::BasicBlock *bb = ki->inst->getParent();
+  if (&*bb->begin() != ki->inst)
+    return false;
+  auto it = llvm::pred_begin(bb), ie = llvm::pred_end(bb);
+  return it != ie && ++it != ie;
+}
+
+/// Rough cost of merging \arg a and \arg b: the constraints and memory
+/// objects which differ between them end up behind ite expressions.
+static unsigned mergeCost(const ExecutionState &a, const ExecutionState &b) {
+  // States share the constraints of their last common ancestor as prefix.
+  auto ai = a.constraints.begin(), ae = a.constraints.end();
+  auto bi = b.constraints.begin(), be = b.constraints.end();
+  unsigned common = 0;
+  for (; ai != ae && bi != be && *ai == *bi; ++ai, ++bi)
+    ++common;
+  unsigned cost = a.constraints.size() + b.constraints.size() - 2 * common;
+
+  auto ao = a.addressSpace.objects.begin(), aoe = a.addressSpace.objects.end();
+  auto bo = b.addressSpace.objects.begin(), boe = b.addressSpace.objects.end();
+  for (; ao != aoe && bo != boe; ++ao, ++bo)
+    if (ao->first != bo->first || ao->second.get() != bo->second.get())
+      ++cost;
+  return cost;
+}
+
+bool JoinPointMerger::reachedJoinPoint(ExecutionState &es) {
+  KInstruction *pc = es.pc;
+  auto r = released.find(&es);
+  if (r != released.end()) {
+    bool wasReleasedHere = r->second == pc;
+    released.erase(r);
+    if (wasReleasedHere)
+      return false;
+  }
+  if (!isJoinPoint(pc))
+    return false;
+
+  std::vector<ExecutionState *> &states = waiting[pc];
+
+  // Phi nodes pick their value by the block the state came from.
+  bool hasPhis = llvm::isa<llvm::PHINode>(pc->inst);
+  std::vector<std::pair<unsigned, ExecutionState *> > candidates;
+  for (ExecutionState *other : states) {
+    if (hasPhis && other->incomingBBIndex != es.incomingBBIndex)
+      continue;
+    if (!other->hasSameHeapLayout(es))
+      continue;
+    candidates.push_back(std::make_pair(mergeCost(*other, es), other));
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const std::pair<unsigned, ExecutionState *> &a,
+                      const std::pair<unsigned, ExecutionState *> &b) {
+                     return a.first < b.first;
+                   });
+
+  for (auto &candidate : candidates) {
+    if (candidate.second->merge(es)) {
+      if (DebugLogMerge)
+        llvm::errs() << "Merged state " << &es << " into " << candidate.second
+                     << " at a join point, cost " << candidate.first << "\n";
+      executor->terminateState(es);
+      return true;
+    }
+  }
+
+  executor->mergingSearcher->pauseState(es);
+  states.push_back(&es);
+  if (states.size() > AutoMergeMaxWaiting) {
+    ExecutionState *oldest = states.front();
+    states.erase(states.begin());
+    if (states.empty())
+      waiting.erase(pc);
+    release(oldest);
+  }
+  return true;
+}
+
+void JoinPointMerger::release(ExecutionState *es) {
+  released[es] = es->pc;
+  executor->mergingSearcher->continueState(*es);
+}
+
+void JoinPointMerger::releaseStates() {
+  for (auto &point : waiting)
+    for (ExecutionState *es : point.second)
+      release(es);
+  waiting.clear();
+}
+
+void JoinPointMerger::removeStates(const std::vector<ExecutionState *> &states) {
+  for (ExecutionState *es : states) {
+    released.erase(es);
+    auto point = waiting.find(es->pc);
+    if (point == waiting.end())
+      continue;
+    auto it = std::find(point->second.begin(), point->second.end(), es);
+    if (it == point->second.end())
+      continue;
+    point->second.erase(it);
+    if (point->second.empty())
+      waiting.erase(point);
+    executor->mergingSearcher->continueState(*es);
+  }
+}
 }
@@ -88,8 +88,11 @@ extern llvm::cl::opt<bool> DebugLogMerge;
 
 extern llvm::cl::opt<bool> DebugLogIncompleteMerge;
 
+extern llvm::cl::opt<bool> UseAutoMerge;
+
 class Executor;
 class ExecutionState;
+struct KInstruction;
 
 /// @brief Represents one `klee_open_merge()` call. 
 /// Handles merging of states that branched from it
@@ -152,6 +155,47 @@ class MergeHandler {
         MergeHandler(Executor *_executor, ExecutionState *es);
         ~MergeHandler();
 };
+
+/// @brief Merges states automatically where control flow joins, without
+/// klee_open_merge() and klee_close_merge().
+///
+/// A state entering a block with several predecessors is paused there and
+/// waits for other states to arrive. Only states whose heap_allocs
+/// histories and native heap layouts are identical are considered, so that
+/// merged states never need a native rollback. Among those, the cheapest
+/// candidates, with the fewest differing constraints and objects, are
+/// tried first. Waiting states are released once too many states wait at
+/// the same point, or when no other state is left to run.
+class JoinPointMerger {
+    private:
+        Executor *executor;
+
+        /// @brief States paused at the entry of join blocks, oldest first
+        std::map<KInstruction *, std::vector<ExecutionState *> > waiting;
+
+        /// @brief States released from the join point they are still at,
+        /// which must not wait there again
+        std::map<ExecutionState *, KInstruction *> released;
+
+        void release(ExecutionState *es);
+
+    public:
+        JoinPointMerger(Executor *_executor) : executor(_executor) {}
+
+        /// @brief Called before the selected state runs, once it no longer
+        /// waits for the solver to decide a branch. Returns true if it was
+        /// merged into another state or paused, and so must not run.
+        bool reachedJoinPoint(ExecutionState &es);
+
+        /// @brief Continue all waiting states
+        void releaseStates();
+
+        bool hasWaitingStates() const { return !waiting.empty(); }
+
+        /// @brief Forget states which are about to be removed, continuing
+        /// them first if they wait, so that the searchers know them
+        void removeStates(const std::vector<ExecutionState *> &states);
+};
 }
 
 #endif	/* KLEE_MERGEHANDLER_H */
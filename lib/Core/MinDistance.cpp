@@ -0,0 +1,133 @@
+//===-- MinDistance.cpp ---------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "MinDistance.h"
+
+#include <cassert>
+#include <functional>
+#include <queue>
+#include <utility>
+
+using namespace klee;
+
+namespace {
+typedef std::pair<MinDistance::distance_ty, unsigned> QueueEntry;
+/// Nodes ordered by increasing distance.
+typedef std::priority_queue<QueueEntry, std::vector<QueueEntry>,
+                            std::greater<QueueEntry> >
+    NodeQueue;
+} // namespace
+
+MinDistance::MinDistance(unsigned numNodes)
+    : succs(numNodes), preds(numNodes), targets(numNodes),
+      distances(numNodes), affected(numNodes) {}
+
+void MinDistance::addEdge(unsigned from, unsigned to, unsigned weight) {
+  assert(weight > 0 && "edge weights must be positive");
+  succs[from].push_back(Edge{to, weight});
+  preds[to].push_back(Edge{from, weight});
+}
+
+void MinDistance::compute() {
+  // Dijkstra from all targets at once, along the reversed edges.
+  NodeQueue queue;
+  for (unsigned node = 0, e = distances.size(); node != e; ++node) {
+    distances[node] = targets[node];
+    if (targets[node])
+      queue.push(QueueEntry(1, node));
+  }
+
+  while (!queue.empty()) {
+    QueueEntry top = queue.top();
+    queue.pop();
+    if (top.first != distances[top.second])
+      continue;
+    for (const Edge &edge : preds[top.second]) {
+      distance_ty d = top.first + edge.weight;
+      if (!distances[edge.node] || d < distances[edge.node]) {
+        distances[edge.node] = d;
+        queue.push(QueueEntry(d, edge.node));
+      }
+    }
+  }
+}
+
+bool MinDistance::isSupported(unsigned node) const {
+  if (targets[node])
+    return true;
+  for (const Edge &edge : succs[node]) {
+    distance_ty d = distances[edge.node];
+    if (d && !affected[edge.node] && d + edge.weight == distances[node])
+      return true;
+  }
+  return false;
+}
+
+void MinDistance::removeTargets(const std::vector<unsigned> &nodes,
+                                std::vector<unsigned> &changed) {
+  // Find the affected nodes: those which lost every shortest path. Going by
+  // increasing distance decides all possible supports of a node, which are
+  // closer, before the node itself.
+  NodeQueue queue;
+  for (unsigned node : nodes) {
+    if (targets[node]) {
+      targets[node] = false;
+      queue.push(QueueEntry(distances[node], node));
+    }
+  }
+
+  std::vector<unsigned> affectedNodes;
+  while (!queue.empty()) {
+    unsigned node = queue.top().second;
+    queue.pop();
+    if (affected[node] || isSupported(node))
+      continue;
+    affected[node] = true;
+    affectedNodes.push_back(node);
+    for (const Edge &edge : preds[node]) {
+      distance_ty d = distances[edge.node];
+      if (!affected[edge.node] && d && d == distances[node] + edge.weight)
+        queue.push(QueueEntry(d, edge.node));
+    }
+  }
+
+  // Start the affected nodes at their best edge leaving the affected
+  // region, then settle the region with Dijkstra.
+  for (unsigned node : affectedNodes) {
+    distance_ty best = 0;
+    for (const Edge &edge : succs[node]) {
+      distance_ty d = distances[edge.node];
+      if (d && !affected[edge.node] && (!best || d + edge.weight < best))
+        best = d + edge.weight;
+    }
+    distances[node] = best;
+    if (best)
+      queue.push(QueueEntry(best, node));
+  }
+
+  while (!queue.empty()) {
+    QueueEntry top = queue.top();
+    queue.pop();
+    if (top.first != distances[top.second])
+      continue;
+    for (const Edge &edge : preds[top.second]) {
+      if (!affected[edge.node])
+        continue;
+      distance_ty d = top.first + edge.weight;
+      if (!distances[edge.node] || d < distances[edge.node]) {
+        distances[edge.node] = d;
+        queue.push(QueueEntry(d, edge.node));
+      }
+    }
+  }
+
+  for (unsigned node : affectedNodes)
+    affected[node] = false;
+  changed.insert(changed.end(), affectedNodes.begin(), affectedNodes.end());
+}
@@ -0,0 +1,66 @@
+//===-- MinDistance.h -------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_MINDISTANCE_H
+#define KLEE_MINDISTANCE_H
+
+#include <cstdint>
+#include <vector>
+
+namespace klee {
+  /// MinDistance - Shortest distances from every node of a weighted graph
+  /// to the nearest target node, kept up to date as targets are removed.
+  ///
+  /// Distances follow the conventions of the instruction level distance
+  /// statistics: a target is at distance 1, and 0 means that no target is
+  /// reachable. Removing targets only makes distances longer, so
+  /// removeTargets() recomputes only the nodes whose shortest paths led to
+  /// a removed target, as in the dynamic shortest path algorithm of
+  /// Ramalingam and Reps.
+  class MinDistance {
+  public:
+    typedef std::uint64_t distance_ty;
+
+  private:
+    struct Edge {
+      unsigned node;
+      unsigned weight;
+    };
+
+    std::vector<std::vector<Edge> > succs, preds;
+    std::vector<bool> targets;
+    std::vector<distance_ty> distances;
+    /// Scratch space of removeTargets().
+    std::vector<bool> affected;
+
+    /// Whether the distance of \arg node is still realized by a target or
+    /// an edge to a node which is not affected.
+    bool isSupported(unsigned node) const;
+
+  public:
+    explicit MinDistance(unsigned numNodes);
+
+    /// Add an edge, the distance of \arg from is at most \arg weight plus
+    /// the distance of \arg to. Weights must be positive.
+    void addEdge(unsigned from, unsigned to, unsigned weight);
+    void setTarget(unsigned node, bool isTarget) { targets[node] = isTarget; }
+
+    /// Compute all distances from scratch.
+    void compute();
+
+    /// Remove \arg nodes from the targets and update the distances. Nodes
+    /// whose distance may have changed are appended to \arg changed.
+    void removeTargets(const std::vector<unsigned> &nodes,
+                       std::vector<unsigned> &changed);
+
+    distance_ty get(unsigned node) const { return distances[node]; }
+  };
+}
+
+#endif /* KLEE_MINDISTANCE_H */
@@ -11,6 +11,7 @@
 
 #include "ExecutionState.h"
 
+#include "klee/ADT/RNG.h"
 #include "klee/Expr/Expr.h"
 #include "klee/Expr/ExprPPrinter.h"
 
@@ -18,32 +19,107 @@
 
 using namespace klee;
 
-PTree::PTree(ExecutionState *initialState) {
-  root = std::make_unique<PTreeNode>(nullptr, initialState);
+namespace klee {
+  extern RNG theRNG;
 }
 
-void PTree::attach(PTreeNode *node, ExecutionState *leftState, ExecutionState *rightState) {
-  assert(node && !node->left && !node->right);
+const PTreeNodeID PTree::None = ~(PTreeNodeID) 0;
 
-  node->state = nullptr;
-  node->left = std::make_unique<PTreeNode>(node, leftState);
-  node->right = std::make_unique<PTreeNode>(node, rightState);
+PTree::PTree(ExecutionState *initialState) : freeNodes(None) {
+  root = allocate(None, initialState);
 }
 
-void PTree::remove(PTreeNode *n) {
-  assert(!n->left && !n->right);
-  do {
-    PTreeNode *p = n->parent;
-    if (p) {
-      if (n == p->left.get()) {
-        p->left = nullptr;
-      } else {
-        assert(n == p->right.get());
-        p->right = nullptr;
-      }
+PTreeNodeID PTree::allocate(PTreeNodeID parent, ExecutionState *state) {
+  PTreeNodeID node = freeNodes;
+  if (node != None) {
+    freeNodes = nodes[node].parent;
+  } else {
+    assert(nodes.size() < None && "process tree too large");
+    node = nodes.size();
+    nodes.emplace_back();
+  }
+
+  nodes[node] = PTreeNode{parent, None, None, state};
+  if (state)
+    state->ptreeNode = node;
+  return node;
+}
+
+void PTree::release(PTreeNodeID node) {
+  nodes[node] = PTreeNode{freeNodes, None, None, nullptr};
+  freeNodes = node;
+}
+
+void PTree::attach(PTreeNodeID node, ExecutionState *leftState, ExecutionState *rightState) {
+  assert(nodes[node].left == None && nodes[node].right == None);
+
+  nodes[node].state = nullptr;
+  // Allocating may move the pool, so don't hold references across it.
+  PTreeNodeID left = allocate(node, leftState);
+  PTreeNodeID right = allocate(node, rightState);
+  nodes[node].left = left;
+  nodes[node].right = right;
+}
+
+void PTree::insert(ExecutionState *state, unsigned depth) {
+  if (root == None) {
+    root = allocate(None, state);
+    return;
+  }
+
+  // The new fork takes the place of `sibling`, one level below the fork
+  // above it, so the state ends up at most `depth` forks deep.
+  PTreeNodeID sibling = root;
+  unsigned flips = 0, bits = 0;
+  for (unsigned level = 1; level < depth && !nodes[sibling].state; ++level) {
+    if (bits == 0) {
+      flips = theRNG.getInt32();
+      bits = 32;
     }
-    n = p;
-  } while (n && !n->left && !n->right);
+    --bits;
+    sibling = (flips & (1 << bits)) ? nodes[sibling].left
+                                    : nodes[sibling].right;
+  }
+
+  PTreeNodeID parent = nodes[sibling].parent;
+  PTreeNodeID fork = allocate(parent, nullptr);
+  PTreeNodeID leaf = allocate(fork, state);
+  nodes[fork].left = sibling;
+  nodes[fork].right = leaf;
+  nodes[sibling].parent = fork;
+  if (parent == None) {
+    root = fork;
+  } else if (nodes[parent].left == sibling) {
+    nodes[parent].left = fork;
+  } else {
+    assert(nodes[parent].right == sibling);
+    nodes[parent].right = fork;
+  }
+}
+
+void PTree::remove(PTreeNodeID n) {
+  assert(nodes[n].left == None && nodes[n].right == None);
+  PTreeNodeID p = nodes[n].parent;
+  release(n);
+  if (p == None) {
+    root = None;
+    return;
+  }
+
+  // The fork no longer branches, splice its other child into its place.
+  PTreeNodeID sibling = nodes[p].left == n ? nodes[p].right : nodes[p].left;
+  PTreeNodeID grandparent = nodes[p].parent;
+  assert(sibling != None && "fork with a single child");
+  nodes[sibling].parent = grandparent;
+  if (grandparent == None) {
+    root = sibling;
+  } else if (nodes[grandparent].left == p) {
+    nodes[grandparent].left = sibling;
+  } else {
+    assert(nodes[grandparent].right == p);
+    nodes[grandparent].right = sibling;
+  }
+  release(p);
 }
 
 void PTree::dump(llvm::raw_ostream &os) {
@@ -56,29 +132,26 @@ void PTree::dump(llvm::raw_ostream &os) {
   os << "\tcenter = \"true\";\n";
   os << "\tnode [style=\"filled\",width=.1,height=.1,fontname=\"Terminus\"]\n";
   os << "\tedge [arrowsize=.3]\n";
-  std::vector<const PTreeNode*> stack;
-  stack.push_back(root.get());
+  std::vector<PTreeNodeID> stack;
+  if (root != None)
+    stack.push_back(root);
   while (!stack.empty()) {
-    const PTreeNode *n = stack.back();
+    PTreeNodeID id = stack.back();
+    const PTreeNode &n = nodes[id];
     stack.pop_back();
-    os << "\tn" << n << " [shape=diamond";
-    if (n->state)
+    os << "\tn" << id << " [shape=diamond";
+    if (n.state)
       os << ",fillcolor=green";
     os << "];\n";
-    if (n->left) {
-      os << "\tn" << n << " -> n" << n->left.get() << ";\n";
-      stack.push_back(n->left.get());
+    if (n.left != None) {
+      os << "\tn" << id << " -> n" << n.left << ";\n";
+      stack.push_back(n.left);
     }
-    if (n->right) {
-      os << "\tn" << n << " -> n" << n->right.get() << ";\n";
-      stack.push_back(n->right.get());
+    if (n.right != None) {
+      os << "\tn" << id << " -> n" << n.right << ";\n";
+      stack.push_back(n.right);
     }
   }
   os << "}\n";
   delete pp;
 }
-
-PTreeNode::PTreeNode(PTreeNode *parent, ExecutionState *state) : parent{parent}, state{state} {
-  state->ptreeNode = this;
-}
-
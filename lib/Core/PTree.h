@@ -12,29 +12,60 @@
 
 #include "klee/Expr/Expr.h"
 
+#include <cstdint>
+#include <vector>
+
 namespace klee {
     class ExecutionState;
 
+    /// Index of a node in the node pool of a PTree.
+    typedef std::uint32_t PTreeNodeID;
+
     class PTreeNode {
         public:
-            PTreeNode *parent = nullptr;
-            std::unique_ptr<PTreeNode> left;
-            std::unique_ptr<PTreeNode> right;
-            ExecutionState *state = nullptr;
-
-            PTreeNode(const PTreeNode&) = delete;
-            PTreeNode(PTreeNode *parent, ExecutionState *state);
-            ~PTreeNode() = default;
+            PTreeNodeID parent;
+            PTreeNodeID left;
+            PTreeNodeID right;
+            /// The state at a leaf, null at inner nodes.
+            ExecutionState *state;
     };
 
+    /// PTree - The process tree: its leaves are the live states, its inner
+    /// nodes the forks which led to them.
+    ///
+    /// Nodes live in one pool and refer to each other by 32-bit indices.
+    /// Once all states on one side of a fork are gone, the fork is spliced
+    /// out, so every inner node has two children and the tree has fewer
+    /// nodes than twice the number of states. Walking from the root to a
+    /// state only passes forks which still branch.
     class PTree {
+            std::vector<PTreeNode> nodes;
+            /// Head of the list of free nodes, linked through their parents.
+            PTreeNodeID freeNodes;
+
+            PTreeNodeID allocate(PTreeNodeID parent, ExecutionState *state);
+            void release(PTreeNodeID node);
+
         public:
-            std::unique_ptr<PTreeNode> root;
+            /// No node: the parent of the root, the children of a leaf.
+            static const PTreeNodeID None;
+
+            PTreeNodeID root;
             explicit PTree(ExecutionState *initialState);
             ~PTree() = default;
 
-            static void attach(PTreeNode *node, ExecutionState *leftState, ExecutionState *rightState);
-            static void remove(PTreeNode *node);
+            const PTreeNode &operator[](PTreeNodeID node) const {
+                return nodes[node];
+            }
+
+            void attach(PTreeNodeID node, ExecutionState *leftState, ExecutionState *rightState);
+            /// Add a state which does not descend from any state in the
+            /// tree, but stands for a path with \arg depth forks. It is
+            /// spliced in at most that many forks below the root, along a
+            /// random path, so that random-path search picks it about as
+            /// often as it would have picked the original state.
+            void insert(ExecutionState *state, unsigned depth);
+            void remove(PTreeNodeID node);
             void dump(llvm::raw_ostream &os);
     };
 }
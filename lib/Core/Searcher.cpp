@@ -32,10 +32,12 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <atomic>
 #include <cassert>
 #include <climits>
 #include <cmath>
 #include <fstream>
+#include <thread>
 
 using namespace klee;
 using namespace llvm;
@@ -48,6 +50,39 @@ namespace klee {
 Searcher::~Searcher() {
 }
 
+unsigned Searcher::allocateSlot() {
+  static std::atomic<unsigned> slots(0);
+  return slots++;
+}
+
+///
+
+void StateList::push_back(ExecutionState *es) {
+  SearcherSlot &s = es->searcherSlot(slot);
+  s.prev = last;
+  s.next = nullptr;
+  if (last)
+    last->searcherSlot(slot).next = es;
+  else
+    first = es;
+  last = es;
+}
+
+void StateList::remove(ExecutionState *es) {
+  SearcherSlot &s = es->searcherSlot(slot);
+  assert((s.prev ? s.prev->searcherSlot(slot).next : first) == es &&
+         "invalid state removed");
+  if (s.prev)
+    s.prev->searcherSlot(slot).next = s.next;
+  else
+    first = s.next;
+  if (s.next)
+    s.next->searcherSlot(slot).prev = s.prev;
+  else
+    last = s.prev;
+  s.prev = s.next = nullptr;
+}
+
 ///
 
 ExecutionState &DFSSearcher::selectState() {
@@ -57,31 +92,10 @@ ExecutionState &DFSSearcher::selectState() {
 void DFSSearcher::update(ExecutionState *current,
                          const std::vector<ExecutionState *> &addedStates,
                          const std::vector<ExecutionState *> &removedStates) {
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
-  for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
-                                                     ie = removedStates.end();
-       it != ie; ++it) {
-    ExecutionState *es = *it;
-    if (es == states.back()) {
-      states.pop_back();
-    } else {
-      bool ok = false;
-
-      for (std::vector<ExecutionState*>::iterator it = states.begin(),
-             ie = states.end(); it != ie; ++it) {
-        if (es==*it) {
-          states.erase(it);
-          ok = true;
-          break;
-        }
-      }
-
-      (void) ok;
-      assert(ok && "invalid state removed");
-    }
-  }
+  for (ExecutionState *es : addedStates)
+    states.push_back(es);
+  for (ExecutionState *es : removedStates)
+    states.remove(es);
 }
 
 ///
@@ -98,37 +112,14 @@ void BFSSearcher::update(ExecutionState *current,
   if (!addedStates.empty() && current &&
       std::find(removedStates.begin(), removedStates.end(), current) ==
           removedStates.end()) {
-    auto pos = std::find(states.begin(), states.end(), current);
-    assert(pos != states.end());
-    states.erase(pos);
+    states.remove(current);
     states.push_back(current);
   }
 
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
-  for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
-                                                     ie = removedStates.end();
-       it != ie; ++it) {
-    ExecutionState *es = *it;
-    if (es == states.front()) {
-      states.pop_front();
-    } else {
-      bool ok = false;
-
-      for (std::deque<ExecutionState*>::iterator it = states.begin(),
-             ie = states.end(); it != ie; ++it) {
-        if (es==*it) {
-          states.erase(it);
-          ok = true;
-          break;
-        }
-      }
-
-      (void) ok;
-      assert(ok && "invalid state removed");
-    }
-  }
+  for (ExecutionState *es : addedStates)
+    states.push_back(es);
+  for (ExecutionState *es : removedStates)
+    states.remove(es);
 }
 
 ///
@@ -141,26 +132,20 @@ void
 RandomSearcher::update(ExecutionState *current,
                        const std::vector<ExecutionState *> &addedStates,
                        const std::vector<ExecutionState *> &removedStates) {
-  states.insert(states.end(),
-                addedStates.begin(),
-                addedStates.end());
-  for (std::vector<ExecutionState *>::const_iterator it = removedStates.begin(),
-                                                     ie = removedStates.end();
-       it != ie; ++it) {
-    ExecutionState *es = *it;
-    __attribute__((unused))
-    bool ok = false;
-
-    for (std::vector<ExecutionState*>::iterator it = states.begin(),
-           ie = states.end(); it != ie; ++it) {
-      if (es==*it) {
-        states.erase(it);
-        ok = true;
-        break;
-      }
-    }
-    
-    assert(ok && "invalid state removed");
+  for (ExecutionState *es : addedStates) {
+    es->searcherSlot(slot).index = states.size();
+    states.push_back(es);
+  }
+
+  // Move the last state into the hole.
+  for (ExecutionState *es : removedStates) {
+    std::size_t index = es->searcherSlot(slot).index;
+    assert(index < states.size() && states[index] == es &&
+           "invalid state removed");
+    ExecutionState *moved = states.back();
+    states[index] = moved;
+    moved->searcherSlot(slot).index = index;
+    states.pop_back();
   }
 }
 
@@ -168,7 +153,8 @@ RandomSearcher::update(ExecutionState *current,
 
 WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
   : states(new DiscretePDF<ExecutionState*>()),
-    type(_type) {
+    type(_type),
+    seenDistanceUpdates(getMinDistToUncoveredUpdates()) {
   switch(type) {
   case Depth:
   case RP:
@@ -179,6 +165,7 @@ WeightedRandomSearcher::WeightedRandomSearcher(WeightType _type)
   case QueryCost:
   case MinDistToUncovered:
   case CoveringNew:
+  case ExploitDistance:
     updateWeights = true;
     break;
   default:
@@ -230,12 +217,33 @@ double WeightedRandomSearcher::getWeight(ExecutionState *es) {
       return invMD2U * invMD2U;
     }
   }
+  case ExploitDistance: {
+    uint64_t dist = computeMinDistToExploitSink(*es);
+    double invDist = 1. / (dist ? dist : 10000);
+    // A state which already wrote through a symbolic pointer is a step
+    // away from an exploit, whatever the distance to the next sink.
+    double capabilities = 1 + es->addressSpace.WriteExploitCapability.size();
+    return capabilities * invDist * invDist;
+  }
   }
 }
 
 void WeightedRandomSearcher::update(
     ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
     const std::vector<ExecutionState *> &removedStates) {
+  // New distances to uncovered code change the weights of all states, not
+  // just the current one. Recompute them in one pass, on several threads
+  // once there are enough states to make that worthwhile.
+  if ((type == MinDistToUncovered || type == CoveringNew) &&
+      seenDistanceUpdates != getMinDistToUncoveredUpdates()) {
+    seenDistanceUpdates = getMinDistToUncoveredUpdates();
+    unsigned numThreads = std::min<std::size_t>(
+        std::max(1u, std::thread::hardware_concurrency()),
+        states->size() / 16384 + 1);
+    states->reweight([this](ExecutionState *es) { return getWeight(es); },
+                     numThreads);
+  }
+
   if (current && updateWeights &&
       std::find(removedStates.begin(), removedStates.end(), current) ==
           removedStates.end())
@@ -269,23 +277,20 @@ RandomPathSearcher::~RandomPathSearcher() {
 
 ExecutionState &RandomPathSearcher::selectState() {
   unsigned flips=0, bits=0;
-  PTreeNode *n = executor.processTree->root.get();
-  while (!n->state) {
-    if (!n->left) {
-      n = n->right.get();
-    } else if (!n->right) {
-      n = n->left.get();
-    } else {
-      if (bits==0) {
-        flips = theRNG.getInt32();
-        bits = 32;
-      }
-      --bits;
-      n = (flips&(1<<bits)) ? n->left.get() : n->right.get();
+  const PTree &tree = *executor.processTree;
+  // Forks whose other side is gone are spliced out, so every inner node
+  // has two children.
+  PTreeNodeID n = tree.root;
+  while (!tree[n].state) {
+    if (bits==0) {
+      flips = theRNG.getInt32();
+      bits = 32;
     }
+    --bits;
+    n = (flips&(1<<bits)) ? tree[n].left : tree[n].right;
   }
 
-  return *n->state;
+  return *tree[n].state;
 }
 
 void
@@ -388,6 +393,115 @@ BatchingSearcher::update(ExecutionState *current,
 
 /***/
 
+NMESwitchSearcher::NMESwitchSearcher(Searcher *_baseSearcher,
+                                     unsigned _quantum)
+  : baseSearcher(_baseSearcher),
+    quantum(_quantum),
+    slot(allocateSlot()),
+    nativeHash(0),
+    lastSwitchInstructions(0) {
+}
+
+NMESwitchSearcher::~NMESwitchSearcher() {
+  delete baseSearcher;
+}
+
+std::uint64_t NMESwitchSearcher::hashEntry(const ExecutionState &es,
+                                           std::size_t i) {
+  // What HeapAlloc::operator!= compares, which nme_req() uses to find the
+  // common prefix.
+  const HeapAlloc &ha = es.heap_allocs[i];
+  std::uint64_t hash = (std::uint64_t) (std::uintptr_t) ha.mo;
+  hash = hash * UINT64_C(0x9E3779B97F4A7C15) ^ ha.size;
+  hash = hash * UINT64_C(0x9E3779B97F4A7C15) ^ (std::uint64_t) ha.req;
+  return hash;
+}
+
+std::uint64_t NMESwitchSearcher::extendHash(std::uint64_t hash,
+                                            const ExecutionState &es,
+                                            std::size_t from) {
+  for (std::size_t i = from, e = es.heap_allocs.size(); i != e; ++i)
+    hash = (hash ^ hashEntry(es, i)) * UINT64_C(0x100000001B3);
+  return hash;
+}
+
+void NMESwitchSearcher::addState(ExecutionState *es) {
+  History history{es->heap_allocs.size(), extendHash(0, *es, 0)};
+  histories[es] = history;
+  groups.emplace(history.hash, StateList(slot)).first->second.push_back(es);
+}
+
+void NMESwitchSearcher::removeState(ExecutionState *es) {
+  auto it = histories.find(es);
+  assert(it != histories.end() && "invalid state removed");
+  auto group = groups.find(it->second.hash);
+  group->second.remove(es);
+  if (group->second.empty())
+    groups.erase(group);
+  histories.erase(it);
+}
+
+std::size_t NMESwitchSearcher::switchCost(const ExecutionState &es) const {
+  std::size_t size = es.heap_allocs.size(), common = 0;
+  while (common < size && common < nativeHeap.size() &&
+         hashEntry(es, common) == nativeHeap[common])
+    ++common;
+  // Roll back the native heap to the common prefix, then replay.
+  return nativeHeap.size() + size - 2 * common;
+}
+
+ExecutionState &NMESwitchSearcher::selectState() {
+  ExecutionState &choice = baseSearcher->selectState();
+  auto history = histories.find(&choice);
+  assert(history != histories.end() && "state unknown to NMESwitchSearcher");
+  if (history->second.hash == nativeHash)
+    return choice;
+
+  if (stats::instructions - lastSwitchInstructions < quantum) {
+    auto group = groups.find(nativeHash);
+    if (group != groups.end()) {
+      // Take turns among the states matching the native heap.
+      ExecutionState *es = group->second.front();
+      group->second.remove(es);
+      group->second.push_back(es);
+      return *es;
+    }
+  }
+
+  if (switchCost(choice))
+    lastSwitchInstructions = stats::instructions;
+  return choice;
+}
+
+void NMESwitchSearcher::update(
+    ExecutionState *current, const std::vector<ExecutionState *> &addedStates,
+    const std::vector<ExecutionState *> &removedStates) {
+  // A state which made heap requests moved the native heap to its history.
+  // Histories only grow.
+  auto it = current ? histories.find(current) : histories.end();
+  if (it != histories.end() && current->heap_allocs.size() != it->second.size) {
+    History history{current->heap_allocs.size(),
+                    extendHash(it->second.hash, *current, it->second.size)};
+    removeState(current);
+    histories[current] = history;
+    groups.emplace(history.hash, StateList(slot))
+        .first->second.push_back(current);
+
+    nativeHeap.clear();
+    for (std::size_t i = 0; i != history.size; ++i)
+      nativeHeap.push_back(hashEntry(*current, i));
+    nativeHash = history.hash;
+  }
+
+  for (ExecutionState *es : removedStates)
+    removeState(es);
+  for (ExecutionState *es : addedStates)
+    addState(es);
+  baseSearcher->update(current, addedStates, removedStates);
+}
+
+/***/
+
 IterativeDeepeningTimeSearcher::IterativeDeepeningTimeSearcher(Searcher *_baseSearcher)
   : baseSearcher(_baseSearcher),
     time(time::seconds(1)) {
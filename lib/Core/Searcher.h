@@ -15,9 +15,11 @@
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <cstdint>
 #include <map>
 #include <queue>
 #include <set>
+#include <unordered_map>
 #include <vector>
 
 namespace llvm {
@@ -50,6 +52,10 @@ namespace klee {
       os << "<unnamed searcher>\n";
     }
 
+    /// Allocate a slot in ExecutionState::searcherSlots, for a searcher
+    /// which removes states in constant time.
+    static unsigned allocateSlot();
+
     // pgbovine - to be called when a searcher gets activated and
     // deactivated, say, by a higher-level searcher; most searchers
     // don't need this functionality, so don't have to override.
@@ -81,12 +87,33 @@ namespace klee {
       NURS_RP,
       NURS_ICnt,
       NURS_CPICnt,
-      NURS_QC
+      NURS_QC,
+      NURS_Exploit
     };
   };
 
+  /// StateList - A list of states linked through their searcher slots, so
+  /// that any state is removed in constant time.
+  class StateList {
+    unsigned slot;
+    ExecutionState *first = nullptr, *last = nullptr;
+
+  public:
+    StateList() : slot(Searcher::allocateSlot()) {}
+    /// A list sharing \arg slot with other lists, for states which are in
+    /// at most one of them.
+    explicit StateList(unsigned slot) : slot(slot) {}
+
+    bool empty() const { return !first; }
+    ExecutionState *front() const { return first; }
+    ExecutionState *back() const { return last; }
+
+    void push_back(ExecutionState *es);
+    void remove(ExecutionState *es);
+  };
+
   class DFSSearcher : public Searcher {
-    std::vector<ExecutionState*> states;
+    StateList states;
 
   public:
     ExecutionState &selectState();
@@ -100,7 +127,7 @@ namespace klee {
   };
 
   class BFSSearcher : public Searcher {
-    std::deque<ExecutionState*> states;
+    StateList states;
 
   public:
     ExecutionState &selectState();
@@ -115,8 +142,11 @@ namespace klee {
 
   class RandomSearcher : public Searcher {
     std::vector<ExecutionState*> states;
+    unsigned slot;
 
   public:
+    RandomSearcher() : slot(allocateSlot()) {}
+
     ExecutionState &selectState();
     void update(ExecutionState *current,
                 const std::vector<ExecutionState *> &addedStates,
@@ -136,13 +166,16 @@ namespace klee {
       InstCount,
       CPInstCount,
       MinDistToUncovered,
-      CoveringNew
+      CoveringNew,
+      ExploitDistance
     };
 
   private:
     DiscretePDF<ExecutionState*> *states;
     WeightType type;
     bool updateWeights;
+    /// Distance updates the weights of all states reflect.
+    uint64_t seenDistanceUpdates;
     
     double getWeight(ExecutionState*);
 
@@ -165,6 +198,7 @@ namespace klee {
       case CPInstCount        : os << "CPInstCount\n"; return;
       case MinDistToUncovered : os << "MinDistToUncovered\n"; return;
       case CoveringNew        : os << "CoveringNew\n"; return;
+      case ExploitDistance    : os << "ExploitDistance\n"; return;
       default                 : os << "<unknown type>\n"; return;
       }
     }
@@ -280,6 +314,62 @@ namespace klee {
     }
   };
 
+  /// NMESwitchSearcher - Avoids native heap rollbacks with native memory
+  /// emulation.
+  ///
+  /// The native heap follows the heap_allocs history of the last state
+  /// which made a heap request. Running a state with another history rolls
+  /// the native heap back to the common prefix and replays the rest, which
+  /// costs one native request per differing entry. States are grouped by
+  /// history, and for up to `quantum` instructions after each expensive
+  /// switch the searcher keeps to states whose history matches the native
+  /// heap. After that it follows the base searcher again.
+  class NMESwitchSearcher : public Searcher {
+    struct History {
+      std::size_t size;
+      std::uint64_t hash;
+    };
+
+    Searcher *baseSearcher;
+    unsigned quantum;
+    unsigned slot;
+
+    /// States by the hash of their heap_allocs history.
+    std::unordered_map<std::uint64_t, StateList> groups;
+    std::unordered_map<ExecutionState *, History> histories;
+    /// Hashes of the entries of the history the native heap reflects.
+    std::vector<std::uint64_t> nativeHeap;
+    std::uint64_t nativeHash;
+    /// Instruction count at the last expensive switch.
+    std::uint64_t lastSwitchInstructions;
+
+    static std::uint64_t hashEntry(const ExecutionState &es, std::size_t i);
+    static std::uint64_t extendHash(std::uint64_t hash,
+                                    const ExecutionState &es,
+                                    std::size_t from);
+    void addState(ExecutionState *es);
+    void removeState(ExecutionState *es);
+    /// Native requests needed to switch the native heap to the history of
+    /// \arg es.
+    std::size_t switchCost(const ExecutionState &es) const;
+
+  public:
+    NMESwitchSearcher(Searcher *baseSearcher, unsigned quantum);
+    ~NMESwitchSearcher();
+
+    ExecutionState &selectState();
+    void update(ExecutionState *current,
+                const std::vector<ExecutionState *> &addedStates,
+                const std::vector<ExecutionState *> &removedStates);
+    bool empty() { return baseSearcher->empty(); }
+    void printName(llvm::raw_ostream &os) {
+      os << "<NMESwitchSearcher> quantum: " << quantum
+         << ", baseSearcher:\n";
+      baseSearcher->printName(os);
+      os << "</NMESwitchSearcher>\n";
+    }
+  };
+
   class IterativeDeepeningTimeSearcher : public Searcher {
     Searcher *baseSearcher;
     time::Point startTime;
@@ -0,0 +1,55 @@
+//===-- SolverPool.cpp ----------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "SolverPool.h"
+
+#include "klee/Solver/Solver.h"
+
+#include <cassert>
+
+using namespace klee;
+
+SolverPool::SolverPool(unsigned numWorkers, const SolverFactory &factory)
+  : stopping(false) {
+  assert(numWorkers && "solver pool without workers");
+  for (unsigned i = 0; i < numWorkers; ++i)
+    solvers.push_back(factory(i));
+  for (unsigned i = 0; i < numWorkers; ++i)
+    workers.emplace_back(&SolverPool::work, this, i);
+}
+
+SolverPool::~SolverPool() {
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+    // Outstanding futures report a broken promise.
+    jobs.clear();
+  }
+  available.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+  for (auto solver : solvers)
+    delete solver;
+}
+
+void SolverPool::work(unsigned id) {
+  Solver &solver = *solvers[id];
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      available.wait(guard, [this]() { return stopping || !jobs.empty(); });
+      if (stopping)
+        return;
+      job = std::move(jobs.front());
+      jobs.pop_front();
+    }
+    job(solver);
+  }
+}
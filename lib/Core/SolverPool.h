@@ -0,0 +1,75 @@
+//===-- SolverPool.h --------------------------------------------*- C++ -*-===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef KLEE_SOLVERPOOL_H
+#define KLEE_SOLVERPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace klee {
+  class Solver;
+
+  /// SolverPool - A fixed number of worker threads, each owning a private
+  /// solver chain, which answer queries submitted by the interpreter.
+  ///
+  /// Solver chains are not thread-safe, so a job only ever sees the solver
+  /// of the worker running it. Jobs must not reference interpreter data
+  /// which may change while they are queued (e.g. a state's constraints).
+  class SolverPool {
+  public:
+    typedef std::function<Solver *(unsigned)> SolverFactory;
+
+  private:
+    typedef std::function<void(Solver &)> Job;
+
+    std::vector<std::thread> workers;
+    std::vector<Solver *> solvers;
+
+    std::mutex lock;
+    std::condition_variable available;
+    std::deque<Job> jobs;
+    bool stopping;
+
+    void work(unsigned id);
+
+  public:
+    /// \param factory Called once per worker (on the constructing thread)
+    /// to create the solver chain owned by that worker.
+    SolverPool(unsigned numWorkers, const SolverFactory &factory);
+    ~SolverPool();
+
+    SolverPool(const SolverPool &) = delete;
+    SolverPool &operator=(const SolverPool &) = delete;
+
+    unsigned size() const { return workers.size(); }
+
+    /// Queue \a job for the next idle worker.
+    template <class R>
+    std::future<R> submit(std::function<R(Solver &)> job) {
+      auto task = std::make_shared<std::packaged_task<R(Solver &)> >(
+          std::move(job));
+      std::future<R> result = task->get_future();
+      {
+        std::lock_guard<std::mutex> guard(lock);
+        jobs.emplace_back([task](Solver &solver) { (*task)(solver); });
+      }
+      available.notify_one();
+      return result;
+    }
+  };
+}
+
+#endif /* KLEE_SOLVERPOOL_H */
@@ -25,6 +25,7 @@
 #include "CoreStats.h"
 #include "Executor.h"
 #include "MemoryManager.h"
+#include "MinDistance.h"
 #include "UserSearcher.h"
 
 #include "llvm/ADT/SmallBitVector.h"
@@ -32,10 +33,12 @@
 #include "llvm/IR/CFG.h"
 #include "llvm/IR/CallSite.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
 #include "llvm/IR/InlineAsm.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/IntrinsicInst.h"
 #include "llvm/IR/Module.h"
+#include "llvm/IR/Operator.h"
 #include "llvm/IR/Type.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/FileSystem.h"
@@ -274,6 +277,7 @@ StatsTracker::StatsTracker(Executor &_executor, std::string _objectFilename,
   // Add timer to calculate uncovered instructions if needed by the solver
   if (updateMinDistToUncovered) {
     computeReachableUncovered();
+    computeReachableExploitSinks();
     executor.timers.add(std::make_unique<Timer>(time::Span{UncoveredUpdateInterval}, [&]{
       computeReachableUncovered();
     }));
@@ -318,6 +322,15 @@ void StatsTracker::done() {
   }
 }
 
+void StatsTracker::resumeInstruction(ExecutionState &es,
+                                     const KInstruction *ki) {
+  if (OutputIStats) {
+    theStatisticManager->setIndex(ki->info->id);
+    if (UseCallPaths)
+      theStatisticManager->setContext(&es.stack.back().callPathNode->statistics);
+  }
+}
+
 void StatsTracker::stepInstruction(ExecutionState &es) {
   if (OutputIStats) {
     if (TrackInstructionTime) {
@@ -360,6 +373,8 @@ void StatsTracker::stepInstruction(ExecutionState &es) {
         es.instsSinceCovNew = 1;
 	++stats::coveredInstructions;
 	stats::uncoveredInstructions += (uint64_t)-1;
+        if (updateMinDistToUncovered)
+          newlyCovered.push_back(ii.id);
       }
     }
   }
@@ -453,7 +468,8 @@ void StatsTracker::writeStatsHeader() {
              << "ResolveTime INTEGER,"
              << "QueryCexCacheMisses INTEGER,"
              << "QueryCexCacheHits INTEGER,"
-             << "ArrayHashTime INTEGER"
+             << "ArrayHashTime INTEGER,"
+             << "NMERequests INTEGER"
          << ')';
   char *zErrMsg = nullptr;
   if(sqlite3_exec(statsFile, create.str().c_str(), nullptr, nullptr, &zErrMsg)) {
@@ -486,7 +502,8 @@ void StatsTracker::writeStatsHeader() {
              << "ResolveTime,"
              << "QueryCexCacheMisses,"
              << "QueryCexCacheHits,"
-             << "ArrayHashTime"
+             << "ArrayHashTime,"
+             << "NMERequests"
          << ") VALUES ("
              << "?,"
              << "?,"
@@ -507,6 +524,7 @@ void StatsTracker::writeStatsHeader() {
              << "?,"
              << "?,"
              << "?,"
+             << "?,"
              << "? "
          << ')';
 
@@ -544,6 +562,7 @@ void StatsTracker::writeStatsLine() {
 #else
   sqlite3_bind_int64(insertStmt, 20, -1LL);
 #endif
+  sqlite3_bind_int64(insertStmt, 21, stats::nmeRequests);
   int errCode = sqlite3_step(insertStmt);
   if(errCode != SQLITE_DONE) klee_error("Error writing stats data: %s", sqlite3_errmsg(statsFile));
   sqlite3_reset(insertStmt);
@@ -730,6 +749,7 @@ typedef std::map<Instruction*, std::vector<Function*> > calltargets_ty;
 static calltargets_ty callTargets;
 static std::map<Function*, std::vector<Instruction*> > functionCallers;
 static std::map<Function*, unsigned> functionShortestPath;
+static uint64_t minDistToUncoveredUpdates = 0;
 
 static std::vector<Instruction*> getSuccs(Instruction *i) {
   BasicBlock *bb = i->getParent();
@@ -767,6 +787,104 @@ uint64_t klee::computeMinDistToUncovered(const KInstruction *ki,
   }
 }
 
+uint64_t klee::getMinDistToUncoveredUpdates() {
+  return minDistToUncoveredUpdates;
+}
+
+uint64_t klee::computeMinDistToExploitSink(const ExecutionState &es) {
+  StatisticManager &sm = *theStatisticManager;
+  uint64_t best = 0, distToFrame = 0;
+  KInstIterator kii = es.pc;
+  for (auto sf = es.stack.rbegin(), se = es.stack.rend(); sf != se; ++sf) {
+    uint64_t local = sm.getIndexedValue(stats::minDistToExploitSink,
+                                        kii->info->id);
+    if (local && (best == 0 || distToFrame + local < best))
+      best = distToFrame + local;
+
+    // Continue in the caller, after the call returns.
+    uint64_t distToReturn =
+        sm.getIndexedValue(stats::minDistToReturn, kii->info->id);
+    if (!distToReturn || !sf->caller)
+      break;
+    distToFrame += distToReturn;
+    kii = sf->caller;
+    ++kii;
+  }
+  return best;
+}
+
+/// Whether \arg inst is an exploit sink: a store through a pointer, an
+/// indirect call, or a call to a function writing to memory.
+static bool isExploitSink(Instruction *inst) {
+  if (StoreInst *si = dyn_cast<StoreInst>(inst)) {
+    // Stores at a fixed offset into a local or global object are not sinks,
+    // but stores at a variable index into one can overflow it.
+    Value *ptr = si->getPointerOperand()->stripPointerCasts();
+    while (GEPOperator *gep = dyn_cast<GEPOperator>(ptr)) {
+      if (!gep->hasAllConstantIndices())
+        return true;
+      ptr = gep->getPointerOperand()->stripPointerCasts();
+    }
+    return !isa<AllocaInst>(ptr) && !isa<GlobalVariable>(ptr);
+  }
+
+  if (!isa<CallInst>(inst) && !isa<InvokeInst>(inst))
+    return false;
+  if (isa<MemIntrinsic>(inst))
+    return true;
+  CallSite cs(inst);
+  if (isa<InlineAsm>(cs.getCalledValue()))
+    return false;
+  Function *target = getDirectCallTarget(cs, /*moduleIsFullyLinked=*/true);
+  if (!target)
+    return true;
+
+  static const char *const writers[] = {
+      "memcpy",  "memmove", "memset", "strcpy", "strncpy", "strcat",
+      "strncat", "sprintf", "gets",   "fgets",  "read",    "fread",
+      "recv",    "scanf",   "sscanf"};
+  StringRef name = target->getName();
+  for (const char *writer : writers)
+    if (name == writer)
+      return true;
+  return false;
+}
+
+void StatsTracker::buildDistanceGraph(MinDistance &graph) {
+  const InstructionInfoTable &infos = *executor.kmodule->infos;
+
+  for (Function &fn : *executor.kmodule->module) {
+    for (BasicBlock &bb : fn) {
+      for (Instruction &inst : bb) {
+        unsigned id = infos.getInfo(inst).id;
+        unsigned bestThrough = 0;
+
+        if (isa<CallInst>(&inst) || isa<InvokeInst>(&inst)) {
+          for (Function *target : callTargets[&inst]) {
+            unsigned dist = functionShortestPath[target];
+            if (dist) {
+              dist = 1+dist; // count instruction itself
+              if (bestThrough==0 || dist<bestThrough)
+                bestThrough = dist;
+            }
+
+            if (!target->isDeclaration()) {
+              Instruction &entry = *target->begin()->begin();
+              graph.addEdge(id, infos.getInfo(entry).id, 1);
+            }
+          }
+        } else {
+          bestThrough = 1;
+        }
+
+        if (bestThrough)
+          for (Instruction *succ : getSuccs(&inst))
+            graph.addEdge(id, infos.getInfo(*succ).id, bestThrough);
+      }
+    }
+  }
+}
+
 void StatsTracker::computeReachableUncovered() {
   KModule *km = executor.kmodule.get();
   const auto m = km->module.get();
@@ -906,83 +1024,34 @@ void StatsTracker::computeReachableUncovered() {
   }
 
   // compute minDistToUncovered, 0 is unreachable
-  std::vector<Instruction *> instructions;
-  for (Module::iterator fnIt = m->begin(), fn_ie = m->end(); 
-       fnIt != fn_ie; ++fnIt) {
-    // Not sure if I should bother to preorder here.
-    for (Function::iterator bbIt = fnIt->begin(), bb_ie = fnIt->end(); 
-         bbIt != bb_ie; ++bbIt) {
-      for (BasicBlock::iterator it = bbIt->begin(), ie = bbIt->end(); 
-           it != ie; ++it) {
-        Instruction *inst = &*it;
-        unsigned id = infos.getInfo(*inst).id;
-        instructions.push_back(inst);
-        sm.setIndexedValue(stats::minDistToUncovered, 
-                           id, 
-                           sm.getIndexedValue(stats::uncoveredInstructions, id));
+  std::vector<unsigned> changed;
+  if (!uncoveredDistances) {
+    uncoveredDistances.reset(new MinDistance(infos.getMaxID()));
+    buildDistanceGraph(*uncoveredDistances);
+    for (Function &fn : *m) {
+      for (BasicBlock &bb : fn) {
+        for (Instruction &inst : bb) {
+          unsigned id = infos.getInfo(inst).id;
+          uncoveredDistances->setTarget(
+              id, sm.getIndexedValue(stats::uncoveredInstructions, id));
+          changed.push_back(id);
+        }
       }
     }
+    uncoveredDistances->compute();
+  } else {
+    // Covering instructions only removes targets, so only the distances
+    // which led to them need to be recomputed.
+    uncoveredDistances->removeTargets(newlyCovered, changed);
   }
-  
-  std::reverse(instructions.begin(), instructions.end());
-  
-  // I'm so lazy it's not even worklisted.
-  bool changed;
-  do {
-    changed = false;
-    for (std::vector<Instruction*>::iterator it = instructions.begin(),
-           ie = instructions.end(); it != ie; ++it) {
-      Instruction *inst = *it;
-      uint64_t best, cur = best = sm.getIndexedValue(stats::minDistToUncovered,
-                                                     infos.getInfo(*inst).id);
-      unsigned bestThrough = 0;
-      
-      if (isa<CallInst>(inst) || isa<InvokeInst>(inst)) {
-        std::vector<Function*> &targets = callTargets[inst];
-        for (std::vector<Function*>::iterator fnIt = targets.begin(),
-               ie = targets.end(); fnIt != ie; ++fnIt) {
-          uint64_t dist = functionShortestPath[*fnIt];
-          if (dist) {
-            dist = 1+dist; // count instruction itself
-            if (bestThrough==0 || dist<bestThrough)
-              bestThrough = dist;
-          }
+  newlyCovered.clear();
 
-          if (!(*fnIt)->isDeclaration()) {
-            uint64_t calleeDist = sm.getIndexedValue(
-                stats::minDistToUncovered, infos.getFunctionInfo(*(*fnIt)).id);
-            if (calleeDist) {
-              calleeDist = 1+calleeDist; // count instruction itself
-              if (best==0 || calleeDist<best)
-                best = calleeDist;
-            }
-          }
-        }
-      } else {
-        bestThrough = 1;
-      }
-      
-      if (bestThrough) {
-        std::vector<Instruction*> succs = getSuccs(inst);
-        for (std::vector<Instruction*>::iterator it2 = succs.begin(),
-               ie = succs.end(); it2 != ie; ++it2) {
-          uint64_t dist = sm.getIndexedValue(stats::minDistToUncovered,
-                                             infos.getInfo(*(*it2)).id);
-          if (dist) {
-            uint64_t val = bestThrough + dist;
-            if (best==0 || val<best)
-              best = val;
-          }
-        }
-      }
-
-      if (best != cur) {
-        sm.setIndexedValue(stats::minDistToUncovered, infos.getInfo(*inst).id,
-                           best);
-        changed = true;
-      }
-    }
-  } while (changed);
+  for (unsigned id : changed)
+    sm.setIndexedValue(stats::minDistToUncovered, id,
+                       uncoveredDistances->get(id));
+  if (changed.empty())
+    return;
+  ++minDistToUncoveredUpdates;
 
   for (std::set<ExecutionState*>::iterator it = executor.states.begin(),
          ie = executor.states.end(); it != ie; ++it) {
@@ -1006,3 +1075,29 @@ void StatsTracker::computeReachableUncovered() {
     }
   }
 }
+
+void StatsTracker::computeReachableExploitSinks() {
+  // Relies on the call targets and return distances computed by the first
+  // computeReachableUncovered().
+  KModule *km = executor.kmodule.get();
+  const InstructionInfoTable &infos = *km->infos;
+  StatisticManager &sm = *theStatisticManager;
+
+  // 0 is unreachable
+  MinDistance sinks(infos.getMaxID());
+  buildDistanceGraph(sinks);
+  for (Function &fn : *km->module)
+    for (BasicBlock &bb : fn)
+      for (Instruction &inst : bb)
+        sinks.setTarget(infos.getInfo(inst).id, isExploitSink(&inst));
+  sinks.compute();
+
+  for (Function &fn : *km->module) {
+    for (BasicBlock &bb : fn) {
+      for (Instruction &inst : bb) {
+        unsigned id = infos.getInfo(inst).id;
+        sm.setIndexedValue(stats::minDistToExploitSink, id, sinks.get(id));
+      }
+    }
+  }
+}
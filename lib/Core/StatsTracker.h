@@ -16,6 +16,7 @@
 #include <memory>
 #include <set>
 #include <sqlite3.h>
+#include <vector>
 
 namespace llvm {
   class BranchInst;
@@ -30,6 +31,7 @@ namespace klee {
   class InstructionInfoTable;
   class InterpreterHandler;
   struct KInstruction;
+  class MinDistance;
   struct StackFrame;
 
   class StatsTracker {
@@ -54,6 +56,10 @@ namespace klee {
     CallPathManager callPathManager;
 
     bool updateMinDistToUncovered;
+    /// Distances to uncovered instructions, updated as they get covered.
+    std::unique_ptr<MinDistance> uncoveredDistances;
+    /// Instructions covered since the last computeReachableUncovered().
+    std::vector<unsigned> newlyCovered;
 
   public:
     static bool useStatistics();
@@ -94,15 +100,33 @@ namespace klee {
     // about to be stepped
     void stepInstruction(ExecutionState &es);
 
+    // restore the statistics context of an instruction es already
+    // stepped, without counting it again
+    void resumeInstruction(ExecutionState &es, const KInstruction *ki);
+
     /// Return duration since execution start.
     time::Span elapsed();
 
     void computeReachableUncovered();
+    void computeReachableExploitSinks();
+
+  private:
+    /// Add the edges between instructions to `graph`: to successors, and
+    /// from calls into the entries of their targets.
+    void buildDistanceGraph(MinDistance &graph);
   };
 
   uint64_t computeMinDistToUncovered(const KInstruction *ki,
                                      uint64_t minDistAtRA);
 
+  /// Number of times the distances to uncovered instructions changed, so
+  /// that weights derived from them can tell when they are stale.
+  uint64_t getMinDistToUncoveredUpdates();
+
+  /// Distance from the current instruction of `es` to the nearest exploit
+  /// sink, through returns to its callers if necessary. 0 is unreachable.
+  uint64_t computeMinDistToExploitSink(const ExecutionState &es);
+
 }
 
 #endif /* KLEE_STATSTRACKER_H */
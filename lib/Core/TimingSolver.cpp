@@ -10,6 +10,7 @@
 #include "TimingSolver.h"
 
 #include "ExecutionState.h"
+#include "SolverPool.h"
 
 #include "klee/Config/Version.h"
 #include "klee/Statistics/Statistics.h"
@@ -21,6 +22,70 @@
 using namespace klee;
 using namespace llvm;
 
+namespace {
+  /// Set for interpreter threads, see TimingSolver::bindThread().
+  thread_local Solver *threadSolver = nullptr;
+  thread_local std::unique_lock<std::mutex> *threadLock = nullptr;
+
+  /// Releases the interpreter lock of the calling thread (if bound) for
+  /// the lifetime of the object. Statistics updated meanwhile are kept
+  /// aside and merged into the issuing instruction once the lock is held
+  /// again. Queries stop their timer before that, waiting for the lock is
+  /// not solver time.
+  class UnlockedQuery {
+    std::unique_ptr<StatisticRecord> statistics;
+    unsigned index;
+    StatisticRecord *context;
+
+  public:
+    UnlockedQuery() : index(0), context(nullptr) {
+      if (!threadLock)
+        return;
+      index = theStatisticManager->getIndex();
+      context = theStatisticManager->getContext();
+      statistics.reset(new StatisticRecord());
+      StatisticManager::setThreadRecord(statistics.get());
+      threadLock->unlock();
+    }
+
+    ~UnlockedQuery() {
+      if (!threadLock)
+        return;
+      threadLock->lock();
+      StatisticManager::setThreadRecord(nullptr);
+      theStatisticManager->setIndex(index);
+      theStatisticManager->setContext(context);
+      theStatisticManager->mergeStatistics(*statistics);
+    }
+  };
+}
+
+/***/
+
+TimingSolver::TimingSolver(Solver *_solver, bool _simplifyExprs)
+  : solver(_solver), simplifyExprs(_simplifyExprs) {}
+
+TimingSolver::~TimingSolver() {
+  // Join the workers before the main solver goes away.
+  pool.reset();
+  delete solver;
+}
+
+void TimingSolver::bindThread(Solver *_threadSolver,
+                              std::unique_lock<std::mutex> *lock) {
+  threadSolver = _threadSolver;
+  threadLock = lock;
+}
+
+Solver &TimingSolver::getSolver() {
+  return threadSolver ? *threadSolver : *solver;
+}
+
+void TimingSolver::startWorkers(unsigned numWorkers,
+                                const std::function<Solver *(unsigned)> &factory) {
+  pool.reset(numWorkers ? new SolverPool(numWorkers, factory) : nullptr);
+}
+
 /***/
 
 bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
@@ -31,14 +96,21 @@ bool TimingSolver::evaluate(const ExecutionState& state, ref<Expr> expr,
         return true;
     }
 
-    TimerStatIncrementer timer(stats::solverTime);
+    WallTimer timer;
 
     if (simplifyExprs)
         expr = state.constraints.simplifyExpr(expr);
 
-    bool success = solver->evaluate(Query(state.constraints, expr), result);
+    bool success;
+    time::Span cost;
+    {
+        UnlockedQuery unlocked;
+        success = getSolver().evaluate(Query(state.constraints, expr), result);
+        cost = timer.delta();
+    }
 
-    state.queryCost += timer.delta();
+    stats::solverTime += cost.toMicroseconds();
+    state.queryCost += cost;
 
     return success;
 }
@@ -51,14 +123,21 @@ bool TimingSolver::mustBeTrue(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
 
-  TimerStatIncrementer timer(stats::solverTime);
+  WallTimer timer;
 
   if (simplifyExprs)
     expr = state.constraints.simplifyExpr(expr);
 
-  bool success = solver->mustBeTrue(Query(state.constraints, expr), result);
+  bool success;
+  time::Span cost;
+  {
+    UnlockedQuery unlocked;
+    success = getSolver().mustBeTrue(Query(state.constraints, expr), result);
+    cost = timer.delta();
+  }
 
-  state.queryCost += timer.delta();
+  stats::solverTime += cost.toMicroseconds();
+  state.queryCost += cost;
 
   return success;
 }
@@ -94,14 +173,21 @@ bool TimingSolver::getValue(const ExecutionState& state, ref<Expr> expr,
     return true;
   }
   
-  TimerStatIncrementer timer(stats::solverTime);
+  WallTimer timer;
 
   if (simplifyExprs)
     expr = state.constraints.simplifyExpr(expr);
 
-  bool success = solver->getValue(Query(state.constraints, expr), result);
+  bool success;
+  time::Span cost;
+  {
+    UnlockedQuery unlocked;
+    success = getSolver().getValue(Query(state.constraints, expr), result);
+    cost = timer.delta();
+  }
 
-  state.queryCost += timer.delta();
+  stats::solverTime += cost.toMicroseconds();
+  state.queryCost += cost;
 
   return success;
 }
@@ -115,18 +201,134 @@ TimingSolver::getInitialValues(const ExecutionState& state,
   if (objects.empty())
     return true;
 
-  TimerStatIncrementer timer(stats::solverTime);
+  WallTimer timer;
 
-  bool success = solver->getInitialValues(Query(state.constraints,
-                                                ConstantExpr::alloc(0, Expr::Bool)), 
-                                          objects, result);
-  
-  state.queryCost += timer.delta();
+  bool success;
+  time::Span cost;
+  {
+    UnlockedQuery unlocked;
+    success = getSolver().getInitialValues(
+        Query(state.constraints, ConstantExpr::alloc(0, Expr::Bool)), objects,
+        result);
+    cost = timer.delta();
+  }
+
+  stats::solverTime += cost.toMicroseconds();
+  state.queryCost += cost;
   
   return success;
 }
 
 std::pair< ref<Expr>, ref<Expr> >
 TimingSolver::getRange(const ExecutionState& state, ref<Expr> expr) {
-  return solver->getRange(Query(state.constraints, expr));
+  UnlockedQuery unlocked;
+  return getSolver().getRange(Query(state.constraints, expr));
+}
+
+/***/
+
+template <class T>
+static AsyncSolverQuery<T> readyQuery(const T &value) {
+  std::promise<AsyncSolverResult<T> > promise;
+  AsyncSolverResult<T> answer;
+  answer.success = true;
+  answer.value = value;
+  promise.set_value(answer);
+  return promise.get_future();
+}
+
+template <class T>
+AsyncSolverQuery<T>
+TimingSolver::submit(const ExecutionState &state, ref<Expr> expr,
+                     time::Span timeout, const QueryFunction<T> &function) {
+  // Snapshot the constraints, the state keeps running (or is destroyed)
+  // while the query is pending.
+  ConstraintManager constraints(state.constraints);
+
+  std::function<AsyncSolverResult<T>(Solver &)> job =
+      [constraints, expr, timeout, function](Solver &s) {
+        AsyncSolverResult<T> answer;
+        StatisticManager::setThreadRecord(&answer.statistics);
+        {
+          TimerStatIncrementer timer(stats::solverTime);
+          s.setCoreSolverTimeout(timeout);
+          answer.success = function(s, Query(constraints, expr), answer.value);
+          s.setCoreSolverTimeout(time::Span());
+          answer.cost = timer.delta();
+        }
+        StatisticManager::setThreadRecord(nullptr);
+        return answer;
+      };
+
+  if (pool)
+    return pool->submit(job);
+
+  // No workers, answer right away with the main solver.
+  std::promise<AsyncSolverResult<T> > promise;
+  promise.set_value(job(*solver));
+  return promise.get_future();
+}
+
+void TimingSolver::account(const ExecutionState &state, time::Span cost,
+                           const StatisticRecord &statistics) {
+  theStatisticManager->mergeStatistics(statistics);
+  state.queryCost += cost;
+}
+
+AsyncSolverQuery<Solver::Validity>
+TimingSolver::evaluateAsync(const ExecutionState &state, ref<Expr> expr,
+                            time::Span timeout) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(expr))
+    return readyQuery(CE->isTrue() ? Solver::True : Solver::False);
+
+  if (simplifyExprs)
+    expr = state.constraints.simplifyExpr(expr);
+
+  return submit<Solver::Validity>(
+      state, expr, timeout,
+      [](Solver &s, const Query &q, Solver::Validity &result) {
+        return s.evaluate(q, result);
+      });
+}
+
+AsyncSolverQuery<bool>
+TimingSolver::mustBeTrueAsync(const ExecutionState &state, ref<Expr> expr,
+                              time::Span timeout) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(expr))
+    return readyQuery(CE->isTrue());
+
+  if (simplifyExprs)
+    expr = state.constraints.simplifyExpr(expr);
+
+  return submit<bool>(state, expr, timeout,
+                      [](Solver &s, const Query &q, bool &result) {
+                        return s.mustBeTrue(q, result);
+                      });
+}
+
+AsyncSolverQuery<ref<ConstantExpr> >
+TimingSolver::getValueAsync(const ExecutionState &state, ref<Expr> expr,
+                            time::Span timeout) {
+  if (ConstantExpr *CE = dyn_cast<ConstantExpr>(expr))
+    return readyQuery(ref<ConstantExpr>(CE));
+
+  if (simplifyExprs)
+    expr = state.constraints.simplifyExpr(expr);
+
+  return submit<ref<ConstantExpr> >(
+      state, expr, timeout,
+      [](Solver &s, const Query &q, ref<ConstantExpr> &result) {
+        return s.getValue(q, result);
+      });
+}
+
+AsyncSolverQuery<std::pair<ref<Expr>, ref<Expr> > >
+TimingSolver::getRangeAsync(const ExecutionState &state, ref<Expr> expr,
+                            time::Span timeout) {
+  typedef std::pair<ref<Expr>, ref<Expr> > range_ty;
+  return submit<range_ty>(state, expr, timeout,
+                          [](Solver &s, const Query &q, range_ty &result) {
+                            result = s.getRange(q);
+                            return true;
+                          });
 }
@@ -12,13 +12,32 @@
 
 #include "klee/Expr/Expr.h"
 #include "klee/Solver/Solver.h"
+#include "klee/Statistics/Statistics.h"
 #include "klee/System/Time.h"
 
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 namespace klee {
     class ExecutionState;
     class Solver;  
+    class SolverPool;
+
+    /// Answer to a query submitted through one of the asynchronous
+    /// TimingSolver methods.
+    template <class T> struct AsyncSolverResult {
+        bool success = false;
+        T value{};
+        time::Span cost;
+        /// Statistics accumulated while answering the query.
+        StatisticRecord statistics;
+    };
+
+    template <class T>
+    using AsyncSolverQuery = std::future<AsyncSolverResult<T> >;
 
     /// TimingSolver - A simple class which wraps a solver and handles
     /// tracking the statistics that we care about.
@@ -27,24 +46,55 @@ namespace klee {
             Solver *solver;
             bool simplifyExprs;
 
+        private:
+            /// Workers answering the asynchronous queries, null if those
+            /// are answered synchronously by \ref solver.
+            std::unique_ptr<SolverPool> pool;
+
+            template <class T>
+            using QueryFunction =
+                std::function<bool(Solver &, const Query &, T &)>;
+
+            template <class T>
+            AsyncSolverQuery<T> submit(const ExecutionState &state,
+                    ref<Expr> expr, time::Span timeout,
+                    const QueryFunction<T> &function);
+
+            void account(const ExecutionState &state, time::Span cost,
+                    const StatisticRecord &statistics);
+
+            /// The solver chain used by the calling thread.
+            Solver &getSolver();
+
         public:
             /// TimingSolver - Construct a new timing solver.
             ///
             /// \param _simplifyExprs - Whether expressions should be
             /// simplified (via the constraint manager interface) prior to
             /// querying.
-            TimingSolver(Solver *_solver, bool _simplifyExprs = true) 
-                : solver(_solver), simplifyExprs(_simplifyExprs) {}
-            ~TimingSolver() {
-                delete solver;
-            }
+            TimingSolver(Solver *_solver, bool _simplifyExprs = true);
+            ~TimingSolver();
+
+            /// Answer asynchronous queries on \a numWorkers threads, each
+            /// with its own solver chain created by \a factory.
+            void startWorkers(unsigned numWorkers,
+                    const std::function<Solver *(unsigned)> &factory);
+
+            bool hasWorkers() const { return pool != nullptr; }
+
+            /// Answer the synchronous queries of the calling thread with
+            /// \a threadSolver instead of \ref solver, and release \a lock
+            /// while they run so that other interpreter threads can make
+            /// progress. Pass null for both to unbind the thread.
+            void bindThread(Solver *threadSolver,
+                    std::unique_lock<std::mutex> *lock);
 
             void setTimeout(time::Span t) {
-                solver->setCoreSolverTimeout(t);
+                getSolver().setCoreSolverTimeout(t);
             }
 
             char *getConstraintLog(const Query& query) {
-                return solver->getConstraintLog(query);
+                return getSolver().getConstraintLog(query);
             }
 
             bool evaluate(const ExecutionState&, ref<Expr>, Solver::Validity &result);
@@ -66,6 +116,36 @@ namespace klee {
 
             std::pair< ref<Expr>, ref<Expr> >
                 getRange(const ExecutionState&, ref<Expr> query);
+
+            /// Asynchronous variants of the queries above. The query is
+            /// built from a snapshot of the state's constraints, so the
+            /// state may change or be destroyed while it is pending. Each
+            /// result has to be retrieved with collect().
+            AsyncSolverQuery<Solver::Validity> evaluateAsync(
+                    const ExecutionState&, ref<Expr>,
+                    time::Span timeout = time::Span());
+
+            AsyncSolverQuery<bool> mustBeTrueAsync(const ExecutionState&,
+                    ref<Expr>, time::Span timeout = time::Span());
+
+            AsyncSolverQuery<ref<ConstantExpr> > getValueAsync(
+                    const ExecutionState&, ref<Expr>,
+                    time::Span timeout = time::Span());
+
+            AsyncSolverQuery<std::pair< ref<Expr>, ref<Expr> > >
+                getRangeAsync(const ExecutionState&, ref<Expr>,
+                        time::Span timeout = time::Span());
+
+            /// Wait for \a query and account its cost to \a state.
+            /// Returns false if the solver failed to answer it.
+            template <class T>
+            bool collect(const ExecutionState &state,
+                    AsyncSolverQuery<T> &query, T &result) {
+                AsyncSolverResult<T> answer = query.get();
+                account(state, answer.cost, answer.statistics);
+                result = answer.value;
+                return answer.success;
+            }
     };
 
 }
@@ -48,7 +48,10 @@ cl::list<Searcher::CoreSearchType> CoreSearch(
                    "use NURS with Instr-Count"),
         clEnumValN(Searcher::NURS_CPICnt, "nurs:cpicnt",
                    "use NURS with CallPath-Instr-Count"),
-        clEnumValN(Searcher::NURS_QC, "nurs:qc", "use NURS with Query-Cost")
+        clEnumValN(Searcher::NURS_QC, "nurs:qc", "use NURS with Query-Cost"),
+        clEnumValN(Searcher::NURS_Exploit, "nurs:exploit",
+                   "use NURS with Min-Dist-to-Exploit-Sink, favouring states "
+                   "with write capabilities")
             KLEE_LLVM_CL_VAL_END),
     cl::cat(SearchCat));
 
@@ -81,14 +84,23 @@ cl::opt<std::string> BatchTime(
     cl::init("5s"),
     cl::cat(SearchCat));
 
+cl::opt<unsigned> NMESwitchQuantum(
+    "nme-switch-quantum",
+    cl::desc("Keep to states whose heap allocation history matches the "
+             "native heap for this many instructions after each switch "
+             "that needs a native heap rollback.  Set to 0 to disable "
+             "(default=0)"),
+    cl::init(0),
+    cl::cat(SearchCat));
+
 } // namespace
 
 void klee::initializeSearchOptions() {
   // default values
   if (CoreSearch.empty()) {
-    if (UseMerge){
+    if (UseMerge || UseAutoMerge){
       CoreSearch.push_back(Searcher::NURS_CovNew);
-      klee_warning("--use-merge enabled. Using NURS_CovNew as default searcher.");
+      klee_warning("Merging enabled. Using NURS_CovNew as default searcher.");
     } else {
       CoreSearch.push_back(Searcher::RandomPath);
       CoreSearch.push_back(Searcher::NURS_CovNew);
@@ -101,7 +113,8 @@ bool klee::userSearcherRequiresMD2U() {
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_CovNew) != CoreSearch.end() ||
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_ICnt) != CoreSearch.end() ||
 	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_CPICnt) != CoreSearch.end() ||
-	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_QC) != CoreSearch.end());
+	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_QC) != CoreSearch.end() ||
+	  std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::NURS_Exploit) != CoreSearch.end());
 }
 
 
@@ -119,6 +132,7 @@ Searcher *getNewSearcher(Searcher::CoreSearchType type, Executor &executor) {
   case Searcher::NURS_ICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::InstCount); break;
   case Searcher::NURS_CPICnt: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::CPInstCount); break;
   case Searcher::NURS_QC: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::QueryCost); break;
+  case Searcher::NURS_Exploit: searcher = new WeightedRandomSearcher(WeightedRandomSearcher::ExploitDistance); break;
   }
 
   return searcher;
@@ -138,6 +152,10 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
     searcher = new InterleavedSearcher(s);
   }
 
+  if (NMESwitchQuantum) {
+    searcher = new NMESwitchSearcher(searcher, NMESwitchQuantum);
+  }
+
   if (UseBatchingSearch) {
     searcher = new BatchingSearcher(searcher, time::Span(BatchTime),
                                     BatchInstructions);
@@ -147,11 +165,11 @@ Searcher *klee::constructUserSearcher(Executor &executor) {
     searcher = new IterativeDeepeningTimeSearcher(searcher);
   }
 
-  if (UseMerge) {
+  if (UseMerge || UseAutoMerge) {
     if (std::find(CoreSearch.begin(), CoreSearch.end(), Searcher::RandomPath) !=
         CoreSearch.end()) {
-      klee_error("use-merge currently does not support random-path, please use "
-                 "another search strategy");
+      klee_error("use-merge and auto-merge currently do not support "
+                 "random-path, please use another search strategy");
     }
 
     auto *ms = new MergingSearcher(searcher);
@@ -0,0 +1,381 @@
+//===-- CompiledExpr.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/CompiledExpr.h"
+
+#include "klee/Expr/Assignment.h"
+
+#include <cassert>
+
+using namespace klee;
+
+namespace {
+inline uint64_t getMask(Expr::Width w) {
+  return w >= 64 ? ~UINT64_C(0) : (UINT64_C(1) << w) - 1;
+}
+
+inline int64_t signExtend(uint64_t v, Expr::Width w) {
+  if (w >= 64)
+    return (int64_t) v;
+  unsigned shift = 64 - w;
+  return (int64_t) (v << shift) >> shift;
+}
+}
+
+CompiledExpr::CompiledExpr(const std::vector<ref<Expr> > &exprs)
+    : roots(exprs), valid(true) {
+  for (const auto &e : roots) {
+    rootRegisters.push_back(compile(e));
+    if (!valid)
+      break;
+  }
+
+  // Only needed while compiling.
+  exprRegisters.clear();
+  chainIds.clear();
+  arraySlots.clear();
+
+  registers.resize(instructions.size());
+  bindings.resize(arrays.size() * BatchSize);
+}
+
+unsigned CompiledExpr::getArraySlot(const Array *array) {
+  auto it = arraySlots.find(array);
+  if (it != arraySlots.end())
+    return it->second;
+  if (array->getRange() > 64)
+    valid = false;
+  arrays.push_back(array);
+  return arraySlots[array] = arrays.size() - 1;
+}
+
+int CompiledExpr::compileUpdates(const UpdateNode *head) {
+  // Collect the updates not compiled yet, compile them oldest first.
+  std::vector<const UpdateNode *> pending;
+  int next = -1;
+  for (const UpdateNode *un = head; un; un = un->next.get()) {
+    auto it = chainIds.find(un);
+    if (it != chainIds.end()) {
+      next = it->second;
+      break;
+    }
+    pending.push_back(un);
+  }
+
+  for (auto it = pending.rbegin(), ie = pending.rend(); it != ie; ++it) {
+    UpdateChain chain;
+    chain.index = compile((*it)->index);
+    chain.value = compile((*it)->value);
+    chain.next = next;
+    updateChains.push_back(chain);
+    next = chainIds[*it] = updateChains.size() - 1;
+  }
+  return next;
+}
+
+unsigned CompiledExpr::compile(const ref<Expr> &e) {
+  auto it = exprRegisters.find(e.get());
+  if (it != exprRegisters.end())
+    return it->second;
+
+  Instruction inst;
+  inst.kind = e->getKind();
+  inst.width = e->getWidth();
+  inst.operandWidth = 0;
+  inst.operands[0] = inst.operands[1] = inst.operands[2] = 0;
+  inst.immediate = 0;
+  if (inst.width > 64) {
+    valid = false;
+    return 0;
+  }
+
+  switch (inst.kind) {
+  case Expr::Constant:
+    inst.immediate = cast<ConstantExpr>(e)->getZExtValue();
+    break;
+
+  case Expr::Read: {
+    const ReadExpr *re = cast<ReadExpr>(e);
+    inst.operands[0] = compile(re->index);
+    inst.operands[1] = getArraySlot(re->updates.root);
+    inst.immediate = (uint64_t) (int64_t) compileUpdates(
+        re->updates.head.get());
+    break;
+  }
+
+  case Expr::Extract:
+    inst.operands[0] = compile(e->getKid(0));
+    inst.immediate = cast<ExtractExpr>(e)->offset;
+    break;
+
+  default:
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      inst.operands[i] = compile(e->getKid(i));
+    break;
+  }
+
+  if (!valid)
+    return 0;
+
+  if (inst.kind == Expr::Concat)
+    inst.operandWidth = e->getKid(1)->getWidth();
+  else if (e->getNumKids())
+    inst.operandWidth = e->getKid(0)->getWidth();
+
+  instructions.push_back(inst);
+  return exprRegisters[e.get()] = instructions.size() - 1;
+}
+
+template <unsigned Lanes>
+unsigned CompiledExpr::execute(const Assignment *const *batch, unsigned n,
+                               uint64_t *regs) const {
+  // Lanes past `n` run with unbound arrays, their results are ignored.
+  for (unsigned i = 0, e = arrays.size(); i != e; ++i) {
+    for (unsigned j = 0; j != Lanes; ++j) {
+      auto &binding = bindings[i * BatchSize + j];
+      binding = std::make_pair(nullptr, 0);
+      if (j >= n)
+        continue;
+      auto it = batch[j]->bindings.find(arrays[i]);
+      if (it != batch[j]->bindings.end())
+        binding = std::make_pair(it->second.data(), it->second.size());
+    }
+  }
+
+  // Each register holds one value per lane, lanes are innermost so the
+  // loops below operate on contiguous vectors.
+  unsigned faults = 0;
+  for (unsigned i = 0, e = instructions.size(); i != e; ++i) {
+    const Instruction &inst = instructions[i];
+    const uint64_t mask = getMask(inst.width);
+    const uint64_t *l = regs + inst.operands[0] * Lanes;
+    const uint64_t *r = regs + inst.operands[1] * Lanes;
+    uint64_t *res = regs + i * Lanes;
+
+    switch (inst.kind) {
+    case Expr::Constant:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = inst.immediate;
+      break;
+    case Expr::NotOptimized:
+    case Expr::ZExt:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j];
+      break;
+
+    case Expr::Read: {
+      // Same order as ExprEvaluator::evalRead, and Assignment::evaluate
+      // without free values for the initial contents.
+      const Array *array = arrays[inst.operands[1]];
+      for (unsigned j = 0; j != Lanes; ++j) {
+        uint64_t index = l[j];
+        int chain = (int) (int64_t) inst.immediate;
+        while (chain >= 0 &&
+               regs[updateChains[chain].index * Lanes + j] != index)
+          chain = updateChains[chain].next;
+        if (chain >= 0) {
+          res[j] = regs[updateChains[chain].value * Lanes + j];
+        } else if (array->isConstantArray() && index < array->size) {
+          res[j] = array->constantValues[index]->getZExtValue();
+        } else {
+          const auto &binding = bindings[inst.operands[1] * BatchSize + j];
+          res[j] = index < binding.second ? binding.first[index] & mask : 0;
+        }
+      }
+      break;
+    }
+
+    case Expr::Select: {
+      const uint64_t *f = regs + inst.operands[2] * Lanes;
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] ? r[j] : f[j];
+      break;
+    }
+    case Expr::Concat:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = (l[j] << inst.operandWidth) | r[j];
+      break;
+    case Expr::Extract:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = (l[j] >> inst.immediate) & mask;
+      break;
+    case Expr::SExt:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = signExtend(l[j], inst.operandWidth) & mask;
+      break;
+    case Expr::Not:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = ~l[j] & mask;
+      break;
+
+    case Expr::Add:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = (l[j] + r[j]) & mask;
+      break;
+    case Expr::Sub:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = (l[j] - r[j]) & mask;
+      break;
+    case Expr::Mul:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = (l[j] * r[j]) & mask;
+      break;
+    case Expr::UDiv:
+    case Expr::URem:
+    case Expr::SDiv:
+    case Expr::SRem:
+      for (unsigned j = 0; j != Lanes; ++j) {
+        if (!r[j]) {
+          faults |= 1u << j;
+          res[j] = 0;
+          continue;
+        }
+        if (inst.kind == Expr::UDiv) {
+          res[j] = l[j] / r[j];
+        } else if (inst.kind == Expr::URem) {
+          res[j] = l[j] % r[j];
+        } else {
+          int64_t sl = signExtend(l[j], inst.width);
+          int64_t sr = signExtend(r[j], inst.width);
+          // INT64_MIN / -1 overflows, APInt wraps around.
+          if (sr == -1)
+            res[j] = inst.kind == Expr::SDiv ? -l[j] & mask : 0;
+          else
+            res[j] = (inst.kind == Expr::SDiv ? sl / sr : sl % sr) & mask;
+        }
+      }
+      break;
+
+    case Expr::And:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] & r[j];
+      break;
+    case Expr::Or:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] | r[j];
+      break;
+    case Expr::Xor:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] ^ r[j];
+      break;
+    case Expr::Shl:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = r[j] >= inst.width ? 0 : (l[j] << r[j]) & mask;
+      break;
+    case Expr::LShr:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = r[j] >= inst.width ? 0 : l[j] >> r[j];
+      break;
+    case Expr::AShr:
+      for (unsigned j = 0; j != Lanes; ++j) {
+        int64_t sl = signExtend(l[j], inst.width);
+        res[j] = (r[j] >= inst.width ? sl >> (inst.width - 1) : sl >> r[j]) &
+                 mask;
+      }
+      break;
+
+    case Expr::Eq:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] == r[j];
+      break;
+    case Expr::Ne:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] != r[j];
+      break;
+    case Expr::Ult:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] < r[j];
+      break;
+    case Expr::Ule:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] <= r[j];
+      break;
+    case Expr::Ugt:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] > r[j];
+      break;
+    case Expr::Uge:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = l[j] >= r[j];
+      break;
+    case Expr::Slt:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = signExtend(l[j], inst.operandWidth) <
+                 signExtend(r[j], inst.operandWidth);
+      break;
+    case Expr::Sle:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = signExtend(l[j], inst.operandWidth) <=
+                 signExtend(r[j], inst.operandWidth);
+      break;
+    case Expr::Sgt:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = signExtend(l[j], inst.operandWidth) >
+                 signExtend(r[j], inst.operandWidth);
+      break;
+    case Expr::Sge:
+      for (unsigned j = 0; j != Lanes; ++j)
+        res[j] = signExtend(l[j], inst.operandWidth) >=
+                 signExtend(r[j], inst.operandWidth);
+      break;
+
+    default:
+      assert(0 && "invalid expression kind");
+      return ~0u;
+    }
+  }
+  return faults & ((1u << n) - 1);
+}
+
+bool CompiledExpr::run(const Assignment &a) const {
+  const Assignment *batch = &a;
+  return !execute<1>(&batch, 1, registers.data());
+}
+
+bool CompiledExpr::evaluate(const Assignment &a, values_ty &values) const {
+  if (!valid || a.allowFreeValues || !run(a))
+    return false;
+  values.resize(rootRegisters.size());
+  for (unsigned i = 0, n = rootRegisters.size(); i != n; ++i)
+    values[i] = registers[rootRegisters[i]];
+  return true;
+}
+
+bool CompiledExpr::isSatisfiedBy(Assignment &a) const {
+  if (!valid || a.allowFreeValues || !run(a))
+    return a.satisfies(roots.begin(), roots.end());
+  for (unsigned reg : rootRegisters)
+    if (!registers[reg])
+      return false;
+  return true;
+}
+
+int CompiledExpr::findSatisfyingInBatch(Assignment *const *batch,
+                                        unsigned n) const {
+  assert(n <= BatchSize);
+  unsigned faults = ~0u;
+  if (valid) {
+    batchRegisters.resize(instructions.size() * BatchSize);
+    faults = execute<BatchSize>(batch, n, batchRegisters.data());
+  }
+
+  for (unsigned j = 0; j != n; ++j) {
+    if ((faults >> j & 1) || batch[j]->allowFreeValues) {
+      if (isSatisfiedBy(*batch[j]))
+        return j;
+      continue;
+    }
+    bool satisfied = true;
+    for (unsigned reg : rootRegisters)
+      satisfied &= batchRegisters[reg * BatchSize + j] != 0;
+    if (satisfied)
+      return j;
+  }
+  return -1;
+}
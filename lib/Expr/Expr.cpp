@@ -9,6 +9,7 @@
 
 #include "klee/Expr/Expr.h"
 
+#include "klee/ADT/InternTable.h"
 #include "klee/Config/Version.h"
 #include "klee/Expr/ExprPPrinter.h"
 #include "klee/Support/OptionCategories.h"
@@ -41,7 +42,134 @@ cl::opt<bool> ConstArrayOpt(
 
 /***/
 
-unsigned Expr::count = 0;
+std::atomic<unsigned> Expr::count(0);
+
+namespace klee {
+struct ExprCacheTraits {
+  static Expr *&link(Expr &e) { return e.nextCached; }
+  static unsigned hash(const Expr &e) { return e.hashValue; }
+
+  /// Kids are cached, so comparing them by identity suffices.
+  static bool isEqual(const Expr &a, const Expr &b) {
+    if (a.getKind() != b.getKind() || a.getWidth() != b.getWidth())
+      return false;
+    unsigned n = a.getNumKids();
+    for (unsigned i = 0; i != n; ++i)
+      if (a.getKid(i).get() != b.getKid(i).get())
+        return false;
+    return a.compare(b) == 0;
+  }
+};
+}
+
+namespace {
+typedef InternTable<Expr, ExprCacheTraits> ExprCache;
+
+/// Never destroyed, since expressions held by static objects may outlive
+/// any static cache.
+ExprCache &getExprCache() {
+  static ExprCache *cache = new ExprCache();
+  return *cache;
+}
+}
+
+namespace {
+/// Free lists of expression nodes, one per thread and size class. Nodes
+/// freed by another thread than the one which allocated them simply move
+/// over to that thread's lists.
+class ExprNodePool {
+  static const size_t Granularity = 16;
+  static const unsigned NumClasses = 16;
+  /// Bounds the memory kept back per size class.
+  static const unsigned MaxFree = 1 << 14;
+
+  struct FreeNode {
+    FreeNode *next;
+  };
+
+  struct Lists {
+    FreeNode *head[NumClasses];
+    unsigned size[NumClasses];
+    bool destroyed;
+  };
+
+  /// Trivially destructible, so that it remains usable by nodes destroyed
+  /// after the releaser below, e.g. by destructors of static objects.
+  static thread_local Lists lists;
+
+  struct Releaser {
+    ~Releaser() {
+      for (unsigned i = 0; i < NumClasses; ++i) {
+        while (FreeNode *node = lists.head[i]) {
+          lists.head[i] = node->next;
+          ::operator delete(node);
+        }
+        lists.size[i] = 0;
+      }
+      lists.destroyed = true;
+    }
+  };
+
+  static thread_local Releaser releaser;
+
+  static unsigned getClass(size_t size) {
+    return (size + Granularity - 1) / Granularity - 1;
+  }
+
+public:
+  static void *allocate(size_t size) {
+    unsigned c = getClass(size);
+    if (c >= NumClasses)
+      return ::operator new(size);
+    if (FreeNode *node = lists.head[c]) {
+      lists.head[c] = node->next;
+      --lists.size[c];
+      return node;
+    }
+    // Make sure the lists are released when the thread exits.
+    (void) &releaser;
+    return ::operator new((c + 1) * Granularity);
+  }
+
+  static void deallocate(void *p, size_t size) {
+    unsigned c = getClass(size);
+    if (c >= NumClasses || lists.destroyed || lists.size[c] >= MaxFree) {
+      ::operator delete(p);
+      return;
+    }
+    FreeNode *node = static_cast<FreeNode *>(p);
+    node->next = lists.head[c];
+    lists.head[c] = node;
+    ++lists.size[c];
+  }
+};
+
+thread_local ExprNodePool::Lists ExprNodePool::lists;
+thread_local ExprNodePool::Releaser ExprNodePool::releaser;
+}
+
+void *Expr::operator new(size_t size) {
+  return ExprNodePool::allocate(size);
+}
+
+void Expr::operator delete(void *p, size_t size) {
+  ExprNodePool::deallocate(p, size);
+}
+
+Expr::~Expr() {
+  // Only the hash is used here, kids of derived classes are gone already.
+  if (isCached)
+    getExprCache().remove(this);
+  Expr::count--;
+}
+
+ref<Expr> Expr::createCachedExpr(ref<Expr> e) {
+  assert(!e->isCached && "expression cached twice");
+  ref<Expr> res = getExprCache().lookupOrInsert(e.get());
+  if (res.get() == e.get())
+    e->isCached = true;
+  return res;
+}
 
 ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
   UpdateList ul(array, 0);
@@ -90,26 +218,10 @@ ref<Expr> Expr::createTempRead(const Array *array, Expr::Width w) {
 }
 
 int Expr::compare(const Expr &b) const {
-  static ExprEquivSet equivs;
-  int r = compare(b, equivs);
-  equivs.clear();
-  return r;
-}
-
-// returns 0 if b is structurally equal to *this
-int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
+  // Structurally equivalent expressions are cached as the same object, so
+  // this only needs to descend into the first pair of differing kids.
   if (this == &b) return 0;
 
-  const Expr *ap, *bp;
-  if (this < &b) {
-    ap = this; bp = &b;
-  } else {
-    ap = &b; bp = this;
-  }
-
-  if (equivs.count(std::make_pair(ap, bp)))
-    return 0;
-
   Kind ak = getKind(), bk = b.getKind();
   if (ak!=bk)
     return (ak < bk) ? -1 : 1;
@@ -122,10 +234,9 @@ int Expr::compare(const Expr &b, ExprEquivSet &equivs) const {
 
   unsigned aN = getNumKids();
   for (unsigned i=0; i<aN; i++)
-    if (int res = getKid(i)->compare(*b.getKid(i), equivs))
+    if (int res = getKid(i)->compare(*b.getKid(i)))
       return res;
 
-  equivs.insert(std::make_pair(ap, bp));
   return 0;
 }
 
@@ -331,6 +442,43 @@ void Expr::dump() const {
 
 /***/
 
+namespace {
+/// Preallocated constants, see ConstantExpr::getSmallConstant(). Never
+/// destroyed, like the expression cache itself.
+struct SmallConstantTable {
+  std::vector<ref<ConstantExpr> > constants[5];
+
+  template <class Alloc> SmallConstantTable(unsigned n, Alloc alloc) {
+    constants[0] = {alloc(0, Expr::Bool), alloc(1, Expr::Bool)};
+    const Expr::Width widths[] = {Expr::Int8, Expr::Int16, Expr::Int32,
+                                  Expr::Int64};
+    for (unsigned i = 0; i < 4; ++i)
+      for (unsigned v = 0; v < n; ++v)
+        constants[i + 1].push_back(alloc(v, widths[i]));
+  }
+};
+}
+
+ConstantExpr *ConstantExpr::getSmallConstant(uint64_t v, Width w) {
+  unsigned widthClass;
+  switch (w) {
+  case Expr::Bool: widthClass = 0; break;
+  case Expr::Int8: widthClass = 1; break;
+  case Expr::Int16: widthClass = 2; break;
+  case Expr::Int32: widthClass = 3; break;
+  case Expr::Int64: widthClass = 4; break;
+  default: return nullptr;
+  }
+
+  static SmallConstantTable *table = new SmallConstantTable(
+      NumSmallConstants, [](uint64_t v, Width w) {
+        return allocNode(llvm::APInt(w, v));
+      });
+  const std::vector<ref<ConstantExpr> > &constants =
+      table->constants[widthClass];
+  return v < constants.size() ? constants[v].get() : nullptr;
+}
+
 ref<Expr> ConstantExpr::fromMemory(void *address, Width width) {
   switch (width) {
   case  Expr::Bool: return ConstantExpr::create(*(( uint8_t*) address), width);
@@ -539,7 +687,12 @@ ref<Expr> ReadExpr::create(const UpdateList &ul, ref<Expr> index) {
   // array element has been updated
   auto un = ul.head.get();
   bool updateListHasSymbolicWrites = false;
+  const ConstantExpr *concreteIndex = dyn_cast<ConstantExpr>(index);
   for (; un; un = un->next.get()) {
+    // Skip writes to other concrete indices in bulk.
+    if (concreteIndex &&
+        !(un = UpdateNode::findUpdate(un, concreteIndex->getZExtValue())))
+      break;
     ref<Expr> cond = EqExpr::create(index, un->index);
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(cond)) {
       if (CE->isTrue())
@@ -638,6 +791,63 @@ ref<Expr> ConcatExpr::create(const ref<Expr> &l, const ref<Expr> &r) {
   return ConcatExpr::alloc(l, r);
 }
 
+/// Whether \arg index is \arg base + \arg offset, in the forms AddExpr::create
+/// leaves the indices of consecutive bytes in.
+static bool isIndexAtOffset(const ref<Expr> &index, const ref<Expr> &base,
+                            uint64_t offset) {
+  Expr::Width w = index->getWidth();
+  if (base->getWidth() != w || w > Expr::Int64)
+    return false;
+  uint64_t mask = w == Expr::Int64 ? ~0ULL : (1ULL << w) - 1;
+
+  if (const ConstantExpr *ci = dyn_cast<ConstantExpr>(index)) {
+    const ConstantExpr *cb = dyn_cast<ConstantExpr>(base);
+    return cb && ci->getZExtValue() == ((cb->getZExtValue() + offset) & mask);
+  }
+
+  // c + x, at x or at c' + x
+  const AddExpr *ai = dyn_cast<AddExpr>(index);
+  if (!ai)
+    return false;
+  const ConstantExpr *ci = dyn_cast<ConstantExpr>(ai->left);
+  if (!ci)
+    return false;
+  if (ai->right.get() == base.get())
+    return ci->getZExtValue() == (offset & mask);
+  const AddExpr *ab = dyn_cast<AddExpr>(base);
+  if (!ab || ab->right.get() != ai->right.get())
+    return false;
+  const ConstantExpr *cb = dyn_cast<ConstantExpr>(ab->left);
+  return cb && ci->getZExtValue() == ((cb->getZExtValue() + offset) & mask);
+}
+
+const ReadExpr *ConcatExpr::findWideReadBase(const ref<Expr> &l,
+                                             const ref<Expr> &r) {
+  const ReadExpr *high = dyn_cast<ReadExpr>(l);
+  if (!high || high->getWidth() != Expr::Int8)
+    return nullptr;
+
+  const ReadExpr *base;
+  unsigned bytes;
+  if (const ReadExpr *re = dyn_cast<ReadExpr>(r)) {
+    base = re;
+    bytes = 1;
+  } else if (const ConcatExpr *ce = dyn_cast<ConcatExpr>(r)) {
+    base = ce->wideReadBase;
+    bytes = ce->width / 8;
+  } else {
+    return nullptr;
+  }
+
+  // The bytes of one load share the update list of the object state.
+  if (!base || base->getWidth() != Expr::Int8 ||
+      high->updates.root != base->updates.root ||
+      high->updates.head.get() != base->updates.head.get() ||
+      !isIndexAtOffset(high->index, base->index, bytes))
+    return nullptr;
+  return base;
+}
+
 /// Shortcut to concat N kids.  The chain returned is unbalanced to the right
 ref<Expr> ConcatExpr::createN(unsigned n_kids, const ref<Expr> kids[]) {
   assert(n_kids > 0);
@@ -13,7 +13,9 @@ using namespace klee;
 
 ExprVisitor::Action ExprEvaluator::evalRead(const UpdateList &ul,
                                             unsigned index) {
-  for (auto un = ul.head; !un.isNull(); un = un->next) {
+  // Writes to other concrete indices can be skipped without evaluation.
+  for (UpdateNode *un = UpdateNode::findUpdate(ul.head.get(), index); un;
+       un = UpdateNode::findUpdate(un->next.get(), index)) {
     ref<Expr> ui = visit(un->index);
     
     if (ConstantExpr *CE = dyn_cast<ConstantExpr>(ui)) {
@@ -67,6 +69,24 @@ ExprVisitor::Action ExprEvaluator::visitRead(const ReadExpr &re) {
   }
 }
 
+ExprVisitor::Action ExprEvaluator::visitConcat(const ConcatExpr &ce) {
+  // Evaluate the index of a wide read once, instead of once per byte.
+  const ReadExpr *base = ce.getWideReadBase();
+  if (!base)
+    return Action::doChildren();
+  ref<Expr> v = visit(base->index);
+  ConstantExpr *CE = dyn_cast<ConstantExpr>(v);
+  if (!CE)
+    return Action::doChildren();
+
+  unsigned index = CE->getZExtValue();
+  ref<Expr> result = evalRead(base->updates, index).argument;
+  for (unsigned i = 1, n = ce.getWidth() / 8; i != n; ++i)
+    result = ConcatExpr::create(evalRead(base->updates, index + i).argument,
+                                result);
+  return Action::changeTo(result);
+}
+
 // we need to check for div by zero during partial evaluation,
 // if this occurs then simply ignore the 0 divisor and use the
 // original expression.
@@ -0,0 +1,448 @@
+//===-- ExprRewriter.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/ExprRewriter.h"
+
+#include "klee/Expr/ExprPatternMatch.h"
+
+#include <cassert>
+#include <vector>
+
+using namespace klee;
+using namespace klee::PatternMatch;
+
+namespace {
+
+/// A rule rewrites the root of an expression whose kids are already
+/// rewritten. It returns false if it does not apply.
+typedef bool (*RewriteFn)(const ref<Expr> &e, ref<Expr> &result);
+
+struct RewriteRule {
+  Expr::Kind kind;
+  RewriteFn apply;
+};
+
+#define RULE(_name) static bool _name(const ref<Expr> &e, ref<Expr> &result)
+
+ref<Expr> zero(Expr::Width w) { return ConstantExpr::create(0, w); }
+
+ref<Expr> createBinary(Expr::Kind kind, const ref<Expr> &l,
+                       const ref<Expr> &r) {
+  switch (kind) {
+  case Expr::Add: return AddExpr::create(l, r);
+  case Expr::Sub: return SubExpr::create(l, r);
+  case Expr::Mul: return MulExpr::create(l, r);
+  case Expr::And: return AndExpr::create(l, r);
+  case Expr::Or: return OrExpr::create(l, r);
+  case Expr::Xor: return XorExpr::create(l, r);
+  case Expr::Eq: return EqExpr::create(l, r);
+  case Expr::Ult: return UltExpr::create(l, r);
+  case Expr::Ule: return UleExpr::create(l, r);
+  case Expr::Slt: return SltExpr::create(l, r);
+  case Expr::Sle: return SleExpr::create(l, r);
+  default:
+    assert(0 && "unexpected kind");
+    return l;
+  }
+}
+
+/// Whether the constant fits into `w` bits when zero extended.
+bool fitsIn(const ref<ConstantExpr> &c, Expr::Width w) {
+  return c->getAPValue().getActiveBits() <= w;
+}
+
+/***/
+// Extracts
+
+// extract(extract(x, o1), o2) -> extract(x, o1 + o2)
+RULE(extractOfExtract) {
+  ref<Expr> x;
+  unsigned inner, outer;
+  if (!match(e, m_Extract(m_Extract(m_Expr(x), inner), outer)))
+    return false;
+  result = ExtractExpr::create(x, inner + outer, e->getWidth());
+  return true;
+}
+
+// extract(zext(x), o) -> extract(x, o), zext(extract(x, o)) or 0
+RULE(extractOfZExt) {
+  ref<Expr> x;
+  unsigned offset;
+  if (!match(e, m_Extract(m_ZExt(m_Expr(x)), offset)))
+    return false;
+  Expr::Width w = e->getWidth(), xw = x->getWidth();
+  if (offset >= xw)
+    result = zero(w);
+  else if (offset + w <= xw)
+    result = ExtractExpr::create(x, offset, w);
+  else
+    result = ZExtExpr::create(ExtractExpr::create(x, offset, xw - offset), w);
+  return true;
+}
+
+// extract(sext(x), o) -> extract(x, o) or sext(extract(x, o))
+RULE(extractOfSExt) {
+  ref<Expr> x;
+  unsigned offset;
+  if (!match(e, m_Extract(m_SExt(m_Expr(x)), offset)))
+    return false;
+  Expr::Width w = e->getWidth(), xw = x->getWidth();
+  if (offset + w <= xw)
+    result = ExtractExpr::create(x, offset, w);
+  else if (offset < xw)
+    result = SExtExpr::create(ExtractExpr::create(x, offset, xw - offset), w);
+  else // Only copies of the sign bit.
+    result = SExtExpr::create(ExtractExpr::create(x, xw - 1, 1), w);
+  return true;
+}
+
+// extract(x op c, o) -> extract(x, o) op extract(c, o), for bitwise ops.
+// And and Or keep their constant on the right, Xor on the left.
+template <Expr::Kind K> RULE(extractOfBitwise) {
+  ref<ConstantExpr> c;
+  ref<Expr> x;
+  unsigned offset;
+  if (!match(e, m_Extract(BinaryMatcher<K, ExprBinder, ConstantBinder>{
+                              m_Expr(x), m_Constant(c)},
+                          offset)) &&
+      !match(e, m_Extract(BinaryMatcher<K, ConstantBinder, ExprBinder>{
+                              m_Constant(c), m_Expr(x)},
+                          offset)))
+    return false;
+  Expr::Width w = e->getWidth();
+  result = createBinary(K, ExtractExpr::create(x, offset, w),
+                        c->Extract(offset, w));
+  return true;
+}
+
+// extract(c op x, 0) -> extract(c, 0) op extract(x, 0), for + - *
+template <Expr::Kind K> RULE(extractOfArith) {
+  ref<ConstantExpr> c;
+  ref<Expr> x;
+  unsigned offset;
+  if (!match(e, m_Extract(BinaryMatcher<K, ConstantBinder, ExprBinder>{
+                              m_Constant(c), m_Expr(x)},
+                          offset)) ||
+      offset != 0)
+    return false;
+  Expr::Width w = e->getWidth();
+  result = createBinary(K, c->Extract(0, w), ExtractExpr::create(x, 0, w));
+  return true;
+}
+
+/***/
+// Casts
+
+// zext(zext(x)) -> zext(x)
+RULE(zextOfZExt) {
+  ref<Expr> x;
+  if (!match(e, m_ZExt(m_ZExt(m_Expr(x)))))
+    return false;
+  result = ZExtExpr::create(x, e->getWidth());
+  return true;
+}
+
+// sext(sext(x)) -> sext(x)
+RULE(sextOfSExt) {
+  ref<Expr> x;
+  if (!match(e, m_SExt(m_SExt(m_Expr(x)))))
+    return false;
+  result = SExtExpr::create(x, e->getWidth());
+  return true;
+}
+
+// sext(zext(x)) -> zext(x), the zero extension clears the sign bit
+RULE(sextOfZExt) {
+  ref<Expr> x;
+  if (!match(e, m_SExt(m_ZExt(m_Expr(x)))))
+    return false;
+  result = ZExtExpr::create(x, e->getWidth());
+  return true;
+}
+
+/***/
+// Concatenations
+
+// concat(0, x) -> zext(x)
+RULE(concatOfZero) {
+  ref<Expr> x;
+  if (!match(e, m_Concat(m_Zero(), m_Expr(x))))
+    return false;
+  result = ZExtExpr::create(x, e->getWidth());
+  return true;
+}
+
+// concat(concat(a, b), c) -> concat(a, concat(b, c)), the shape createN
+// builds, so that neighbouring extracts end up next to each other
+RULE(concatRightLeaning) {
+  ref<Expr> a, b, c;
+  if (!match(e, m_Concat(m_Concat(m_Expr(a), m_Expr(b)), m_Expr(c))))
+    return false;
+  result = ConcatExpr::create(a, ConcatExpr::create(b, c));
+  return true;
+}
+
+// concat(extract(x, o + w), concat(extract(x, o), r))
+//   -> concat(extract(x, o), r) with the extracts merged
+RULE(concatOfAdjacentExtracts) {
+  ref<Expr> x, hi, lo, rest;
+  unsigned hiOffset, loOffset;
+  if (!match(e, m_Concat(m_Expr(hi),
+                         m_Concat(m_Expr(lo), m_Expr(rest)))) ||
+      !match(hi, m_Extract(m_Expr(x), hiOffset)) ||
+      !match(lo, m_Extract(m_Specific(x), loOffset)) ||
+      loOffset + lo->getWidth() != hiOffset)
+    return false;
+  result = ConcatExpr::create(
+      ExtractExpr::create(x, loOffset, hi->getWidth() + lo->getWidth()),
+      rest);
+  return true;
+}
+
+/***/
+// Comparisons
+
+// zext(x) cmp zext(y) -> x cmp y, for unsigned comparisons and equality
+template <Expr::Kind K> RULE(cmpOfZExts) {
+  ref<Expr> x, y;
+  if (!match(e, BinaryMatcher<K, UnaryMatcher<Expr::ZExt, ExprBinder>,
+                              UnaryMatcher<Expr::ZExt, ExprBinder> >{
+                    m_ZExt(m_Expr(x)), m_ZExt(m_Expr(y))}) ||
+      x->getWidth() != y->getWidth())
+    return false;
+  // Zero extended values are non-negative, signed order is unsigned order.
+  Expr::Kind kind =
+      K == Expr::Slt ? Expr::Ult : K == Expr::Sle ? Expr::Ule : K;
+  result = createBinary(kind, x, y);
+  return true;
+}
+
+// sext(x) cmp sext(y) -> x cmp y, for signed comparisons and equality
+template <Expr::Kind K> RULE(cmpOfSExts) {
+  ref<Expr> x, y;
+  if (!match(e, BinaryMatcher<K, UnaryMatcher<Expr::SExt, ExprBinder>,
+                              UnaryMatcher<Expr::SExt, ExprBinder> >{
+                    m_SExt(m_Expr(x)), m_SExt(m_Expr(y))}) ||
+      x->getWidth() != y->getWidth())
+    return false;
+  result = createBinary(K, x, y);
+  return true;
+}
+
+// zext(x) < c, zext(x) <= c, c < zext(x), c <= zext(x) -> compare x to
+// the truncated constant, or a constant if c is out of the range of x
+template <Expr::Kind K> RULE(unsignedCmpOfZExtAndConstant) {
+  ref<Expr> x;
+  ref<ConstantExpr> c;
+  if (match(e, BinaryMatcher<K, UnaryMatcher<Expr::ZExt, ExprBinder>,
+                             ConstantBinder>{m_ZExt(m_Expr(x)),
+                                             m_Constant(c)})) {
+    if (!fitsIn(c, x->getWidth()))
+      result = ConstantExpr::create(1, Expr::Bool);
+    else
+      result = createBinary(K, x, c->ZExt(x->getWidth()));
+    return true;
+  }
+  if (match(e, BinaryMatcher<K, ConstantBinder,
+                             UnaryMatcher<Expr::ZExt, ExprBinder> >{
+                   m_Constant(c), m_ZExt(m_Expr(x))})) {
+    if (!fitsIn(c, x->getWidth()))
+      result = ConstantExpr::create(0, Expr::Bool);
+    else
+      result = createBinary(K, c->ZExt(x->getWidth()), x);
+    return true;
+  }
+  return false;
+}
+
+// x < x, x <= x
+template <Expr::Kind K> RULE(cmpOfSame) {
+  if (e->getKid(0).get() != e->getKid(1).get())
+    return false;
+  result = ConstantExpr::create(K == Expr::Ule || K == Expr::Sle, Expr::Bool);
+  return true;
+}
+
+// x < 0 -> false, x < 1 -> x == 0, 0 < x -> x != 0, max < x -> false
+RULE(ultBounds) {
+  ref<Expr> x;
+  ref<ConstantExpr> c;
+  if (match(e, m_Ult(m_Expr(x), m_Constant(c)))) {
+    if (c->isZero())
+      result = ConstantExpr::create(0, Expr::Bool);
+    else if (c->isOne())
+      result = EqExpr::create(zero(x->getWidth()), x);
+    else
+      return false;
+    return true;
+  }
+  if (match(e, m_Ult(m_Constant(c), m_Expr(x)))) {
+    if (c->isZero())
+      result = Expr::createIsZero(EqExpr::create(c, x));
+    else if (c->isAllOnes())
+      result = ConstantExpr::create(0, Expr::Bool);
+    else
+      return false;
+    return true;
+  }
+  return false;
+}
+
+// x <= 0 -> x == 0, 0 <= x -> true, x <= max -> true
+RULE(uleBounds) {
+  ref<Expr> x;
+  ref<ConstantExpr> c;
+  if (match(e, m_Ule(m_Expr(x), m_Constant(c)))) {
+    if (c->isZero())
+      result = EqExpr::create(c, x);
+    else if (c->isAllOnes())
+      result = ConstantExpr::create(1, Expr::Bool);
+    else
+      return false;
+    return true;
+  }
+  if (match(e, m_Ule(m_Zero(), m_Expr(x)))) {
+    result = ConstantExpr::create(1, Expr::Bool);
+    return true;
+  }
+  return false;
+}
+
+/***/
+// Bitwise operations
+
+// x & x -> x, x | x -> x
+template <Expr::Kind K> RULE(bitwiseOfSame) {
+  if (e->getKid(0).get() != e->getKid(1).get())
+    return false;
+  result = e->getKid(0);
+  return true;
+}
+
+// x ^ x -> 0
+RULE(xorOfSame) {
+  if (e->getKid(0).get() != e->getKid(1).get())
+    return false;
+  result = zero(e->getWidth());
+  return true;
+}
+
+// ~~x -> x
+RULE(notOfNot) {
+  ref<Expr> x;
+  if (!match(e, m_Not(m_Not(m_Expr(x)))))
+    return false;
+  result = x;
+  return true;
+}
+
+// zext(x) & c -> zext(x) if c keeps all bits of x
+RULE(andOfZExtMask) {
+  ref<ConstantExpr> c;
+  ref<Expr> x;
+  if (!match(e, m_And(m_ZExt(m_Expr(x)), m_Constant(c))) ||
+      !c->Extract(0, x->getWidth())->isAllOnes())
+    return false;
+  result = e->getKid(0);
+  return true;
+}
+
+// x << c, x >> c -> 0 if c is at least the width
+template <Expr::Kind K> RULE(overShift) {
+  ref<Expr> x;
+  ref<ConstantExpr> c;
+  if (!match(e, BinaryMatcher<K, ExprBinder, ConstantBinder>{m_Expr(x),
+                                                              m_Constant(c)}) ||
+      !c->getAPValue().uge(e->getWidth()))
+    return false;
+  result = zero(e->getWidth());
+  return true;
+}
+
+#undef RULE
+
+/// The rule table. Rules for the same kind are tried in order.
+const RewriteRule rules[] = {
+    {Expr::Extract, extractOfExtract},
+    {Expr::Extract, extractOfZExt},
+    {Expr::Extract, extractOfSExt},
+    {Expr::Extract, extractOfBitwise<Expr::And>},
+    {Expr::Extract, extractOfBitwise<Expr::Or>},
+    {Expr::Extract, extractOfBitwise<Expr::Xor>},
+    {Expr::Extract, extractOfArith<Expr::Add>},
+    {Expr::Extract, extractOfArith<Expr::Sub>},
+    {Expr::Extract, extractOfArith<Expr::Mul>},
+
+    {Expr::ZExt, zextOfZExt},
+    {Expr::SExt, sextOfSExt},
+    {Expr::SExt, sextOfZExt},
+
+    {Expr::Concat, concatOfZero},
+    {Expr::Concat, concatRightLeaning},
+    {Expr::Concat, concatOfAdjacentExtracts},
+
+    {Expr::Eq, cmpOfZExts<Expr::Eq>},
+    {Expr::Eq, cmpOfSExts<Expr::Eq>},
+    {Expr::Ult, cmpOfZExts<Expr::Ult>},
+    {Expr::Ult, unsignedCmpOfZExtAndConstant<Expr::Ult>},
+    {Expr::Ult, cmpOfSame<Expr::Ult>},
+    {Expr::Ult, ultBounds},
+    {Expr::Ule, cmpOfZExts<Expr::Ule>},
+    {Expr::Ule, unsignedCmpOfZExtAndConstant<Expr::Ule>},
+    {Expr::Ule, cmpOfSame<Expr::Ule>},
+    {Expr::Ule, uleBounds},
+    {Expr::Slt, cmpOfZExts<Expr::Slt>},
+    {Expr::Slt, cmpOfSExts<Expr::Slt>},
+    {Expr::Slt, cmpOfSame<Expr::Slt>},
+    {Expr::Sle, cmpOfZExts<Expr::Sle>},
+    {Expr::Sle, cmpOfSExts<Expr::Sle>},
+    {Expr::Sle, cmpOfSame<Expr::Sle>},
+
+    {Expr::And, bitwiseOfSame<Expr::And>},
+    {Expr::And, andOfZExtMask},
+    {Expr::Or, bitwiseOfSame<Expr::Or>},
+    {Expr::Xor, xorOfSame},
+    {Expr::Not, notOfNot},
+    {Expr::Shl, overShift<Expr::Shl>},
+    {Expr::LShr, overShift<Expr::LShr>},
+};
+
+/// The rules grouped by the kind of expression they rewrite.
+class RuleIndex {
+  std::vector<RewriteFn> byKind[Expr::LastKind + 1];
+
+public:
+  RuleIndex() {
+    for (const RewriteRule &rule : rules)
+      byKind[rule.kind].push_back(rule.apply);
+  }
+
+  const std::vector<RewriteFn> &get(Expr::Kind kind) const {
+    return byKind[kind];
+  }
+};
+} // namespace
+
+ref<Expr> ExprRewriter::rewriteRoot(const ref<Expr> &e) {
+  static const RuleIndex index;
+  ref<Expr> result;
+  for (RewriteFn apply : index.get(e->getKind()))
+    if (apply(e, result))
+      return result;
+  return e;
+}
+
+ExprVisitor::Action ExprRewriter::visitExprPost(const Expr &e) {
+  ref<Expr> expr(const_cast<Expr *>(&e));
+  ref<Expr> result = rewriteRoot(expr);
+  if (result.get() == expr.get())
+    return Action::skipChildren();
+  // The result may be rewritable again, at the root or below.
+  return Action::changeTo(visit(result));
+}
@@ -23,105 +23,153 @@ llvm::cl::opt<bool> UseVisitorHash(
 
 using namespace klee;
 
-ref<Expr> ExprVisitor::visit(const ref<Expr> &e) {
-  if (!UseVisitorHash || isa<ConstantExpr>(e)) {
-    return visitActual(e);
-  } else {
-    visited_ty::iterator it = visited.find(e);
-
-    if (it!=visited.end()) {
-      return it->second;
-    } else {
-      ref<Expr> res = visitActual(e);
-      visited.insert(std::make_pair(e, res));
-      return res;
-    }
+bool ExprVisitor::lookup(const ref<Expr> &e, ref<Expr> &result) const {
+  if (isa<ConstantExpr>(e)) {
+    result = e;
+    return true;
+  }
+  if (!UseVisitorHash)
+    return false;
+  visited_ty::const_iterator it = visited.find(e);
+  if (it == visited.end())
+    return false;
+  result = it->second;
+  return true;
+}
+
+ExprVisitor::Action ExprVisitor::visitKind(const Expr &ep) {
+  switch(ep.getKind()) {
+  case Expr::NotOptimized: return visitNotOptimized(static_cast<const NotOptimizedExpr&>(ep));
+  case Expr::Read: return visitRead(static_cast<const ReadExpr&>(ep));
+  case Expr::Select: return visitSelect(static_cast<const SelectExpr&>(ep));
+  case Expr::Concat: return visitConcat(static_cast<const ConcatExpr&>(ep));
+  case Expr::Extract: return visitExtract(static_cast<const ExtractExpr&>(ep));
+  case Expr::ZExt: return visitZExt(static_cast<const ZExtExpr&>(ep));
+  case Expr::SExt: return visitSExt(static_cast<const SExtExpr&>(ep));
+  case Expr::Add: return visitAdd(static_cast<const AddExpr&>(ep));
+  case Expr::Sub: return visitSub(static_cast<const SubExpr&>(ep));
+  case Expr::Mul: return visitMul(static_cast<const MulExpr&>(ep));
+  case Expr::UDiv: return visitUDiv(static_cast<const UDivExpr&>(ep));
+  case Expr::SDiv: return visitSDiv(static_cast<const SDivExpr&>(ep));
+  case Expr::URem: return visitURem(static_cast<const URemExpr&>(ep));
+  case Expr::SRem: return visitSRem(static_cast<const SRemExpr&>(ep));
+  case Expr::Not: return visitNot(static_cast<const NotExpr&>(ep));
+  case Expr::And: return visitAnd(static_cast<const AndExpr&>(ep));
+  case Expr::Or: return visitOr(static_cast<const OrExpr&>(ep));
+  case Expr::Xor: return visitXor(static_cast<const XorExpr&>(ep));
+  case Expr::Shl: return visitShl(static_cast<const ShlExpr&>(ep));
+  case Expr::LShr: return visitLShr(static_cast<const LShrExpr&>(ep));
+  case Expr::AShr: return visitAShr(static_cast<const AShrExpr&>(ep));
+  case Expr::Eq: return visitEq(static_cast<const EqExpr&>(ep));
+  case Expr::Ne: return visitNe(static_cast<const NeExpr&>(ep));
+  case Expr::Ult: return visitUlt(static_cast<const UltExpr&>(ep));
+  case Expr::Ule: return visitUle(static_cast<const UleExpr&>(ep));
+  case Expr::Ugt: return visitUgt(static_cast<const UgtExpr&>(ep));
+  case Expr::Uge: return visitUge(static_cast<const UgeExpr&>(ep));
+  case Expr::Slt: return visitSlt(static_cast<const SltExpr&>(ep));
+  case Expr::Sle: return visitSle(static_cast<const SleExpr&>(ep));
+  case Expr::Sgt: return visitSgt(static_cast<const SgtExpr&>(ep));
+  case Expr::Sge: return visitSge(static_cast<const SgeExpr&>(ep));
+  case Expr::Constant:
+  default:
+    assert(0 && "invalid expression kind");
+    return Action::skipChildren();
   }
 }
 
-ref<Expr> ExprVisitor::visitActual(const ref<Expr> &e) {
-  if (isa<ConstantExpr>(e)) {    
-    return e;
-  } else {
-    Expr &ep = *e.get();
-
-    Action res = visitExpr(ep);
-    switch(res.kind) {
-    case Action::DoChildren:
-      // continue with normal action
+// The traversal keeps its own stack of frames instead of recursing, so
+// that deep expressions cannot overflow the C++ stack. Each frame stands
+// for one visit() of the original recursive formulation, and its result is
+// memoized like one. The visitor callbacks may call visit() themselves,
+// such calls push their frames above the current one and are finished
+// before returning, so frames are always accessed by index: the stack may
+// be reallocated by any callback.
+ref<Expr> ExprVisitor::visit(const ref<Expr> &e) {
+  ref<Expr> result;
+  if (lookup(e, result))
+    return result;
+
+  const size_t base = stack.size();
+  stack.emplace_back(e);
+
+  while (true) {
+    const size_t top = stack.size() - 1;
+    bool done = false;
+
+    switch (stack[top].stage) {
+    case Frame::Pre: {
+      ref<Expr> current = stack[top].e;
+      Action res = visitExpr(*current);
+      if (res.kind == Action::DoChildren)
+        res = visitKind(*current);
+      if (res.kind == Action::DoChildren) {
+        stack[top].stage = Frame::Kids;
+      } else {
+        result = res.kind == Action::ChangeTo ? res.argument : current;
+        done = true;
+      }
       break;
-    case Action::SkipChildren:
-      return e;
-    case Action::ChangeTo:
-      return res.argument;
     }
 
-    switch(ep.getKind()) {
-    case Expr::NotOptimized: res = visitNotOptimized(static_cast<NotOptimizedExpr&>(ep)); break;
-    case Expr::Read: res = visitRead(static_cast<ReadExpr&>(ep)); break;
-    case Expr::Select: res = visitSelect(static_cast<SelectExpr&>(ep)); break;
-    case Expr::Concat: res = visitConcat(static_cast<ConcatExpr&>(ep)); break;
-    case Expr::Extract: res = visitExtract(static_cast<ExtractExpr&>(ep)); break;
-    case Expr::ZExt: res = visitZExt(static_cast<ZExtExpr&>(ep)); break;
-    case Expr::SExt: res = visitSExt(static_cast<SExtExpr&>(ep)); break;
-    case Expr::Add: res = visitAdd(static_cast<AddExpr&>(ep)); break;
-    case Expr::Sub: res = visitSub(static_cast<SubExpr&>(ep)); break;
-    case Expr::Mul: res = visitMul(static_cast<MulExpr&>(ep)); break;
-    case Expr::UDiv: res = visitUDiv(static_cast<UDivExpr&>(ep)); break;
-    case Expr::SDiv: res = visitSDiv(static_cast<SDivExpr&>(ep)); break;
-    case Expr::URem: res = visitURem(static_cast<URemExpr&>(ep)); break;
-    case Expr::SRem: res = visitSRem(static_cast<SRemExpr&>(ep)); break;
-    case Expr::Not: res = visitNot(static_cast<NotExpr&>(ep)); break;
-    case Expr::And: res = visitAnd(static_cast<AndExpr&>(ep)); break;
-    case Expr::Or: res = visitOr(static_cast<OrExpr&>(ep)); break;
-    case Expr::Xor: res = visitXor(static_cast<XorExpr&>(ep)); break;
-    case Expr::Shl: res = visitShl(static_cast<ShlExpr&>(ep)); break;
-    case Expr::LShr: res = visitLShr(static_cast<LShrExpr&>(ep)); break;
-    case Expr::AShr: res = visitAShr(static_cast<AShrExpr&>(ep)); break;
-    case Expr::Eq: res = visitEq(static_cast<EqExpr&>(ep)); break;
-    case Expr::Ne: res = visitNe(static_cast<NeExpr&>(ep)); break;
-    case Expr::Ult: res = visitUlt(static_cast<UltExpr&>(ep)); break;
-    case Expr::Ule: res = visitUle(static_cast<UleExpr&>(ep)); break;
-    case Expr::Ugt: res = visitUgt(static_cast<UgtExpr&>(ep)); break;
-    case Expr::Uge: res = visitUge(static_cast<UgeExpr&>(ep)); break;
-    case Expr::Slt: res = visitSlt(static_cast<SltExpr&>(ep)); break;
-    case Expr::Sle: res = visitSle(static_cast<SleExpr&>(ep)); break;
-    case Expr::Sgt: res = visitSgt(static_cast<SgtExpr&>(ep)); break;
-    case Expr::Sge: res = visitSge(static_cast<SgeExpr&>(ep)); break;
-    case Expr::Constant:
-    default:
-      assert(0 && "invalid expression kind");
-    }
-
-    switch(res.kind) {
-    default:
-      assert(0 && "invalid kind");
-    case Action::DoChildren: {  
-      bool rebuild = false;
-      ref<Expr> e(&ep), kids[8];
-      unsigned count = ep.getNumKids();
-      for (unsigned i=0; i<count; i++) {
-        ref<Expr> kid = ep.getKid(i);
-        kids[i] = visit(kid);
-        if (kids[i] != kid)
-          rebuild = true;
+    case Frame::Kids: {
+      Frame &f = stack[top];
+      unsigned count = f.e->getNumKids();
+      while (f.nextKid < count && lookup(f.e->getKid(f.nextKid), result))
+        f.setKid(result);
+      if (f.nextKid < count) {
+        stack.emplace_back(f.e->getKid(f.nextKid));
+        break;
       }
-      if (rebuild) {
-        e = ep.rebuild(kids);
-        if (recursive)
-          e = visit(e);
+
+      f.stage = Frame::Post;
+      if (f.rebuild) {
+        ref<Expr> rebuilt = f.e->rebuild(f.kids);
+        f.current = rebuilt;
+        // Visit the rebuilt expression again, like a fresh visit() would.
+        if (recursive && !lookup(rebuilt, result)) {
+          f.stage = Frame::Rebuilt;
+          stack.emplace_back(rebuilt);
+        } else if (recursive) {
+          f.current = result;
+        }
       }
-      if (!isa<ConstantExpr>(e)) {
-        res = visitExprPost(*e.get());
-        if (res.kind==Action::ChangeTo)
-          e = res.argument;
+      break;
+    }
+
+    case Frame::Rebuilt:
+      // Only reached through a finished child frame.
+      assert(0 && "rebuilt expression not visited");
+      break;
+
+    case Frame::Post: {
+      result = stack[top].current;
+      if (!isa<ConstantExpr>(result)) {
+        Action res = visitExprPost(*result);
+        if (res.kind == Action::ChangeTo)
+          result = res.argument;
       }
-      return e;
+      done = true;
+      break;
     }
-    case Action::SkipChildren:
-      return e;
-    case Action::ChangeTo:
-      return res.argument;
+    }
+
+    if (!done)
+      continue;
+
+    // Finish the frame and hand the result to its parent.
+    if (UseVisitorHash)
+      visited.insert(std::make_pair(stack[top].e, result));
+    stack.pop_back();
+    if (stack.size() == base)
+      return result;
+
+    Frame &parent = stack.back();
+    if (parent.stage == Frame::Kids) {
+      parent.setKid(result);
+    } else {
+      assert(parent.stage == Frame::Rebuilt);
+      parent.current = result;
+      parent.stage = Frame::Post;
     }
   }
 }
@@ -9,15 +9,18 @@
 
 #include "klee/Expr/Expr.h"
 
+#include "klee/ADT/InternTable.h"
+
 #include <cassert>
+#include <unordered_map>
 
 using namespace klee;
 
 ///
 
-UpdateNode::UpdateNode(const ref<UpdateNode> &_next, const ref<Expr> &_index,
-                       const ref<Expr> &_value)
-    : next(_next), index(_index), value(_value) {
+UpdateNode::UpdateNode(const Array *_root, const ref<UpdateNode> &_next,
+                       const ref<Expr> &_index, const ref<Expr> &_value)
+    : next(_next), index(_index), value(_value), root(_root) {
   // FIXME: What we need to check here instead is that _value is of the same width 
   // as the range of the array that the update node is part of.
   /*
@@ -30,6 +33,109 @@ UpdateNode::UpdateNode(const ref<UpdateNode> &_next, const ref<Expr> &_index,
 
 extern "C" void vc_DeleteExpr(void*);
 
+namespace klee {
+struct UpdateNodeCacheTraits {
+  static UpdateNode *&link(UpdateNode &un) { return un.nextCached; }
+  static unsigned hash(const UpdateNode &un) { return un.hashValue; }
+
+  /// Tails, indices and values are cached, so comparing them by identity
+  /// suffices.
+  static bool isEqual(const UpdateNode &a, const UpdateNode &b) {
+    return a.root == b.root && a.next.get() == b.next.get() &&
+           a.index.get() == b.index.get() && a.value.get() == b.value.get();
+  }
+};
+}
+
+namespace {
+typedef InternTable<UpdateNode, UpdateNodeCacheTraits> UpdateNodeCache;
+
+/// Never destroyed, like the expression cache.
+UpdateNodeCache &getUpdateNodeCache() {
+  static UpdateNodeCache *cache = new UpdateNodeCache();
+  return *cache;
+}
+}
+
+ref<UpdateNode> UpdateNode::create(const Array *root,
+                                   const ref<UpdateNode> &next,
+                                   const ref<Expr> &index,
+                                   const ref<Expr> &value) {
+  ref<UpdateNode> un(new UpdateNode(root, next, index, value));
+  ref<UpdateNode> res = getUpdateNodeCache().lookupOrInsert(un.get());
+  if (res.get() == un.get())
+    un->isCached = true;
+  return res;
+}
+
+namespace klee {
+/// Maps the concrete indices written by a block of updates to the most
+/// recent update of the block writing to them. The block starts at the node
+/// owning the index and ends before `next`, which is either the next node
+/// carrying an index, the first update with a symbolic index, or null.
+struct ConcreteUpdateIndex {
+  std::unordered_map<uint64_t, UpdateNode *> updates;
+  UpdateNode *next;
+};
+}
+
+UpdateNode::~UpdateNode() {
+  if (isCached)
+    getUpdateNodeCache().remove(this);
+  delete concreteIndex.load(std::memory_order_relaxed);
+}
+
+const ConcreteUpdateIndex *UpdateNode::getConcreteIndex() const {
+  if (const ConcreteUpdateIndex *res =
+          concreteIndex.load(std::memory_order_acquire))
+    return res;
+
+  ConcreteUpdateIndex *res = new ConcreteUpdateIndex();
+  // Nodes are never modified, const only matters to the callers.
+  UpdateNode *un = const_cast<UpdateNode *>(this);
+  do {
+    // Walking from the most recent update, the first write to an index
+    // is the one a read sees.
+    res->updates.emplace(cast<ConstantExpr>(un->index)->getZExtValue(), un);
+    un = un->next.get();
+  } while (un && isa<ConstantExpr>(un->index) &&
+           un->size % FlattenInterval != 0);
+  res->next = un;
+
+  // Another thread may have built the same index in the meantime.
+  const ConcreteUpdateIndex *expected = nullptr;
+  if (!concreteIndex.compare_exchange_strong(expected, res,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+    delete res;
+    return expected;
+  }
+  return res;
+}
+
+UpdateNode *UpdateNode::findUpdate(const UpdateNode *start, uint64_t index) {
+  UpdateNode *un = const_cast<UpdateNode *>(start);
+  while (un) {
+    const ConstantExpr *CE = dyn_cast<ConstantExpr>(un->index);
+    if (!CE)
+      return un;
+
+    if (un->size % FlattenInterval == 0) {
+      const ConcreteUpdateIndex *ci = un->getConcreteIndex();
+      auto it = ci->updates.find(index);
+      if (it != ci->updates.end())
+        return it->second;
+      un = ci->next;
+      continue;
+    }
+
+    if (CE->getZExtValue() == index)
+      return un;
+    un = un->next.get();
+  }
+  return nullptr;
+}
+
 int UpdateNode::compare(const UpdateNode &b) const {
   if (int i = index.compare(b.index)) 
     return i;
@@ -55,22 +161,23 @@ void UpdateList::extend(const ref<Expr> &index, const ref<Expr> &value) {
     assert(root->getRange() == value->getWidth());
   }
 
-  head = new UpdateNode(head, index, value);
+  head = UpdateNode::create(root, head, index, value);
 }
 
 int UpdateList::compare(const UpdateList &b) const {
-  if (root->name != b.root->name)
-    return root->name < b.root->name ? -1 : 1;
+  if (root != b.root) {
+    if (root->name != b.root->name)
+      return root->name < b.root->name ? -1 : 1;
 
-  // Check the root itself in case we have separate objects with the
-  // same name.
-  if (root != b.root)
+    // Separate objects with the same name.
     return root < b.root ? -1 : 1;
+  }
 
   if (getSize() < b.getSize()) return -1;
   else if (getSize() > b.getSize()) return 1;    
 
-  // XXX build comparison into update, make fast
+  // Update sequences are cached, so equal lists share their head and this
+  // only walks up to the first differing update.
   const auto *an = head.get(), *bn = b.head.get();
   for (; an && bn; an = an->next.get(), bn = bn->next.get()) {
     if (an==bn) { // exploit shared list structure
@@ -9,10 +9,12 @@
 
 #include "klee/Solver/Solver.h"
 
-#include "klee/ADT/MapOfSets.h"
+#include "klee/ADT/ShardedMapOfSets.h"
 #include "klee/Expr/Assignment.h"
+#include "klee/Expr/CompiledExpr.h"
 #include "klee/Expr/Constraints.h"
 #include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprHashMap.h"
 #include "klee/Expr/ExprUtil.h"
 #include "klee/Expr/ExprVisitor.h"
 #include "klee/Support/OptionCategories.h"
@@ -23,6 +25,12 @@
 
 #include "llvm/Support/CommandLine.h"
 
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
+
 using namespace klee;
 using namespace llvm;
 
@@ -50,6 +58,12 @@ cl::opt<bool> CexCacheExperimental(
     cl::desc("Optimization for validity queries (default=false)"),
     cl::cat(SolvingCat));
 
+cl::opt<unsigned> CexCacheShards(
+    "cex-cache-shards", cl::init(16),
+    cl::desc("Number of independently locked partitions of the "
+             "counterexample cache (default=16)"),
+    cl::cat(SolvingCat));
+
 } // namespace
 
 ///
@@ -68,9 +82,13 @@ class CexCachingSolver : public SolverImpl {
 
   Solver *solver;
   
-  MapOfSets<ref<Expr>, Assignment*> cache;
-  // memo table
+  // The cache and the memo table may be accessed from several solver
+  // threads, the cache synchronises itself per shard.
+  ShardedMapOfSets<ref<Expr>, Assignment*, util::ExprHash> cache;
+  // memo table; --cex-cache-try-all scans it under a shared lock, so scans
+  // do not block each other
   assignmentsTable_ty assignmentsTable;
+  std::shared_timed_mutex assignmentsTableLock;
 
   bool searchForAssignment(KeyType &key, 
                            Assignment *&result);
@@ -85,7 +103,8 @@ class CexCachingSolver : public SolverImpl {
   bool getAssignment(const Query& query, Assignment *&result);
   
 public:
-  CexCachingSolver(Solver *_solver) : solver(_solver) {}
+  CexCachingSolver(Solver *_solver)
+    : solver(_solver), cache(std::max(1u, (unsigned) CexCacheShards)) {}
   ~CexCachingSolver();
   
   bool computeTruth(const Query&, bool &isValid);
@@ -110,13 +129,29 @@ struct NonNullAssignment {
   bool operator()(Assignment *a) const { return a!=0; }
 };
 
+/// A key compiled when it is first evaluated, so that keys found in the
+/// cache are never compiled and others only once per lookup.
+class LazyCompiledKey {
+  const KeyType &key;
+  mutable std::unique_ptr<CompiledExpr> compiled;
+
+public:
+  LazyCompiledKey(const KeyType &_key) : key(_key) {}
+
+  const CompiledExpr &get() const {
+    if (!compiled)
+      compiled.reset(new CompiledExpr(key.begin(), key.end()));
+    return *compiled;
+  }
+};
+
 struct NullOrSatisfyingAssignment {
-  KeyType &key;
+  const LazyCompiledKey &key;
   
-  NullOrSatisfyingAssignment(KeyType &_key) : key(_key) {}
+  NullOrSatisfyingAssignment(const LazyCompiledKey &_key) : key(_key) {}
 
   bool operator()(Assignment *a) const { 
-    return !a || a->satisfies(key.begin(), key.end()); 
+    return !a || key.get().isSatisfiedBy(*a);
   }
 };
 
@@ -128,61 +163,57 @@ struct NullOrSatisfyingAssignment {
 /// unsatisfiable query).
 /// \return - True if a cached result was found.
 bool CexCachingSolver::searchForAssignment(KeyType &key, Assignment *&result) {
-  Assignment * const *lookup = cache.lookup(key);
-  if (lookup) {
-    result = *lookup;
+  if (cache.lookup(key, result))
     return true;
-  }
 
+  LazyCompiledKey compiledKey(key);
   if (CexCacheTryAll) {
     // Look for a satisfying assignment for a superset, which is trivially an
     // assignment for any subset.
-    Assignment **lookup = 0;
+    bool found = false;
     if (CexCacheSuperSet)
-      lookup = cache.findSuperset(key, NonNullAssignment());
+      found = cache.findSuperset(key, NonNullAssignment(), result);
 
     // Otherwise, look for a subset which is unsatisfiable, see below.
-    if (!lookup) 
-      lookup = cache.findSubset(key, NullAssignment());
+    if (!found)
+      found = cache.findSubset(key, NullAssignment(), result);
 
     // If either lookup succeeded, then we have a cached solution.
-    if (lookup) {
-      result = *lookup;
+    if (found)
       return true;
-    }
 
     // Otherwise, iterate through the set of current assignments to see if one
     // of them satisfies the query.
-    for (assignmentsTable_ty::iterator it = assignmentsTable.begin(), 
-           ie = assignmentsTable.end(); it != ie; ++it) {
-      Assignment *a = *it;
-      if (a->satisfies(key.begin(), key.end())) {
-        result = a;
-        return true;
-      }
+    std::shared_lock<std::shared_timed_mutex> guard(assignmentsTableLock);
+    if (assignmentsTable.empty())
+      return false;
+    assignmentsTable_ty::iterator it = compiledKey.get().findSatisfying(
+        assignmentsTable.begin(), assignmentsTable.end());
+    if (it != assignmentsTable.end()) {
+      result = *it;
+      return true;
     }
   } else {
     // FIXME: Which order? one is sure to be better.
 
     // Look for a satisfying assignment for a superset, which is trivially an
     // assignment for any subset.
-    Assignment **lookup = 0;
+    bool found = false;
     if (CexCacheSuperSet)
-      lookup = cache.findSuperset(key, NonNullAssignment());
+      found = cache.findSuperset(key, NonNullAssignment(), result);
 
     // Otherwise, look for a subset which is unsatisfiable -- if the subset is
     // unsatisfiable then no additional constraints can produce a valid
     // assignment. While searching subsets, we also explicitly the solutions for
     // satisfiable subsets to see if they solve the current query and return
     // them if so. This is cheap and frequently succeeds.
-    if (!lookup) 
-      lookup = cache.findSubset(key, NullOrSatisfyingAssignment(key));
+    if (!found)
+      found = cache.findSubset(key, NullOrSatisfyingAssignment(compiledKey),
+                               result);
 
     // If either lookup succeeded, then we have a cached solution.
-    if (lookup) {
-      result = *lookup;
+    if (found)
       return true;
-    }
   }
   
   return false;
@@ -238,6 +269,7 @@ bool CexCachingSolver::getAssignment(const Query& query, Assignment *&result) {
     binding = new Assignment(objects, values);
 
     // Memoize the result.
+    std::lock_guard<std::shared_timed_mutex> guard(assignmentsTableLock);
     std::pair<assignmentsTable_ty::iterator, bool>
       res = assignmentsTable.insert(binding);
     if (!res.second) {
@@ -40,6 +40,9 @@ Solver *constructSolverChain(Solver *coreSolver,
                  baseSolverQuerySMT2LogPath.c_str());
   }
 
+  if (PredictSolverTimeouts)
+    solver = createTimeoutPredictingSolver(solver);
+
   if (UseAssignmentValidatingSolver)
     solver = createAssignmentValidatingSolver(solver);
 
@@ -55,6 +58,9 @@ Solver *constructSolverChain(Solver *coreSolver,
   if (UseIndependentSolver)
     solver = createIndependentSolver(solver);
 
+  if (RewriteQueries)
+    solver = createRewritingSolver(solver);
+
   if (DebugValidateSolver)
     solver = createValidatingSolver(solver, coreSolver);
 
@@ -804,8 +804,13 @@ public:
       const Array *array = re->updates.root;
       CexObjectData &cod = getObjectData(array);
       CexValueData index = evalRangeForExpr(re->index);
+      const ConstantExpr *concreteIndex = dyn_cast<ConstantExpr>(re->index);
 
       for (const auto *un = re->updates.head.get(); un; un = un->next.get()) {
+        // Writes to other concrete indices can't alias, skip them in bulk.
+        if (concreteIndex &&
+            !(un = UpdateNode::findUpdate(un, concreteIndex->getZExtValue())))
+          break;
         CexValueData ui = evalRangeForExpr(un->index);
 
         // If these indices can't alias, continue propogation
@@ -0,0 +1,117 @@
+//===-- RewritingSolver.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/ExprRewriter.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// Simplifies queries with the ExprRewriter before passing them on.
+class RewritingSolver : public SolverImpl {
+  /// Start over with an empty rewriter after this many queries, which
+  /// bounds the memory used for memoized rewrites.
+  static const unsigned ResetInterval = 1024;
+
+  Solver *solver;
+  /// Kept between queries, as most constraints occur in many queries.
+  std::unique_ptr<ExprRewriter> rewriter;
+  unsigned queries = 0;
+  std::mutex lock;
+
+  /// Rewrite the query, returns the expression and appends the constraints
+  /// to `constraints`.
+  ref<Expr> rewrite(const Query &query, std::vector<ref<Expr> > &constraints);
+
+public:
+  RewritingSolver(Solver *_solver)
+      : solver(_solver), rewriter(new ExprRewriter()) {}
+  ~RewritingSolver() { delete solver; }
+
+  bool computeValidity(const Query &, Solver::Validity &result);
+  bool computeTruth(const Query &, bool &isValid);
+  bool computeValue(const Query &, ref<Expr> &result);
+  bool computeInitialValues(const Query &,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution);
+  SolverRunStatus getOperationStatusCode();
+  char *getConstraintLog(const Query &);
+  void setCoreSolverTimeout(time::Span timeout);
+};
+
+ref<Expr> RewritingSolver::rewrite(const Query &query,
+                                   std::vector<ref<Expr> > &constraints) {
+  std::lock_guard<std::mutex> guard(lock);
+  if (++queries % ResetInterval == 0)
+    rewriter.reset(new ExprRewriter());
+
+  for (const auto &constraint : query.constraints) {
+    ref<Expr> e = rewriter->rewrite(constraint);
+    if (!e->isTrue())
+      constraints.push_back(e);
+  }
+  return rewriter->rewrite(query.expr);
+}
+
+bool RewritingSolver::computeValidity(const Query &query,
+                                      Solver::Validity &result) {
+  std::vector<ref<Expr> > rewritten;
+  ref<Expr> expr = rewrite(query, rewritten);
+  ConstraintManager constraints(rewritten);
+  return solver->impl->computeValidity(Query(constraints, expr), result);
+}
+
+bool RewritingSolver::computeTruth(const Query &query, bool &isValid) {
+  std::vector<ref<Expr> > rewritten;
+  ref<Expr> expr = rewrite(query, rewritten);
+  ConstraintManager constraints(rewritten);
+  return solver->impl->computeTruth(Query(constraints, expr), isValid);
+}
+
+bool RewritingSolver::computeValue(const Query &query, ref<Expr> &result) {
+  std::vector<ref<Expr> > rewritten;
+  ref<Expr> expr = rewrite(query, rewritten);
+  ConstraintManager constraints(rewritten);
+  return solver->impl->computeValue(Query(constraints, expr), result);
+}
+
+bool RewritingSolver::computeInitialValues(
+    const Query &query, const std::vector<const Array *> &objects,
+    std::vector<std::vector<unsigned char> > &values, bool &hasSolution) {
+  std::vector<ref<Expr> > rewritten;
+  ref<Expr> expr = rewrite(query, rewritten);
+  ConstraintManager constraints(rewritten);
+  return solver->impl->computeInitialValues(Query(constraints, expr), objects,
+                                            values, hasSolution);
+}
+
+SolverImpl::SolverRunStatus RewritingSolver::getOperationStatusCode() {
+  return solver->impl->getOperationStatusCode();
+}
+
+char *RewritingSolver::getConstraintLog(const Query &query) {
+  return solver->impl->getConstraintLog(query);
+}
+
+void RewritingSolver::setCoreSolverTimeout(time::Span timeout) {
+  solver->impl->setCoreSolverTimeout(timeout);
+}
+} // namespace
+
+Solver *klee::createRewritingSolver(Solver *s) {
+  return new Solver(new RewritingSolver(s));
+}
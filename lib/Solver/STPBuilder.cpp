@@ -509,6 +509,27 @@ ExprHandle STPBuilder::construct(ref<Expr> e, int *width_out) {
   }
 }
 
+/// Build a little-endian load of \arg bytes bytes starting at the read
+/// \arg base, with the array and the index built only once.
+ExprHandle STPBuilder::constructWideRead(const ReadExpr *base,
+                                         unsigned bytes) {
+  ::VCExpr array =
+      getArrayForUpdate(base->updates.root, base->updates.head.get());
+  int indexWidth;
+  ExprHandle index = construct(base->index, &indexWidth);
+  ref<ConstantExpr> CE = dyn_cast<ConstantExpr>(base->index);
+
+  ExprHandle res = vc_readExpr(vc, array, index);
+  for (unsigned i = 1; i != bytes; ++i) {
+    ExprHandle byteIndex =
+        !CE.isNull()
+            ? construct(CE->Add(ConstantExpr::create(i, CE->getWidth())), 0)
+            : ExprHandle(vc_bvPlusExpr(vc, indexWidth,
+                                       bvConst32(indexWidth, i), index));
+    res = vc_bvConcatExpr(vc, vc_readExpr(vc, array, byteIndex), res);
+  }
+  return res;
+}
 
 /** if *width_out!=1 then result is a bitvector,
     otherwise it is a bool */
@@ -570,6 +591,10 @@ ExprHandle STPBuilder::constructActual(ref<Expr> e, int *width_out) {
 
   case Expr::Concat: {
     ConcatExpr *ce = cast<ConcatExpr>(e);
+    if (const ReadExpr *base = ce->getWideReadBase()) {
+      *width_out = ce->getWidth();
+      return constructWideRead(base, ce->getWidth() / 8);
+    }
     unsigned numKids = ce->getNumKids();
     ExprHandle res = construct(ce->getKid(numKids-1), 0);
     for (int i=numKids-2; i>=0; i--) {
@@ -106,6 +106,7 @@ private:
   ::VCExpr getArrayForUpdate(const Array *root, const UpdateNode *un);
 
   ExprHandle constructActual(ref<Expr> e, int *width_out);
+  ExprHandle constructWideRead(const ReadExpr *base, unsigned bytes);
   ExprHandle construct(ref<Expr> e, int *width_out);
   
   ::VCExpr buildVar(const char *name, unsigned width);
@@ -113,6 +113,20 @@ cl::opt<bool> UseAssignmentValidatingSolver(
     cl::desc("Debug the correctness of generated assignments (default=false)"),
     cl::cat(SolvingCat));
 
+cl::opt<bool> PredictSolverTimeouts(
+    "predict-solver-timeouts", cl::init(false),
+    cl::desc("Fail queries resembling ones that timed out before without "
+             "asking the core solver, and give queries resembling ones that "
+             "were solved quickly a shorter timeout. Only has an effect "
+             "together with --max-solver-time (default=false)"),
+    cl::cat(SolvingCat));
+
+cl::opt<bool> RewriteQueries(
+    "rewrite-queries", cl::init(false),
+    cl::desc("Simplify queries with additional rewrite rules before "
+             "the caches and the core solver see them (default=false)"),
+    cl::cat(SolvingCat));
+
 
 void KCommandLine::HideOptions(llvm::cl::OptionCategory &Category) {
   StringMap<cl::Option *> &map = cl::getRegisteredOptions();
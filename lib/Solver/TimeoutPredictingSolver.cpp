@@ -0,0 +1,250 @@
+//===-- TimeoutPredictingSolver.cpp ---------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+#include "klee/Solver/SolverStats.h"
+#include "klee/Support/Timer.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// Cheap structural features of a query, used to group queries which are
+/// likely to be similarly hard for the core solver.
+class QueryFeatures {
+  /// Stop counting nodes at this size, larger queries share one bucket.
+  static const unsigned MaxNodes = 1 << 16;
+
+  std::unordered_set<const Expr *> visitedExprs;
+  std::unordered_set<const UpdateNode *> visitedUpdates;
+  std::unordered_set<const Array *> arrays;
+  std::vector<const Expr *> worklist;
+  bool symbolicIndex = false;
+  bool nonLinear = false;
+
+  void push(const ref<Expr> &e) {
+    if (visitedExprs.size() < MaxNodes && visitedExprs.insert(e.get()).second)
+      worklist.push_back(e.get());
+  }
+
+  void visit(const Expr *e) {
+    switch (e->getKind()) {
+    case Expr::Read: {
+      const ReadExpr *re = cast<ReadExpr>(e);
+      arrays.insert(re->updates.root);
+      if (!isa<ConstantExpr>(re->index))
+        symbolicIndex = true;
+      for (const UpdateNode *un = re->updates.head.get(); un;
+           un = un->next.get()) {
+        if (!visitedUpdates.insert(un).second)
+          break;
+        if (!isa<ConstantExpr>(un->index))
+          symbolicIndex = true;
+        push(un->index);
+        push(un->value);
+      }
+      break;
+    }
+    case Expr::Mul:
+    case Expr::UDiv:
+    case Expr::SDiv:
+    case Expr::URem:
+    case Expr::SRem:
+      if (!isa<ConstantExpr>(e->getKid(0)) && !isa<ConstantExpr>(e->getKid(1)))
+        nonLinear = true;
+      break;
+    default:
+      break;
+    }
+
+    for (unsigned i = 0, n = e->getNumKids(); i != n; ++i)
+      push(e->getKid(i));
+  }
+
+  static unsigned log2(unsigned n) {
+    unsigned res = 0;
+    while (n >>= 1)
+      ++res;
+    return res;
+  }
+
+public:
+  explicit QueryFeatures(const Query &query) {
+    for (const auto &constraint : query.constraints)
+      push(constraint);
+    push(query.expr);
+    while (!worklist.empty()) {
+      const Expr *e = worklist.back();
+      worklist.pop_back();
+      visit(e);
+    }
+  }
+
+  /// Bucketed features packed into a single key.
+  unsigned getKey() const {
+    unsigned arrayBucket = std::min(log2(arrays.size() + 1), 7u);
+    unsigned sizeBucket = std::min(log2(visitedExprs.size() + 1), 15u);
+    return arrayBucket | sizeBucket << 3 | symbolicIndex << 7 | nonLinear << 8;
+  }
+};
+
+/// TimeoutPredictingSolver - Learns which kinds of queries the underlying
+/// solver fails to answer in time.
+///
+/// Queries are grouped by their QueryFeatures. Once most of the queries of
+/// a group timed out, further queries of that group fail right away (every
+/// RetryInterval-th one is still tried, in case the group becomes
+/// solvable). Groups with enough solved queries get a budget of a small
+/// multiple of their slowest solved query instead of the full timeout. A
+/// query hitting such a budget is run again with the rest of the timeout,
+/// so a budget only ever delays an answer; if the query is then solved,
+/// its time raises the budget of its group.
+///
+/// Without a timeout set nothing can time out, so all queries are simply
+/// forwarded.
+class TimeoutPredictingSolver : public SolverImpl {
+  /// Timeouts needed before a group is predicted to time out.
+  static const unsigned MinTimeouts = 3;
+  /// Percentage of timed out queries needed to predict a timeout.
+  static const unsigned TimeoutPercentage = 90;
+  /// Every this many predicted queries one is still run.
+  static const unsigned RetryInterval = 16;
+  /// Solved queries needed before a group gets a budget.
+  static const unsigned MinSolved = 8;
+  /// Budget as a multiple of the slowest solved query of a group.
+  static const unsigned BudgetFactor = 4;
+
+  struct Record {
+    unsigned solved = 0;
+    unsigned timeouts = 0;
+    unsigned predicted = 0;
+    time::Span maxSolveTime;
+  };
+
+  Solver *solver;
+  time::Span timeout;
+  std::unordered_map<unsigned, Record> records;
+  /// Whether the last query was failed without asking the solver.
+  bool lastPredicted = false;
+
+  bool predictTimeout(Record &record) const {
+    unsigned queries = record.solved + record.timeouts;
+    return record.timeouts >= MinTimeouts &&
+           record.timeouts * 100 >= queries * TimeoutPercentage;
+  }
+
+  time::Span getBudget(const Record &record) const {
+    if (record.solved < MinSolved)
+      return timeout;
+    time::Span budget = std::max(record.maxSolveTime * BudgetFactor,
+                                 time::milliseconds(10));
+    return std::min(budget, timeout);
+  }
+
+  template <class Function> bool run(const Query &query, Function f) {
+    lastPredicted = false;
+    if (!timeout)
+      return f();
+
+    Record &record = records[QueryFeatures(query).getKey()];
+    if (predictTimeout(record) && ++record.predicted % RetryInterval) {
+      ++stats::queryTimeoutsPredicted;
+      lastPredicted = true;
+      return false;
+    }
+
+    time::Span budget = getBudget(record);
+    solver->impl->setCoreSolverTimeout(budget);
+    WallTimer timer;
+    bool success = f();
+    if (!success && budget < timeout &&
+        solver->impl->getOperationStatusCode() == SOLVER_RUN_STATUS_TIMEOUT) {
+      // The budget was too tight, spend the rest of the timeout on the
+      // query before giving up.
+      time::Span elapsed = timer.delta();
+      if (elapsed < timeout) {
+        solver->impl->setCoreSolverTimeout(timeout - elapsed);
+        success = f();
+      }
+    }
+    time::Span elapsed = timer.delta();
+    solver->impl->setCoreSolverTimeout(timeout);
+
+    if (success) {
+      ++record.solved;
+      record.maxSolveTime = std::max(record.maxSolveTime, elapsed);
+    } else if (solver->impl->getOperationStatusCode() ==
+               SOLVER_RUN_STATUS_TIMEOUT) {
+      ++stats::queryTimeouts;
+      ++record.timeouts;
+    }
+    return success;
+  }
+
+public:
+  TimeoutPredictingSolver(Solver *_solver) : solver(_solver) {}
+  ~TimeoutPredictingSolver() { delete solver; }
+
+  bool computeValidity(const Query &query, Solver::Validity &result) {
+    return run(query, [&]() {
+      return solver->impl->computeValidity(query, result);
+    });
+  }
+
+  bool computeTruth(const Query &query, bool &isValid) {
+    return run(query, [&]() {
+      return solver->impl->computeTruth(query, isValid);
+    });
+  }
+
+  bool computeValue(const Query &query, ref<Expr> &result) {
+    return run(query, [&]() {
+      return solver->impl->computeValue(query, result);
+    });
+  }
+
+  bool computeInitialValues(const Query &query,
+                            const std::vector<const Array *> &objects,
+                            std::vector<std::vector<unsigned char> > &values,
+                            bool &hasSolution) {
+    return run(query, [&]() {
+      return solver->impl->computeInitialValues(query, objects, values,
+                                                hasSolution);
+    });
+  }
+
+  SolverRunStatus getOperationStatusCode() {
+    if (lastPredicted)
+      return SOLVER_RUN_STATUS_TIMEOUT;
+    return solver->impl->getOperationStatusCode();
+  }
+
+  char *getConstraintLog(const Query &query) {
+    return solver->impl->getConstraintLog(query);
+  }
+
+  void setCoreSolverTimeout(time::Span _timeout) {
+    timeout = _timeout;
+    solver->impl->setCoreSolverTimeout(_timeout);
+  }
+};
+
+}
+
+Solver *klee::createTimeoutPredictingSolver(Solver *s) {
+  return new Solver(new TimeoutPredictingSolver(s));
+}
@@ -470,6 +470,28 @@ Z3ASTHandle Z3Builder::construct(ref<Expr> e, int *width_out) {
   }
 }
 
+/// Build a little-endian load of \arg bytes bytes starting at the read
+/// \arg base, with the array and the index built only once.
+Z3ASTHandle Z3Builder::constructWideRead(const ReadExpr *base,
+                                         unsigned bytes) {
+  Z3ASTHandle array =
+      getArrayForUpdate(base->updates.root, base->updates.head.get());
+  int indexWidth;
+  Z3ASTHandle index = construct(base->index, &indexWidth);
+  ref<ConstantExpr> CE = dyn_cast<ConstantExpr>(base->index);
+
+  Z3ASTHandle res = readExpr(array, index);
+  for (unsigned i = 1; i != bytes; ++i) {
+    Z3ASTHandle byteIndex =
+        !CE.isNull()
+            ? construct(CE->Add(ConstantExpr::create(i, CE->getWidth())), 0)
+            : Z3ASTHandle(Z3_mk_bvadd(ctx, bvConst32(indexWidth, i), index),
+                          ctx);
+    res = Z3ASTHandle(Z3_mk_concat(ctx, readExpr(array, byteIndex), res), ctx);
+  }
+  return res;
+}
+
 /** if *width_out!=1 then result is a bitvector,
     otherwise it is a bool */
 Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
@@ -532,6 +554,10 @@ Z3ASTHandle Z3Builder::constructActual(ref<Expr> e, int *width_out) {
 
   case Expr::Concat: {
     ConcatExpr *ce = cast<ConcatExpr>(e);
+    if (const ReadExpr *base = ce->getWideReadBase()) {
+      *width_out = ce->getWidth();
+      return constructWideRead(base, ce->getWidth() / 8);
+    }
     unsigned numKids = ce->getNumKids();
     Z3ASTHandle res = construct(ce->getKid(numKids - 1), 0);
     for (int i = numKids - 2; i >= 0; i--) {
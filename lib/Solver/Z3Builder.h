@@ -159,6 +159,7 @@ private:
   Z3ASTHandle getArrayForUpdate(const Array *root, const UpdateNode *un);
 
   Z3ASTHandle constructActual(ref<Expr> e, int *width_out);
+  Z3ASTHandle constructWideRead(const ReadExpr *base, unsigned bytes);
   Z3ASTHandle construct(ref<Expr> e, int *width_out);
 
   Z3ASTHandle buildArray(const char *name, unsigned indexWidth,
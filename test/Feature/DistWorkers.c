@@ -0,0 +1,35 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.dist-out
+// RUN: %klee --output-dir=%t.klee-out %t1.bc go 2> %t.plain.log
+// RUN: ls %t.klee-out | grep -c ktest > %t.plain.count
+// RUN: echo "--dist-workers=2 --dist-units=4" > %t.rsp
+// RUN: %klee --output-dir=%t.dist-out @%t.rsp %t1.bc go 2> %t.dist.log
+// RUN: FileCheck --input-file=%t.dist.log %s
+// RUN: ls %t.dist-out | grep -c ktest > %t.dist.count
+// RUN: diff %t.plain.count %t.dist.count
+
+// The workers must be given the program arguments even though part of the
+// command line comes from a response file, otherwise they diverge from the
+// work units and find only the single path without arguments.
+// CHECK: replaying {{[0-9]+}} work units on 2 workers
+// CHECK: collected {{[0-9]+}} test cases from {{[0-9]+}} workers
+
+#include "klee/klee.h"
+
+#include <string.h>
+
+int main(int argc, char **argv) {
+  if (argc != 2 || strcmp(argv[1], "go"))
+    return 0;
+
+  int x;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  int r = 0;
+  if (x & 1)
+    r += 1;
+  if (x & 2)
+    r += 2;
+  if (x & 4)
+    r += 4;
+  return r;
+}
@@ -0,0 +1,36 @@
+// RUN: %clang %s -emit-llvm %O0opt -c -o %t.bc
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --search=nurs:exploit --max-instructions=1000 %t.bc > %t.log
+// RUN: FileCheck --input-file=%t.log %s
+
+// Writing at a symbolic index into a stack buffer is an exploit sink, so
+// the state heading there is preferred over the many states forked by the
+// other branch, which reach no sink. Without the preference the sink is
+// not reached within the instruction budget.
+// CHECK: sink reached
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+#define STEP r = r * 3 + 1;
+#define STEP10 STEP STEP STEP STEP STEP STEP STEP STEP STEP STEP
+
+int main() {
+  char buf[8];
+  int x, i, k, r = 0;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&i, sizeof(i), "i");
+
+  if (x > 0) {
+    for (k = 0; k < 31; ++k)
+      if (x & (1 << k))
+        ++r;
+    return r;
+  }
+
+  STEP10 STEP10 STEP10 STEP10 STEP10
+  buf[i & 7] = r;
+  printf("sink reached\n");
+  return buf[0];
+}
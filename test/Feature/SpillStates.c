@@ -0,0 +1,51 @@
+// REQUIRES: not-msan
+// RUN: %clang %s -emit-llvm %O0opt -g -c -o %t.bc
+// RUN: rm -rf %t.klee-out %t.spill-out
+// RUN: %klee --output-dir=%t.klee-out %t.bc > %t.log
+// RUN: %klee --output-dir=%t.spill-out --write-paths --spill-states --max-memory=60 %t.bc > %t.spill.log
+// RUN: grep "WARNING: spilling" %t.spill-out/warnings.txt
+
+// Spilled states are re-executed later, so the same paths complete and the
+// same number of tests is generated as without a memory cap.
+// RUN: grep "^path " %t.log | sort > %t.paths
+// RUN: grep "^path " %t.spill.log | sort > %t.spill.paths
+// RUN: diff %t.paths %t.spill.paths
+// RUN: ls %t.klee-out | grep -c ktest > %t.tests
+// RUN: ls %t.spill-out | grep -c ktest > %t.spill.tests
+// RUN: diff %t.tests %t.spill.tests
+
+#include "klee/klee.h"
+
+#include <stdio.h>
+
+#define FRAME_SIZE (1 << 20)
+
+// Keeps about 20 MB per state alive while it loops at the bottom, long
+// enough for the periodic memory check to see all states at once.
+static int fill(int depth) {
+  char buf[FRAME_SIZE];
+  buf[depth] = depth;
+  if (depth == 0) {
+    int i, sum = 0;
+    for (i = 0; i < 100000; ++i)
+      sum += i;
+    return sum + buf[0];
+  }
+  return fill(depth - 1) + buf[depth];
+}
+
+int main() {
+  int x, p = 0;
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  if (x & 1)
+    p |= 1;
+  if (x & 2)
+    p |= 2;
+  if (x & 4)
+    p |= 4;
+
+  fill(10);
+  printf("path %d\n", p);
+  return 0;
+}
@@ -0,0 +1,32 @@
+// RUN: %clang -emit-llvm -g -c -o %t.bc %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out --auto-merge --debug-log-merge --search=nurs:covnew %t.bc 2>&1 | FileCheck %s
+
+// CHECK: Merged state
+// CHECK: KLEE: done: generated tests = 1{{$}}
+
+#include "klee/klee.h"
+
+int main(int argc, char** args){
+
+  int x;
+  int p = 0;
+
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  // Without merging, every branch doubles the number of paths.
+  if (x & 1)
+    p += 1;
+  else
+    p += 2;
+  if (x & 2)
+    p += 4;
+  else
+    p += 8;
+  if (x & 4)
+    p += 16;
+  else
+    p += 32;
+
+  return p;
+}
@@ -0,0 +1,35 @@
+// REQUIRES: z3
+// RUN: %clang -emit-llvm -g -c -o %t.bc %s
+// RUN: rm -rf %t.klee-out
+// RUN: %klee --output-dir=%t.klee-out -solver-backend=z3 --solver-workers=2 --auto-merge --debug-log-merge --search=nurs:covnew %t.bc 2>&1 | FileCheck %s
+
+// States waiting for a branch to be decided by a solver worker finish the
+// branch before they are merged, so merging works as without workers.
+// CHECK: Deciding branches on 2 solver workers
+// CHECK: Merged state
+// CHECK: KLEE: done: generated tests = 1{{$}}
+
+#include "klee/klee.h"
+
+int main(int argc, char** args){
+
+  int x;
+  int p = 0;
+
+  klee_make_symbolic(&x, sizeof(x), "x");
+
+  if (x & 1)
+    p += 1;
+  else
+    p += 2;
+  if (x & 2)
+    p += 4;
+  else
+    p += 8;
+  if (x & 4)
+    p += 16;
+  else
+    p += 32;
+
+  return p;
+}
@@ -0,0 +1,33 @@
+// REQUIRES: z3
+// RUN: %clang %s -emit-llvm %O0opt -g -c -o %t1.bc
+// RUN: rm -rf %t.klee-out %t.workers-out
+// RUN: %klee --output-dir=%t.klee-out -solver-backend=z3 %t1.bc 2> %t.sync.log
+// RUN: %klee --output-dir=%t.workers-out -solver-backend=z3 --solver-workers=2 %t1.bc 2> %t.workers.log
+// RUN: FileCheck --input-file=%t.workers.log %s
+// RUN: grep "KLEE: done:" %t.sync.log > %t.sync.done
+// RUN: grep "KLEE: done:" %t.workers.log > %t.workers.done
+// RUN: diff %t.sync.done %t.workers.done
+
+// Branches decided by the solver workers are completed without being
+// executed again, so both runs execute the same instructions and paths.
+// CHECK: Deciding branches on 2 solver workers
+// CHECK: KLEE: done: completed paths = 12
+
+#include "klee/klee.h"
+
+int main() {
+  int x, y;
+  klee_make_symbolic(&x, sizeof(x), "x");
+  klee_make_symbolic(&y, sizeof(y), "y");
+
+  int r = 0;
+  if (x * 3 > y)
+    r += 1;
+  if (x + y == 42)
+    r += 2;
+  else if (x - y == 7)
+    r += 4;
+  if (y & 8)
+    r += 8;
+  return r;
+}
@@ -31,6 +31,7 @@
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Type.h"
+#include "llvm/Support/Allocator.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Errno.h"
 #include "llvm/Support/FileSystem.h"
@@ -41,6 +42,7 @@
 
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/StringSaver.h"
 
 #if LLVM_VERSION_CODE >= LLVM_VERSION(4, 0)
 #include <llvm/Bitcode/BitcodeReader.h>
@@ -259,6 +261,33 @@ namespace {
                  cl::cat(ReplayCat));
 
 
+  /*** Distributed exploration options ***/
+
+  cl::opt<unsigned>
+  DistWorkers("dist-workers",
+              cl::desc("Spread the exploration over this many worker "
+                       "processes.  KLEE explores until there are "
+                       "--dist-units states, then replays each of them in a "
+                       "worker and collects the unique test cases.  Set to 0 "
+                       "to disable (default=0)"),
+              cl::init(0),
+              cl::cat(ParallelCat));
+
+  cl::opt<unsigned>
+  DistUnits("dist-units",
+            cl::desc("Number of states to hand out to the workers "
+                     "(default=4 per worker)"),
+            cl::init(0),
+            cl::cat(ParallelCat));
+
+  cl::opt<std::string>
+  NMESharedFile("nme-shared-file",
+                cl::desc("File shared with the native memory emulation "
+                         "agent, created if needed (default=shar_file in the "
+                         "NME launcher directory)"),
+                cl::cat(ParallelCat));
+
+
 
   cl::list<std::string>
   SeedOutFile("seed-file",
@@ -299,6 +328,7 @@ namespace {
 
 namespace klee {
 extern cl::opt<std::string> MaxTime;
+extern cl::opt<unsigned> WriteWorkUnits;
 class ExecutionState;
 }
 
@@ -325,6 +355,7 @@ public:
   ~KleeHandler();
 
   llvm::raw_ostream &getInfoStream() const { return *m_infoFile; }
+  std::string getOutputDirectory() const { return m_outputDirectory.str().str(); }
   /// Returns the number of test cases successfully generated so far
   unsigned getNumTestCases() { return m_numGeneratedTests; }
   unsigned getNumPathsExplored() { return m_pathsExplored; }
@@ -348,6 +379,12 @@ public:
   static void getKTestFilesInDir(std::string directoryPath,
                                  std::vector<std::string> &results);
 
+  /// Move the test cases found in \a directory into the output directory,
+  /// skipping those whose .ktest contents are in \a known. Returns the
+  /// number of test cases moved.
+  unsigned importTestCases(const std::string &directory,
+                           std::set<std::string> &known);
+
   static std::string getRunTimeLibraryPath(const char *argv0);
 };
 
@@ -615,12 +652,9 @@ void KleeHandler::loadPathFile(std::string name,
   if (!f.good())
     assert(0 && "unable to open path file");
 
-  while (f.good()) {
-    unsigned value;
-    f >> value;
+  unsigned value;
+  while (f >> value)
     buffer.push_back(!!value);
-    f.get();
-  }
 }
 
 void KleeHandler::getKTestFilesInDir(std::string directoryPath,
@@ -641,6 +675,42 @@ void KleeHandler::getKTestFilesInDir(std::string directoryPath,
   }
 }
 
+unsigned KleeHandler::importTestCases(const std::string &directory,
+                                      std::set<std::string> &known) {
+  std::vector<std::string> files;
+  std::error_code ec;
+  for (sys::fs::directory_iterator i(directory, ec), e; i != e && !ec;
+       i.increment(ec))
+    files.push_back(i->path());
+  std::sort(files.begin(), files.end());
+
+  unsigned imported = 0;
+  for (const auto &kTestFile : files) {
+    if (sys::path::extension(kTestFile) != ".ktest")
+      continue;
+    auto buffer = MemoryBuffer::getFile(kTestFile);
+    if (!buffer || !known.insert((*buffer)->getBuffer().str()).second)
+      continue;
+
+    // Move all files of the test case, e.g. test000001.{ktest,path,ptr.err}
+    std::string prefix = sys::path::stem(kTestFile).str() + '.';
+    unsigned id = ++m_numTotalTests;
+    for (const auto &file : files) {
+      StringRef name = sys::path::filename(file);
+      if (!name.startswith(prefix))
+        continue;
+      std::string target = getOutputFilename(
+          getTestFilename(name.substr(prefix.size()).str(), id));
+      if (auto err = sys::fs::rename(file, target))
+        klee_warning("unable to move %s: %s", file.c_str(),
+                     err.message().c_str());
+    }
+    ++m_numGeneratedTests;
+    ++imported;
+  }
+  return imported;
+}
+
 std::string KleeHandler::getRunTimeLibraryPath(const char *argv0) {
   // allow specifying the path to the runtime library
   const char *env = getenv("KLEE_RUNTIME_LIBRARY_PATH");
@@ -696,10 +766,19 @@ static std::string strip(std::string &in) {
   return in.substr(lead, trail-lead);
 }
 
+// The command line as parsed, with response files expanded, so that the
+// positions recorded for the options index into it.
+static SmallVector<const char *, 32> parsedArgv;
+
 static void parseArguments(int argc, char **argv) {
   cl::SetVersionPrinter(klee::printVersion);
-  // This version always reads response files
-  cl::ParseCommandLineOptions(argc, argv, " klee\n");
+  // Response files are expanded here rather than by the parser, so that
+  // work unit workers can be given the same arguments.
+  static BumpPtrAllocator allocator;
+  static StringSaver saver(allocator);
+  parsedArgv.assign(argv, argv + argc);
+  cl::ExpandResponseFiles(saver, cl::TokenizeGNUCommandLine, parsedArgv);
+  cl::ParseCommandLineOptions(parsedArgv.size(), parsedArgv.data(), " klee\n");
 }
 
 static void
@@ -1022,6 +1101,154 @@ static void halt_via_gdb(int pid) {
     perror("system");
 }
 
+// Build the command line of a worker replaying \a unit. Options that
+// concern the coordinator are dropped, the input file and program
+// arguments are kept as they are.
+static std::vector<std::string>
+getWorkerArguments(const std::string &unit, const std::string &outputDir) {
+  static const std::set<std::string> dropped = {
+      "dist-workers", "dist-units",         "write-work-units",
+      "output-dir",   "replay-path",        "nme-shared-file",
+      "write-paths",  "replay-path-prefix"};
+  static const std::set<std::string> flags = {"write-paths",
+                                              "replay-path-prefix"};
+
+  std::vector<std::string> args;
+  void *MainExecAddr = (void *)(intptr_t)getWorkerArguments;
+  args.push_back(sys::fs::getMainExecutable(parsedArgv[0], MainExecAddr));
+
+  // The parser records where the input file was found, everything after it
+  // are program arguments.
+  unsigned argc = parsedArgv.size();
+  unsigned firstPositional =
+      InputFile.getNumOccurrences() ? InputFile.getPosition() : argc;
+  for (unsigned i = 1; i < firstPositional; ++i) {
+    StringRef arg(parsedArgv[i]);
+    // Re-added in front of the input file below.
+    if (arg == "--")
+      continue;
+    StringRef name = arg.ltrim('-').split('=').first;
+    if (!dropped.count(name.str())) {
+      args.push_back(arg.str());
+    } else if (!arg.contains('=') && !flags.count(name.str())) {
+      ++i; // skip the value
+    }
+  }
+
+  args.push_back("--output-dir=" + outputDir);
+  args.push_back("--replay-path=" + unit);
+  args.push_back("--replay-path-prefix");
+  args.push_back("--nme-shared-file=" + outputDir + ".nme");
+  // Workers only write .path files if asked to, like a plain run.
+  if (WritePaths.getNumOccurrences())
+    args.push_back("--write-paths");
+  if (firstPositional < argc) {
+    args.push_back("--");
+    for (unsigned i = firstPositional; i < argc; ++i)
+      args.push_back(parsedArgv[i]);
+  }
+  return args;
+}
+
+static pid_t launchWorker(const std::vector<std::string> &args,
+                          const std::string &logFile) {
+  pid_t pid = fork();
+  if (pid < 0)
+    klee_error("unable to fork worker: %s", strerror(errno));
+  if (pid)
+    return pid;
+
+  int fd = open(logFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd >= 0) {
+    dup2(fd, STDOUT_FILENO);
+    dup2(fd, STDERR_FILENO);
+    close(fd);
+  }
+  std::vector<char *> cargs;
+  for (const auto &arg : args)
+    cargs.push_back(const_cast<char *>(arg.c_str()));
+  cargs.push_back(nullptr);
+  execv(cargs[0], cargs.data());
+  fprintf(stderr, "KLEE: unable to run worker %s: %s\n", cargs[0],
+          strerror(errno));
+  _exit(1);
+}
+
+// Replay the work units written by the exploration on DistWorkers worker
+// processes, each with its own output directory, and collect their unique
+// test cases into the main output directory.
+static void runWorkUnits(KleeHandler &handler) {
+  std::vector<std::string> units;
+  std::error_code ec;
+  for (sys::fs::directory_iterator i(handler.getOutputDirectory(), ec), e;
+       i != e && !ec; i.increment(ec)) {
+    StringRef name = sys::path::filename(i->path());
+    if (name.startswith("unit") && name.endswith(".path"))
+      units.push_back(i->path());
+  }
+  std::sort(units.begin(), units.end());
+  if (units.empty())
+    return;
+  klee_message("replaying %u work units on %u workers",
+               (unsigned) units.size(), (unsigned) DistWorkers);
+
+  std::map<pid_t, std::string> running;
+  std::vector<std::string> outputDirs;
+  size_t next = 0;
+  while ((next < units.size() && !interrupted) || !running.empty()) {
+    if (next < units.size() && !interrupted && running.size() < DistWorkers) {
+      const std::string &unit = units[next++];
+      SmallString<128> path(unit);
+      sys::path::replace_extension(path, "");
+      std::string dir = path.str().str();
+      pid_t pid = launchWorker(getWorkerArguments(unit, dir), dir + ".log");
+      running[pid] = dir;
+      outputDirs.push_back(dir);
+      continue;
+    }
+
+    // Only the workers are waited for, other children like the NME
+    // launcher must not be reaped here.
+    bool reaped = false;
+    for (auto it = running.begin(); it != running.end();) {
+      int status;
+      pid_t res = waitpid(it->first, &status, WNOHANG);
+      if (res < 0 && errno != EINTR)
+        klee_error("waiting for workers failed: %s", strerror(errno));
+      if (res <= 0) {
+        ++it;
+        continue;
+      }
+      if (!WIFEXITED(status) || WEXITSTATUS(status))
+        klee_warning("worker for %s failed, see %s.log", it->second.c_str(),
+                     it->second.c_str());
+      it = running.erase(it);
+      reaped = true;
+    }
+    if (!reaped)
+      usleep(100000);
+  }
+
+  // Test cases of different workers can coincide where units overlap.
+  std::set<std::string> known;
+  std::vector<std::string> kTestFiles;
+  KleeHandler::getKTestFilesInDir(handler.getOutputDirectory(), kTestFiles);
+  for (const auto &kTestFile : kTestFiles)
+    if (auto buffer = MemoryBuffer::getFile(kTestFile))
+      known.insert((*buffer)->getBuffer().str());
+
+  unsigned imported = 0, total = 0;
+  for (const auto &dir : outputDirs) {
+    std::vector<std::string> workerTests;
+    if (sys::fs::is_directory(dir))
+      KleeHandler::getKTestFilesInDir(dir, workerTests);
+    total += workerTests.size();
+    imported += handler.importTestCases(dir, known);
+  }
+  klee_message("collected %u test cases from %u workers (%u duplicates)",
+               imported, (unsigned) outputDirs.size(), total - imported);
+}
+
 #ifndef SUPPORT_KLEE_UCLIBC
 static void
 linkWithUclibc(StringRef libDir,
@@ -1180,11 +1407,15 @@ int main(int argc, char **argv, char **envp) {
     }
     strcpy(tmp_path, nme_path);
     strcat(tmp_path, shar_file_p);
-    printf ("shar file path: %s. \n", tmp_path);
-    int kn_shar_fd = open(tmp_path, O_RDWR);
+    std::string shar_path =
+        NMESharedFile.empty() ? std::string(tmp_path) : NMESharedFile.getValue();
+    printf ("shar file path: %s. \n", shar_path.c_str());
+    int kn_shar_fd = NMESharedFile.empty()
+        ? open(shar_path.c_str(), O_RDWR)
+        : open(shar_path.c_str(), O_RDWR | O_CREAT, 0600);
     if (kn_shar_fd == -1)
     {
-        printf ("open shar file failed. path: %s. \n", tmp_path);
+        printf ("open shar file failed. path: %s. \n", shar_path.c_str());
         return -1;
     }
     // int tmp_ret = access (tmp_path, W_OK);
@@ -1271,7 +1502,10 @@ int main(int argc, char **argv, char **envp) {
     }
     strcpy(req_dump_path, nme_path);
     strcat(req_dump_path, shar_file_p);
-    req_dump_fp = fopen(req_dump_path, "w+");
+    // Workers must not touch the files of the coordinator.
+    req_dump_fp = NMESharedFile.empty()
+        ? fopen(req_dump_path, "w+")
+        : fopen((NMESharedFile + ".req_dump").c_str(), "w+");
     if (req_dump_fp == NULL)
     {
         printf ("open req dump failed. path: %s. \n", req_dump_path);
@@ -1495,6 +1729,16 @@ int main(int argc, char **argv, char **envp) {
         pArgv[i] = pArg;
     }
 
+    if (DistWorkers) {
+        if (!ReplayKTestDir.empty() || !ReplayKTestFile.empty() ||
+                ReplayPathFile != "")
+            klee_error("--dist-workers cannot be combined with replaying");
+        // Work units are cut from the branch history of the states.
+        WritePaths = true;
+        if (!WriteWorkUnits)
+            WriteWorkUnits = DistUnits ? DistUnits : 4 * DistWorkers;
+    }
+
     std::vector<bool> replayPath;
 
     if (ReplayPathFile != "") {
@@ -1630,6 +1874,9 @@ int main(int argc, char **argv, char **envp) {
         }
         interpreter->runFunctionAsMain(mainFn, pArgc, pArgv, pEnvp);
 
+        if (DistWorkers && !interrupted)
+            runWorkUnits(*handler);
+
         while (!seeds.empty()) {
             kTest_free(seeds.back());
             seeds.pop_back();
@@ -0,0 +1,58 @@
+#include "klee/ADT/CopyOnWriteVector.h"
+#include "gtest/gtest.h"
+
+using namespace klee;
+
+namespace {
+
+typedef CopyOnWriteVector<int, 4> Vector;
+
+TEST(CopyOnWriteVectorTest, CopiesShareUntilWritten) {
+  Vector a;
+  ASSERT_TRUE(a.empty());
+  for (int i = 0; i < 10; ++i)
+    a.push_back(i);
+  ASSERT_EQ(10u, a.size());
+  ASSERT_EQ(9, a.back());
+
+  Vector b(a);
+  ASSERT_EQ(3u, a.getNumSharedPages());
+  ASSERT_TRUE(a == b);
+
+  // Appending to the last page only unshares that page.
+  b.push_back(10);
+  ASSERT_EQ(2u, a.getNumSharedPages());
+  ASSERT_EQ(10u, a.size());
+  ASSERT_EQ(11u, b.size());
+  ASSERT_TRUE(a != b);
+
+  b.getWriteable(1) = 42;
+  ASSERT_EQ(1u, a.getNumSharedPages());
+  ASSERT_EQ(1, a[1]);
+  ASSERT_EQ(42, b[1]);
+
+  // Writing to an unshared page does not copy it again.
+  b.getWriteableBack() = 7;
+  ASSERT_EQ(7, b.back());
+  ASSERT_EQ(9, a.back());
+  ASSERT_EQ(1u, b.getNumSharedPages());
+}
+
+TEST(CopyOnWriteVectorTest, EqualContentsCompareEqual) {
+  Vector a, b;
+  for (int i = 0; i < 6; ++i) {
+    a.push_back(i);
+    b.emplace_back(i);
+  }
+  ASSERT_EQ(0u, a.getNumSharedPages());
+  ASSERT_TRUE(a == b);
+
+  b.getWriteable(5) = 0;
+  ASSERT_TRUE(a != b);
+
+  b.clear();
+  ASSERT_TRUE(b.empty());
+  ASSERT_EQ(0u, a.getNumSharedPages());
+}
+
+}
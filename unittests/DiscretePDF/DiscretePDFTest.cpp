@@ -1,6 +1,8 @@
 #include "klee/ADT/DiscretePDF.h"
 #include "gtest/gtest.h"
 #include <iostream>
+#include <map>
+#include <random>
 #include <vector>
 
 int finished = 0;
@@ -56,3 +58,61 @@ TEST(DiscretePDFTest, Rotatation) {
   ASSERT_EQ(1, testTree.getWeight(1));
   ASSERT_EQ(2, testTree.getWeight(2));
 }
+
+// Choosing over an even grid of probabilities hits every item about as
+// often as its share of the total weight.
+static void expectProportional(DiscretePDF<int> &pdf,
+                               const std::map<int, double> &expected) {
+  const unsigned samples = 100000;
+  double total = 0;
+  for (auto &entry : expected)
+    total += entry.second;
+
+  std::map<int, unsigned> counts;
+  for (unsigned i = 0; i < samples; ++i)
+    ++counts[pdf.choose((i + 0.5) / samples)];
+
+  for (auto &entry : counts)
+    ASSERT_TRUE(expected.count(entry.first)) << entry.first;
+  for (auto &entry : expected) {
+    ASSERT_EQ(entry.second, pdf.getWeight(entry.first));
+    EXPECT_NEAR(entry.second / total, counts[entry.first] / double(samples),
+                1e-4)
+        << entry.first;
+  }
+}
+
+TEST(DiscretePDFTest, Proportional) {
+  DiscretePDF<int> pdf;
+  std::map<int, double> expected;
+  std::mt19937 rng(1);
+
+  for (int round = 0; round < 2000; ++round) {
+    int item = rng() % 100;
+    double weight = rng() % 4 ? rng() % 1000 : 0;
+    if (expected.count(item)) {
+      if (rng() % 2) {
+        pdf.remove(item);
+        expected.erase(item);
+      } else {
+        pdf.update(item, weight);
+        expected[item] = weight;
+      }
+    } else {
+      pdf.insert(item, weight);
+      expected[item] = weight;
+    }
+    ASSERT_EQ(expected.size(), pdf.size());
+  }
+  expectProportional(pdf, expected);
+
+  for (auto &entry : expected)
+    entry.second = entry.first % 7 + 1;
+  pdf.reweight([](int item) { return item % 7 + 1.; });
+  expectProportional(pdf, expected);
+
+  for (auto &entry : expected)
+    entry.second = entry.first;
+  pdf.reweight([](int item) { return (double) item; }, 4);
+  expectProportional(pdf, expected);
+}
@@ -0,0 +1,209 @@
+//===-- CompiledExprTest.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/CompiledExpr.h"
+
+#include <random>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+class CompiledExprTest : public ::testing::Test {
+protected:
+  ArrayCache ac;
+  std::vector<const Array *> arrays;
+  std::mt19937 rng{42};
+
+  void SetUp() {
+    arrays.push_back(ac.CreateArray("a", 8));
+    arrays.push_back(ac.CreateArray("b", 8));
+  }
+
+  unsigned random(unsigned n) { return rng() % n; }
+
+  ref<Expr> randomRead(Expr::Width w) {
+    const Array *array = arrays[random(arrays.size())];
+    if (w != Expr::Int8 || random(2))
+      return Expr::createTempRead(array, w);
+
+    // A read through updates, some of them at symbolic indices.
+    UpdateList ul(array, 0);
+    for (unsigned i = 0, n = random(4); i < n; ++i) {
+      ref<Expr> index =
+          random(2) ? ref<Expr>(ConstantExpr::create(random(8), Expr::Int32))
+                    : ZExtExpr::create(AndExpr::create(
+                                           randomRead(Expr::Int8),
+                                           ConstantExpr::create(7, Expr::Int8)),
+                                       Expr::Int32);
+      ul.extend(index, ConstantExpr::create(random(256), Expr::Int8));
+    }
+    return ReadExpr::create(ul, ConstantExpr::create(random(10), Expr::Int32));
+  }
+
+  ref<Expr> randomExpr(Expr::Width w, unsigned depth) {
+    if (!depth || !random(4)) {
+      if (random(2))
+        return randomRead(w);
+      uint64_t v = ((uint64_t) rng() << 32) | rng();
+      return ConstantExpr::create(v & (w == 64 ? ~0ULL : (1ULL << w) - 1), w);
+    }
+
+    if (w == Expr::Bool) {
+      Expr::Width ow = random(2) ? Expr::Int8 : Expr::Int32;
+      ref<Expr> l = randomExpr(ow, depth - 1), r = randomExpr(ow, depth - 1);
+      switch (random(8)) {
+      case 0: return EqExpr::create(l, r);
+      case 1: return UltExpr::create(l, r);
+      case 2: return UleExpr::create(l, r);
+      case 3: return SltExpr::create(l, r);
+      case 4: return SleExpr::create(l, r);
+      case 5: return SgeExpr::create(l, r);
+      case 6:
+        return AndExpr::create(randomExpr(w, depth - 1),
+                               randomExpr(w, depth - 1));
+      default:
+        return OrExpr::create(randomExpr(w, depth - 1),
+                              randomExpr(w, depth - 1));
+      }
+    }
+
+    ref<Expr> l = randomExpr(w, depth - 1), r = randomExpr(w, depth - 1);
+    // Keep divisors non-zero, the evaluator can't fold divisions by zero.
+    ref<Expr> d = OrExpr::create(r, ConstantExpr::create(1, w));
+    switch (random(17)) {
+    case 0: return AddExpr::create(l, r);
+    case 1: return SubExpr::create(l, r);
+    case 2: return MulExpr::create(l, r);
+    case 3: return UDivExpr::create(l, d);
+    case 4: return SDivExpr::create(l, d);
+    case 5: return URemExpr::create(l, d);
+    case 6: return SRemExpr::create(l, d);
+    case 7: return XorExpr::create(l, r);
+    case 8: return ShlExpr::create(l, r);
+    case 9: return LShrExpr::create(l, r);
+    case 10: return AShrExpr::create(l, r);
+    case 11: return NotExpr::create(l);
+    case 12:
+      return SelectExpr::create(randomExpr(Expr::Bool, depth - 1), l, r);
+    case 13:
+      return w > Expr::Int8 ? SExtExpr::create(randomExpr(Expr::Int8, depth), w)
+                            : l;
+    case 14:
+      return w > Expr::Int8 ? ZExtExpr::create(randomExpr(Expr::Int8, depth), w)
+                            : l;
+    case 15:
+      return w < Expr::Int64
+                 ? ExtractExpr::create(randomExpr(Expr::Int64, depth - 1),
+                                       random(64 - w + 1), w)
+                 : l;
+    default:
+      return w == Expr::Int16 ? ConcatExpr::create(
+                                    randomExpr(Expr::Int8, depth - 1),
+                                    randomExpr(Expr::Int8, depth - 1))
+                              : l;
+    }
+  }
+
+  Assignment randomAssignment() {
+    std::vector<std::vector<unsigned char> > values(arrays.size());
+    for (auto &value : values)
+      for (unsigned i = 0; i < 8; ++i)
+        value.push_back(random(256));
+    return Assignment(arrays, values);
+  }
+};
+
+TEST_F(CompiledExprTest, MatchesEvaluator) {
+  const Expr::Width widths[] = {Expr::Bool, Expr::Int8, Expr::Int16,
+                                Expr::Int32, Expr::Int64};
+  for (unsigned round = 0; round < 200; ++round) {
+    std::vector<ref<Expr> > exprs;
+    for (auto w : widths)
+      exprs.push_back(randomExpr(w, 5));
+    CompiledExpr compiled(exprs);
+    ASSERT_TRUE(compiled.isValid());
+
+    for (unsigned i = 0; i < 5; ++i) {
+      Assignment a = randomAssignment();
+      CompiledExpr::values_ty values;
+      ASSERT_TRUE(compiled.evaluate(a, values));
+      for (unsigned j = 0; j < exprs.size(); ++j) {
+        ref<Expr> expected = a.evaluate(exprs[j]);
+        ASSERT_TRUE(isa<ConstantExpr>(expected));
+        EXPECT_EQ(cast<ConstantExpr>(expected)->getZExtValue(), values[j])
+            << "for " << exprs[j];
+      }
+    }
+  }
+}
+
+TEST_F(CompiledExprTest, Satisfies) {
+  ref<Expr> read = Expr::createTempRead(arrays[0], Expr::Int8);
+  std::vector<ref<Expr> > constraints = {
+      UltExpr::create(read, ConstantExpr::create(10, Expr::Int8)),
+      EqExpr::create(UDivExpr::create(ConstantExpr::create(100, Expr::Int8),
+                                      read),
+                     ConstantExpr::create(20, Expr::Int8))};
+  CompiledExpr compiled(constraints);
+
+  std::vector<std::vector<unsigned char> > values(1, {5});
+  std::vector<const Array *> objects(1, arrays[0]);
+  Assignment a(objects, values);
+  EXPECT_TRUE(compiled.isSatisfiedBy(a));
+  values[0][0] = 4;
+  Assignment b(objects, values);
+  EXPECT_FALSE(compiled.isSatisfiedBy(b));
+
+  // Division by zero is left to the evaluator.
+  values[0][0] = 0;
+  Assignment c(objects, values);
+  CompiledExpr::values_ty results;
+  EXPECT_FALSE(compiled.evaluate(c, results));
+  EXPECT_EQ(c.satisfies(constraints.begin(), constraints.end()),
+            compiled.isSatisfiedBy(c));
+}
+
+TEST_F(CompiledExprTest, FindSatisfyingInBatches) {
+  for (unsigned round = 0; round < 50; ++round) {
+    std::vector<ref<Expr> > constraints;
+    for (unsigned i = 0; i < 2; ++i)
+      constraints.push_back(randomExpr(Expr::Bool, 3));
+    // Divisions by zero in some lanes only.
+    ref<Expr> read = Expr::createTempRead(arrays[round % 2], Expr::Int8);
+    if (round % 3 == 0)
+      constraints.push_back(
+          UleExpr::create(UDivExpr::create(read, read),
+                          ConstantExpr::create(1, Expr::Int8)));
+    CompiledExpr compiled(constraints);
+
+    // Not a multiple of the batch size.
+    std::vector<Assignment> assignments;
+    for (unsigned i = 0; i < 2 * CompiledExpr::BatchSize + 5; ++i)
+      assignments.push_back(randomAssignment());
+    std::vector<Assignment *> candidates;
+    for (auto &a : assignments)
+      candidates.push_back(&a);
+
+    // Search from every position, so that matches land in all lanes.
+    for (auto begin = candidates.begin(); begin != candidates.end(); ++begin) {
+      auto expected = begin;
+      while (expected != candidates.end() &&
+             !(*expected)->satisfies(constraints.begin(), constraints.end()))
+        ++expected;
+      EXPECT_EQ(expected, compiled.findSatisfying(begin, candidates.end()));
+    }
+  }
+}
+}
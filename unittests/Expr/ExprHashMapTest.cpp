@@ -0,0 +1,141 @@
+//===-- ExprHashMapTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ExprHashMap.h"
+
+#include <map>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+/// A value which may only be constructed and destroyed, like a solver
+/// handle that must not be assigned across contexts.
+struct Unassignable {
+  static int live;
+  unsigned value;
+
+  explicit Unassignable(unsigned _value = 0) : value(_value) { ++live; }
+  Unassignable(const Unassignable &b) : value(b.value) { ++live; }
+  ~Unassignable() { --live; }
+  Unassignable &operator=(const Unassignable &) = delete;
+};
+
+int Unassignable::live = 0;
+
+// Keys cannot be changed in place, like in the standard containers.
+static_assert(std::is_same<ExprHashMap<unsigned>::value_type,
+                           std::pair<const ref<Expr>, unsigned> >::value,
+              "ExprHashMap keys must be const");
+
+TEST(ExprHashMapTest, MatchesStdMap) {
+  std::vector<ref<Expr> > keys;
+  for (unsigned i = 0; i < 2000; ++i)
+    keys.push_back(ConstantExpr::create(1000 + i, Expr::Int32));
+
+  ExprHashMap<unsigned> map;
+  std::map<ref<Expr>, unsigned> model;
+  std::mt19937 rng(1);
+  for (unsigned round = 0; round < 20000; ++round) {
+    const ref<Expr> &key = keys[rng() % keys.size()];
+    switch (rng() % 3) {
+    case 0: {
+      auto res = map.insert(std::make_pair(key, round));
+      auto expected = model.insert(std::make_pair(key, round));
+      EXPECT_EQ(expected.second, res.second);
+      EXPECT_EQ(expected.first->second, res.first->second);
+      break;
+    }
+    case 1:
+      EXPECT_EQ(model.erase(key), map.erase(key));
+      break;
+    default:
+      map[key] = round;
+      model[key] = round;
+    }
+    ASSERT_EQ(model.size(), map.size());
+  }
+
+  // Every key is still found after all the moves done by erase().
+  for (const auto &key : keys) {
+    auto it = map.find(key);
+    auto expected = model.find(key);
+    ASSERT_EQ(expected == model.end(), it == map.end());
+    if (it != map.end()) {
+      EXPECT_EQ(expected->second, it->second);
+    }
+  }
+
+  unsigned n = 0;
+  for (const auto &entry : map) {
+    EXPECT_EQ(model[entry.first], entry.second);
+    ++n;
+  }
+  EXPECT_EQ(model.size(), n);
+}
+
+TEST(ExprHashMapTest, Set) {
+  ref<Expr> a = ConstantExpr::create(1000, Expr::Int32);
+  // Created separately, hash-consed to the same node.
+  ref<Expr> b = AddExpr::create(a, a);
+  ref<Expr> c = AddExpr::create(a, a);
+
+  ExprHashSet set(4);
+  EXPECT_TRUE(set.insert(a).second);
+  EXPECT_TRUE(set.insert(b).second);
+  EXPECT_FALSE(set.insert(c).second);
+  EXPECT_EQ(2u, set.size());
+  EXPECT_EQ(1u, set.count(c));
+
+  set.clear();
+  EXPECT_TRUE(set.empty());
+  EXPECT_EQ(0u, set.count(a));
+  EXPECT_TRUE(set.begin() == set.end());
+}
+
+TEST(ExprHashMapTest, ValuesAreNeverAssigned) {
+  std::vector<ref<Expr> > keys;
+  for (unsigned i = 0; i < 200; ++i)
+    keys.push_back(ConstantExpr::create(5000 + i, Expr::Int32));
+
+  {
+    ExprHashMap<Unassignable> map;
+    for (unsigned i = 0; i < keys.size(); ++i)
+      map.insert(std::make_pair(keys[i], Unassignable(i)));
+    EXPECT_EQ((int) keys.size(), Unassignable::live);
+
+    // Erase every other key, so that entries are moved back into holes.
+    for (unsigned i = 0; i < keys.size(); i += 2)
+      EXPECT_EQ(1u, map.erase(keys[i]));
+    EXPECT_EQ((int) map.size(), Unassignable::live);
+    for (unsigned i = 0; i < keys.size(); ++i) {
+      auto it = map.find(keys[i]);
+      ASSERT_EQ(i % 2 == 0, it == map.end());
+      if (it != map.end()) {
+        EXPECT_EQ(i, it->second.value);
+      }
+    }
+
+    ExprHashMap<Unassignable> copy(map);
+    EXPECT_EQ(map.size(), copy.size());
+    EXPECT_EQ(2 * (int) map.size(), Unassignable::live);
+
+    map.clear();
+    EXPECT_TRUE(map.empty());
+    EXPECT_EQ((int) copy.size(), Unassignable::live);
+    EXPECT_EQ(1u, copy.count(keys[1]));
+  }
+  EXPECT_EQ(0, Unassignable::live);
+}
+}
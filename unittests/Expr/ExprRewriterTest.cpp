@@ -0,0 +1,195 @@
+//===-- ExprRewriterTest.cpp ----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Assignment.h"
+#include "klee/Expr/ExprRewriter.h"
+
+#include <random>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+class ExprRewriterTest : public ::testing::Test {
+protected:
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("a", 8);
+  std::mt19937 rng{7};
+  ExprRewriter rewriter;
+
+  unsigned random(unsigned n) { return rng() % n; }
+
+  ref<Expr> byte(unsigned i) {
+    return ReadExpr::create(UpdateList(array, 0),
+                            ConstantExpr::create(i, Expr::Int32));
+  }
+
+  ref<Expr> constant(uint64_t v, Expr::Width w) {
+    return ConstantExpr::create(v, w);
+  }
+
+  /// Random expressions made mostly of the operations the rules look at.
+  ref<Expr> randomExpr(Expr::Width w, unsigned depth) {
+    if (!depth || !random(5)) {
+      if (w == Expr::Int8 && random(3))
+        return byte(random(8));
+      if (w != Expr::Bool && random(2))
+        return Expr::createTempRead(array, w);
+      uint64_t v = random(3) ? random(3) : ((uint64_t) rng() << 32) | rng();
+      return ConstantExpr::create(v & (w == 64 ? ~0ULL : (1ULL << w) - 1), w);
+    }
+
+    if (w == Expr::Bool) {
+      Expr::Width ow = random(2) ? Expr::Int8 : Expr::Int32;
+      ref<Expr> l = randomExpr(ow, depth - 1), r = randomExpr(ow, depth - 1);
+      switch (random(6)) {
+      case 0: return EqExpr::create(l, r);
+      case 1: return UltExpr::create(l, r);
+      case 2: return UleExpr::create(l, r);
+      case 3: return SltExpr::create(l, r);
+      case 4: return SleExpr::create(l, r);
+      default: return SgtExpr::create(l, r);
+      }
+    }
+
+    ref<Expr> l = randomExpr(w, depth - 1), r = randomExpr(w, depth - 1);
+    switch (random(14)) {
+    case 0: return AddExpr::create(l, r);
+    case 1: return SubExpr::create(l, r);
+    case 2: return AndExpr::create(l, r);
+    case 3: return OrExpr::create(l, r);
+    case 4: return XorExpr::create(l, r);
+    case 5: return ShlExpr::create(l, r);
+    case 6: return LShrExpr::create(l, r);
+    case 7: return NotExpr::create(l);
+    case 8:
+    case 9: {
+      if (w == Expr::Int8)
+        return l;
+      ref<Expr> narrow = randomExpr(Expr::Int8, depth - 1);
+      return random(2) ? ZExtExpr::create(narrow, w)
+                       : SExtExpr::create(narrow, w);
+    }
+    case 10:
+    case 11:
+      if (w >= Expr::Int64)
+        return l;
+      return ExtractExpr::create(randomExpr(Expr::Int64, depth - 1),
+                                 random(64 - w + 1), w);
+    default: {
+      if (w == Expr::Int8)
+        return l;
+      return ConcatExpr::create(randomExpr(w / 2, depth - 1),
+                                randomExpr(w / 2, depth - 1));
+    }
+    }
+  }
+};
+
+TEST_F(ExprRewriterTest, Casts) {
+  ref<Expr> x = byte(0);
+  EXPECT_EQ(ZExtExpr::create(x, Expr::Int64),
+            rewriter.rewrite(ZExtExpr::create(ZExtExpr::create(x, Expr::Int32),
+                                              Expr::Int64)));
+  EXPECT_EQ(ZExtExpr::create(x, Expr::Int64),
+            rewriter.rewrite(SExtExpr::create(ZExtExpr::create(x, Expr::Int32),
+                                              Expr::Int64)));
+  EXPECT_EQ(x, rewriter.rewrite(ExtractExpr::create(
+                   SExtExpr::create(x, Expr::Int32), 0, Expr::Int8)));
+  EXPECT_EQ(constant(0, Expr::Int8),
+            rewriter.rewrite(ExtractExpr::create(
+                ZExtExpr::create(x, Expr::Int32), 16, Expr::Int8)));
+}
+
+TEST_F(ExprRewriterTest, Concats) {
+  // Bytes of a wider value, put back together.
+  ref<Expr> x = Expr::createTempRead(array, Expr::Int32);
+  ref<Expr> bytes = ConcatExpr::createN(
+      4, std::vector<ref<Expr> >{ExtractExpr::create(x, 24, Expr::Int8),
+                                 ExtractExpr::create(x, 16, Expr::Int8),
+                                 ExtractExpr::create(x, 8, Expr::Int8),
+                                 ExtractExpr::create(x, 0, Expr::Int8)}
+             .data());
+  EXPECT_EQ(x, rewriter.rewrite(bytes));
+
+  EXPECT_EQ(ZExtExpr::create(byte(1), Expr::Int16),
+            rewriter.rewrite(
+                ConcatExpr::create(constant(0, Expr::Int8), byte(1))));
+}
+
+TEST_F(ExprRewriterTest, Comparisons) {
+  ref<Expr> x = byte(0), y = byte(1);
+  ref<Expr> zx = ZExtExpr::create(x, Expr::Int32);
+  ref<Expr> zy = ZExtExpr::create(y, Expr::Int32);
+  EXPECT_EQ(UltExpr::create(x, y),
+            rewriter.rewrite(UltExpr::create(zx, zy)));
+  EXPECT_EQ(UleExpr::create(x, y),
+            rewriter.rewrite(SleExpr::create(zx, zy)));
+  EXPECT_EQ(SltExpr::create(x, y),
+            rewriter.rewrite(SltExpr::create(SExtExpr::create(x, Expr::Int32),
+                                             SExtExpr::create(y, Expr::Int32))));
+  EXPECT_EQ(UltExpr::create(x, constant(10, Expr::Int8)),
+            rewriter.rewrite(UltExpr::create(zx, constant(10, Expr::Int32))));
+  EXPECT_TRUE(rewriter.rewrite(UltExpr::create(zx, constant(300, Expr::Int32)))
+                  ->isTrue());
+  EXPECT_TRUE(rewriter.rewrite(UleExpr::create(constant(300, Expr::Int32), zx))
+                  ->isFalse());
+  EXPECT_TRUE(rewriter.rewrite(UltExpr::create(x, constant(0, Expr::Int8)))
+                  ->isFalse());
+  EXPECT_EQ(EqExpr::create(constant(0, Expr::Int8), x),
+            rewriter.rewrite(UltExpr::create(x, constant(1, Expr::Int8))));
+}
+
+TEST_F(ExprRewriterTest, Bitwise) {
+  ref<Expr> x = byte(0);
+  ref<Expr> zx = ZExtExpr::create(x, Expr::Int32);
+  EXPECT_EQ(zx, rewriter.rewrite(
+                    AndExpr::create(constant(0xff, Expr::Int32), zx)));
+  EXPECT_EQ(AndExpr::create(x, constant(0x0f, Expr::Int8)),
+            rewriter.rewrite(ExtractExpr::create(
+                AndExpr::create(zx, constant(0xf0f, Expr::Int32)), 0,
+                Expr::Int8)));
+  EXPECT_EQ(x, rewriter.rewrite(NotExpr::create(NotExpr::create(x))));
+  EXPECT_EQ(constant(0, Expr::Int32),
+            rewriter.rewrite(ShlExpr::create(zx, constant(32, Expr::Int32))));
+  // The rewritten extract makes the xor trivial.
+  ref<Expr> y = Expr::createTempRead(array, Expr::Int32);
+  EXPECT_EQ(constant(0, Expr::Int8),
+            rewriter.rewrite(XorExpr::create(
+                ExtractExpr::create(ExtractExpr::create(y, 8, Expr::Int16), 0,
+                                    Expr::Int8),
+                ExtractExpr::create(y, 8, Expr::Int8))));
+}
+
+TEST_F(ExprRewriterTest, PreservesValues) {
+  const Expr::Width widths[] = {Expr::Bool, Expr::Int8, Expr::Int16,
+                                Expr::Int32, Expr::Int64};
+  std::vector<const Array *> objects(1, array);
+  for (unsigned round = 0; round < 500; ++round) {
+    ref<Expr> e = randomExpr(widths[random(5)], 5);
+    ref<Expr> rewritten = rewriter.rewrite(e);
+    ASSERT_EQ(e->getWidth(), rewritten->getWidth());
+    // Rewriting again changes nothing.
+    EXPECT_EQ(rewritten, ExprRewriter().rewrite(rewritten)) << "for " << e;
+
+    for (unsigned i = 0; i < 8; ++i) {
+      std::vector<std::vector<unsigned char> > values(1);
+      for (unsigned j = 0; j < 8; ++j)
+        values[0].push_back(random(4) ? random(256) : random(2) ? 0 : 0xff);
+      Assignment a(objects, values);
+      EXPECT_EQ(a.evaluate(e), a.evaluate(rewritten))
+          << "for " << e << " rewritten to " << rewritten;
+    }
+  }
+}
+}
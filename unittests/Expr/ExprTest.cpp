@@ -8,9 +8,12 @@
 //===----------------------------------------------------------------------===//
 
 #include <iostream>
+#include <thread>
+#include <vector>
 #include "gtest/gtest.h"
 
 #include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Assignment.h"
 #include "klee/Expr/Expr.h"
 
 using namespace klee;
@@ -264,4 +267,231 @@ TEST(ExprTest, ReadExprFoldingSymbolicIndexUpdate) {
     EXPECT_EQ(Expr::Read, read.get()->getKind());
   }
 }
+
+TEST(ExprTest, HashConsing) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 256);
+  ref<Expr> a = AddExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                getConstant(1, Expr::Int32));
+  ref<Expr> b = AddExpr::create(Expr::createTempRead(array, Expr::Int32),
+                                getConstant(1, Expr::Int32));
+  EXPECT_EQ(a.get(), b.get());
+  EXPECT_EQ(getConstant(7, Expr::Int8).get(), getConstant(7, Expr::Int8).get());
+  EXPECT_NE(getConstant(7, Expr::Int8).get(),
+            getConstant(7, Expr::Int16).get());
+
+  // Dropped expressions leave the cache, and rebuilding them still works.
+  unsigned count = Expr::count;
+  {
+    ref<Expr> c = MulExpr::create(a, a);
+    EXPECT_LT(count, Expr::count);
+  }
+  EXPECT_EQ(count, Expr::count);
+  EXPECT_EQ(Expr::Mul, MulExpr::create(a, a)->getKind());
+}
+
+TEST(ExprTest, SmallConstants) {
+  ref<ConstantExpr> c = ConstantExpr::create(0, Expr::Int32);
+  unsigned count = Expr::count;
+  for (unsigned i = 0; i < 256; ++i) {
+    ref<ConstantExpr> a = ConstantExpr::create(i, Expr::Int64);
+    ref<ConstantExpr> b = ConstantExpr::alloc(llvm::APInt(64, i));
+    EXPECT_EQ(a.get(), b.get());
+    EXPECT_EQ(i, a->getZExtValue());
+    // Arithmetic on small constants reuses the preallocated nodes.
+    EXPECT_EQ(a.get(), a->Add(c->ZExt(Expr::Int64)).get());
+  }
+  EXPECT_EQ(count, Expr::count);
+  EXPECT_TRUE(ConstantExpr::create(1, Expr::Bool)->isTrue());
+  EXPECT_EQ(300u, ConstantExpr::create(300, Expr::Int16)->getZExtValue());
+}
+
+TEST(ExprTest, NodeRecycling) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 4);
+  ref<Expr> read = Expr::createTempRead(array, Expr::Int32);
+  std::vector<const Array *> objects = {array};
+  std::vector<std::vector<unsigned char> > values = {{7, 0, 0, 0}};
+  Assignment a(objects, values);
+
+  // Free and rebuild nodes of different kinds and sizes over and over, so
+  // that memory of freed nodes comes back as other kinds of nodes. Every
+  // rebuilt expression must still be complete and evaluate correctly.
+  unsigned count = Expr::count;
+  for (unsigned i = 0; i < 1000; ++i) {
+    ref<Expr> c = getConstant(i + 1000, Expr::Int32);
+    ref<Expr> e;
+    switch (i % 3) {
+    case 0:
+      e = MulExpr::create(read, AddExpr::create(read, c));
+      EXPECT_EQ(getConstant(7 * (7 + i + 1000), Expr::Int32), a.evaluate(e));
+      break;
+    case 1:
+      e = UDivExpr::create(c, read);
+      EXPECT_EQ(getConstant((i + 1000) / 7, Expr::Int32), a.evaluate(e));
+      break;
+    default:
+      e = SelectExpr::create(UltExpr::create(read, c), c, read);
+      EXPECT_EQ(c, a.evaluate(e));
+      break;
+    }
+  }
+  // Every node was freed again.
+  EXPECT_EQ(count, Expr::count);
+}
+
+TEST(ExprTest, HashConsingUpdates) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 256);
+  const Array *other = ac.CreateArray("other", 256);
+  ref<Expr> index = Expr::createTempRead(array, Expr::Int32);
+
+  UpdateList a(array, 0), b(array, 0), c(other, 0);
+  for (unsigned i = 0; i < 100; ++i) {
+    ref<Expr> value = getConstant(i, Expr::Int8);
+    a.extend(i % 3 ? getConstant(i, Expr::Int32) : index, value);
+    b.extend(i % 3 ? getConstant(i, Expr::Int32) : index, value);
+    c.extend(i % 3 ? getConstant(i, Expr::Int32) : index, value);
+  }
+  // Equal writes to the same array share their nodes, and so do the reads.
+  EXPECT_EQ(a.head.get(), b.head.get());
+  EXPECT_EQ(ReadExpr::create(a, index).get(), ReadExpr::create(b, index).get());
+  // Nodes of different arrays are kept apart.
+  EXPECT_NE(a.head.get(), c.head.get());
+  EXPECT_NE(0, a.compare(c));
+
+  b.extend(getConstant(0, Expr::Int32), getConstant(1, Expr::Int8));
+  EXPECT_NE(a.head.get(), b.head.get());
+  EXPECT_EQ(a.head.get(), b.head->next.get());
+  EXPECT_GT(0, a.compare(b));
+}
+
+TEST(ExprTest, HashConsingThreads) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 256);
+  ref<Expr> read = Expr::createTempRead(array, Expr::Int32);
+
+  const unsigned numThreads = 4, numExprs = 1000;
+  std::vector<std::vector<ref<Expr> > > results(numThreads);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < numThreads; ++t) {
+    threads.emplace_back([&, t]() {
+      for (unsigned i = 0; i < numExprs; ++i) {
+        // Let the threads race on creating and destroying expressions.
+        ref<Expr> e = AddExpr::create(read, getConstant(i, Expr::Int32));
+        if (i % 2)
+          results[t].push_back(e);
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  for (unsigned t = 1; t < numThreads; ++t)
+    for (unsigned i = 0; i < results[t].size(); ++i)
+      EXPECT_EQ(results[0][i].get(), results[t][i].get());
+}
+
+TEST(ExprTest, FindUpdateInLongLists) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 256);
+  const Array *symbolic = ac.CreateArray("sym", 4);
+  ref<Expr> symbolicIndex = Expr::createTempRead(symbolic, Expr::Int32);
+
+  UpdateList ul(array, 0);
+  std::vector<UpdateList> versions;
+  for (unsigned i = 0; i < 1000; ++i) {
+    if (i == 300)
+      ul.extend(symbolicIndex, getConstant(1, Expr::Int8));
+    else
+      ul.extend(getConstant((i * 7) % 200, Expr::Int32),
+                getConstant(i % 256, Expr::Int8));
+    versions.push_back(ul);
+  }
+
+  // Compare against walking the lists node by node, on many versions since
+  // they share nodes with each other.
+  for (unsigned v = 0; v < versions.size(); v += 13) {
+    const UpdateList &version = versions[v];
+    for (uint64_t index = 0; index < 256; index += 5) {
+      const UpdateNode *expected = version.head.get();
+      for (; expected; expected = expected->next.get()) {
+        const ConstantExpr *CE = dyn_cast<ConstantExpr>(expected->index);
+        if (!CE || CE->getZExtValue() == index)
+          break;
+      }
+      EXPECT_EQ(expected, UpdateNode::findUpdate(version.head.get(), index));
+    }
+  }
+
+  // Reads at concrete indices fold to the last write after the symbolic one.
+  ref<Expr> read =
+      ReadExpr::create(ul, getConstant(7 * 999 % 200, Expr::Int32));
+  EXPECT_EQ(getConstant(999 % 256, Expr::Int8), read);
+  read = ReadExpr::create(ul, getConstant(201, Expr::Int32));
+  ASSERT_EQ(Expr::Read, read->getKind());
+  EXPECT_EQ(symbolicIndex, cast<ReadExpr>(read)->updates.head->index);
+}
+
+/// A little-endian load of `bytes` bytes, built like ObjectState::read.
+ref<Expr> loadLSB(const UpdateList &ul, ref<Expr> index, unsigned bytes) {
+  ref<Expr> res;
+  for (unsigned i = 0; i != bytes; ++i) {
+    ref<Expr> byte =
+        ReadExpr::create(ul, AddExpr::create(index, getConstant(i, 32)));
+    res = i ? ConcatExpr::create(byte, res) : byte;
+  }
+  return res;
+}
+
+TEST(ExprTest, WideReads) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 16);
+  const Array *offsets = ac.CreateArray("off", 4);
+  UpdateList ul(array, 0);
+  ref<Expr> symbolic = ZExtExpr::create(Expr::createTempRead(offsets, 8), 32);
+  ref<Expr> shifted = AddExpr::create(symbolic, getConstant(3, 32));
+
+  for (ref<Expr> index : {getConstant(2, 32), symbolic, shifted}) {
+    for (unsigned bytes : {2, 4, 8}) {
+      ref<Expr> load = loadLSB(ul, index, bytes);
+      ASSERT_EQ(Expr::Concat, load->getKind());
+      const ReadExpr *base = cast<ConcatExpr>(load)->getWideReadBase();
+      ASSERT_TRUE(base);
+      EXPECT_EQ(index, base->index);
+      // The chain below the top byte is a wide read from the same base.
+      EXPECT_EQ(base,
+                bytes > 2 ? cast<ConcatExpr>(cast<ConcatExpr>(load)->getRight())
+                                ->getWideReadBase()
+                          : base);
+    }
+  }
+
+  // Big-endian order, gaps and different update lists are not wide reads.
+  ref<Expr> b0 = ReadExpr::create(ul, symbolic);
+  ref<Expr> b1 = ReadExpr::create(ul, shifted);
+  EXPECT_FALSE(cast<ConcatExpr>(ConcatExpr::create(b0, b1))->getWideReadBase());
+  ref<Expr> b3 = ReadExpr::create(ul, AddExpr::create(symbolic,
+                                                     getConstant(1, 32)));
+  EXPECT_FALSE(cast<ConcatExpr>(ConcatExpr::create(b0, b3))->getWideReadBase());
+  UpdateList written(array, 0);
+  written.extend(getConstant(0, 32), getConstant(1, 8));
+  ref<Expr> w1 = ReadExpr::create(written, AddExpr::create(symbolic,
+                                                           getConstant(1, 32)));
+  EXPECT_FALSE(cast<ConcatExpr>(ConcatExpr::create(w1, b0))->getWideReadBase());
+
+  // Evaluating a wide read gives the same value as byte by byte.
+  std::vector<const Array *> objects = {array, offsets};
+  std::vector<std::vector<unsigned char> > values(2);
+  for (unsigned i = 0; i < 16; ++i)
+    values[0].push_back(i * 17 + 3);
+  values[1] = {5, 0, 0, 0};
+  Assignment a(objects, values);
+  ref<Expr> load = loadLSB(written, symbolic, 4);
+  ASSERT_TRUE(cast<ConcatExpr>(load)->getWideReadBase());
+  uint64_t expected = 0;
+  for (unsigned i = 0; i < 4; ++i)
+    expected |= (uint64_t) values[0][5 + i] << (8 * i);
+  EXPECT_EQ(getConstant(expected, 32), a.evaluate(load));
+}
 }
@@ -0,0 +1,88 @@
+//===-- ExprVisitorTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Expr/ExprVisitor.h"
+
+using namespace klee;
+
+namespace {
+
+class CountingVisitor : public ExprVisitor {
+public:
+  unsigned visits = 0;
+
+  Action visitExpr(const Expr &) {
+    ++visits;
+    return Action::doChildren();
+  }
+};
+
+class ReplaceVisitor : public ExprVisitor {
+  ref<Expr> src, dst;
+
+public:
+  ReplaceVisitor(const ref<Expr> &_src, const ref<Expr> &_dst)
+      : ExprVisitor(true), src(_src), dst(_dst) {}
+
+  Action visitExprPost(const Expr &e) {
+    if (&e == src.get())
+      return Action::changeTo(dst);
+    return Action::doChildren();
+  }
+};
+
+ref<Expr> buildDAG(const ref<Expr> &leaf, unsigned depth) {
+  ref<Expr> e = leaf;
+  // Each level refers to the previous one twice.
+  for (unsigned i = 0; i < depth; ++i)
+    e = AddExpr::create(e, MulExpr::create(e, leaf));
+  return e;
+}
+
+TEST(ExprVisitorTest, SharedSubexpressionsVisitedOnce) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 4);
+  ref<Expr> read = Expr::createTempRead(array, Expr::Int32);
+  ref<Expr> e = buildDAG(read, 40);
+
+  CountingVisitor counter;
+  EXPECT_EQ(e, counter.visit(e));
+  // One visit per level for the Add, the Mul, plus the read and its index.
+  EXPECT_GE(2u * 40 + 10, counter.visits);
+
+  ref<Expr> c = ConstantExpr::create(3, Expr::Int32);
+  ReplaceVisitor replacer(read, c);
+  EXPECT_EQ(buildDAG(c, 40), replacer.visit(e));
+}
+
+TEST(ExprVisitorTest, DeepExpression) {
+  ArrayCache ac;
+  const Array *array = ac.CreateArray("arr", 4);
+  ref<Expr> read = Expr::createTempRead(array, Expr::Int32);
+  ref<Expr> x = ZExtExpr::create(Expr::createTempRead(array, Expr::Int8),
+                                 Expr::Int32);
+
+  // Deep enough to overflow the stack with a recursive traversal.
+  ref<Expr> e = read;
+  for (unsigned i = 0; i < 20000; ++i)
+    e = XorExpr::create(x, e);
+
+  ref<Expr> c = ConstantExpr::create(3, Expr::Int32);
+  ref<Expr> expected = c;
+  for (unsigned i = 0; i < 20000; ++i)
+    expected = XorExpr::create(x, expected);
+
+  ReplaceVisitor replacer(read, c);
+  EXPECT_EQ(expected.get(), replacer.visit(e).get());
+}
+}
@@ -0,0 +1,128 @@
+//===-- MinDistanceTest.cpp -----------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Core/MinDistance.h"
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+struct Graph {
+  struct Edge {
+    unsigned from, to, weight;
+  };
+
+  unsigned numNodes;
+  std::vector<Edge> edges;
+  std::vector<bool> targets;
+
+  void build(MinDistance &md) const {
+    for (const Edge &e : edges)
+      md.addEdge(e.from, e.to, e.weight);
+    for (unsigned i = 0; i < numNodes; ++i)
+      md.setTarget(i, targets[i]);
+    md.compute();
+  }
+};
+
+/// A random graph, with cycles, self loops and parallel edges, which is
+/// sparse enough to leave some nodes without any target in reach.
+Graph randomGraph(std::mt19937 &rng) {
+  Graph g;
+  g.numNodes = std::uniform_int_distribution<unsigned>(1, 60)(rng);
+  std::uniform_int_distribution<unsigned> node(0, g.numNodes - 1);
+  std::uniform_int_distribution<unsigned> weight(1, 5);
+  unsigned numEdges =
+      std::uniform_int_distribution<unsigned>(0, 2 * g.numNodes)(rng);
+  for (unsigned i = 0; i < numEdges; ++i)
+    g.edges.push_back({node(rng), node(rng), weight(rng)});
+  std::bernoulli_distribution isTarget(0.3);
+  for (unsigned i = 0; i < g.numNodes; ++i)
+    g.targets.push_back(isTarget(rng));
+  return g;
+}
+
+TEST(MinDistanceTest, Chain) {
+  // 0 -> 1 -> 2 -> 3, with a shortcut 0 -> 3.
+  MinDistance md(5);
+  md.addEdge(0, 1, 1);
+  md.addEdge(1, 2, 2);
+  md.addEdge(2, 3, 1);
+  md.addEdge(0, 3, 10);
+  md.setTarget(2, true);
+  md.setTarget(3, true);
+  md.compute();
+  ASSERT_EQ(4u, md.get(0));
+  ASSERT_EQ(3u, md.get(1));
+  ASSERT_EQ(1u, md.get(2));
+  ASSERT_EQ(1u, md.get(3));
+  ASSERT_EQ(0u, md.get(4));
+
+  std::vector<unsigned> changed;
+  md.removeTargets({2}, changed);
+  ASSERT_EQ(5u, md.get(0));
+  ASSERT_EQ(4u, md.get(1));
+  ASSERT_EQ(2u, md.get(2));
+
+  changed.clear();
+  md.removeTargets({3}, changed);
+  for (unsigned i = 0; i < 5; ++i)
+    ASSERT_EQ(0u, md.get(i));
+}
+
+TEST(MinDistanceTest, RemoveTargetsMatchesCompute) {
+  std::mt19937 rng(0x4b4c4545);
+  for (unsigned trial = 0; trial < 500; ++trial) {
+    Graph g = randomGraph(rng);
+    MinDistance incremental(g.numNodes);
+    g.build(incremental);
+
+    // Remove the targets a few at a time, checking after every step.
+    std::vector<unsigned> remaining;
+    for (unsigned i = 0; i < g.numNodes; ++i)
+      if (g.targets[i])
+        remaining.push_back(i);
+    std::shuffle(remaining.begin(), remaining.end(), rng);
+
+    while (!remaining.empty()) {
+      unsigned n = std::uniform_int_distribution<unsigned>(
+          1, std::min<std::size_t>(3, remaining.size()))(rng);
+      std::vector<unsigned> removed(remaining.end() - n, remaining.end());
+      remaining.resize(remaining.size() - n);
+
+      std::vector<MinDistance::distance_ty> before;
+      for (unsigned i = 0; i < g.numNodes; ++i)
+        before.push_back(incremental.get(i));
+
+      std::vector<unsigned> changed;
+      incremental.removeTargets(removed, changed);
+      for (unsigned i : removed)
+        g.targets[i] = false;
+
+      MinDistance fresh(g.numNodes);
+      g.build(fresh);
+      std::set<unsigned> reported(changed.begin(), changed.end());
+      for (unsigned i = 0; i < g.numNodes; ++i) {
+        ASSERT_EQ(fresh.get(i), incremental.get(i))
+            << "trial " << trial << ", node " << i;
+        if (before[i] != fresh.get(i))
+          ASSERT_TRUE(reported.count(i))
+              << "trial " << trial << ", node " << i << " not reported";
+      }
+    }
+  }
+}
+
+} // namespace
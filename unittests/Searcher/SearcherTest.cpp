@@ -0,0 +1,130 @@
+//===-- SearcherTest.cpp --------------------------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "Core/ExecutionState.h"
+#include "Core/Searcher.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+std::unique_ptr<ExecutionState> makeState() {
+  return std::unique_ptr<ExecutionState>(
+      new ExecutionState(std::vector<ref<Expr> >()));
+}
+
+/// The states of \a list in order, following the links of \a slot.
+std::vector<ExecutionState *> contents(const StateList &list, unsigned slot) {
+  std::vector<ExecutionState *> res;
+  for (ExecutionState *es = list.front(); es; es = es->searcherSlot(slot).next)
+    res.push_back(es);
+  return res;
+}
+
+TEST(StateListTest, PushBack) {
+  unsigned slot = Searcher::allocateSlot();
+  StateList list(slot);
+  auto a = makeState(), b = makeState(), c = makeState();
+
+  ASSERT_TRUE(list.empty());
+  list.push_back(a.get());
+  list.push_back(b.get());
+  list.push_back(c.get());
+  ASSERT_FALSE(list.empty());
+  ASSERT_EQ(a.get(), list.front());
+  ASSERT_EQ(c.get(), list.back());
+  ASSERT_EQ((std::vector<ExecutionState *>{a.get(), b.get(), c.get()}),
+            contents(list, slot));
+  ASSERT_EQ(nullptr, a->searcherSlot(slot).prev);
+  ASSERT_EQ(b.get(), c->searcherSlot(slot).prev);
+}
+
+TEST(StateListTest, RemoveFromMiddle) {
+  unsigned slot = Searcher::allocateSlot();
+  StateList list(slot);
+  auto a = makeState(), b = makeState(), c = makeState();
+  list.push_back(a.get());
+  list.push_back(b.get());
+  list.push_back(c.get());
+
+  list.remove(b.get());
+  ASSERT_EQ((std::vector<ExecutionState *>{a.get(), c.get()}),
+            contents(list, slot));
+  ASSERT_EQ(a.get(), c->searcherSlot(slot).prev);
+  ASSERT_EQ(nullptr, b->searcherSlot(slot).prev);
+  ASSERT_EQ(nullptr, b->searcherSlot(slot).next);
+
+  list.remove(a.get());
+  list.remove(c.get());
+  ASSERT_TRUE(list.empty());
+  ASSERT_EQ(nullptr, list.back());
+}
+
+TEST(StateListTest, ReinsertAfterRemoval) {
+  unsigned slot = Searcher::allocateSlot();
+  StateList list(slot);
+  auto a = makeState(), b = makeState(), c = makeState();
+  list.push_back(a.get());
+  list.push_back(b.get());
+  list.push_back(c.get());
+
+  list.remove(b.get());
+  list.push_back(b.get());
+  ASSERT_EQ((std::vector<ExecutionState *>{a.get(), c.get(), b.get()}),
+            contents(list, slot));
+  ASSERT_EQ(b.get(), list.back());
+
+  list.remove(a.get());
+  list.push_back(a.get());
+  ASSERT_EQ((std::vector<ExecutionState *>{c.get(), b.get(), a.get()}),
+            contents(list, slot));
+  ASSERT_EQ(c.get(), list.front());
+}
+
+TEST(StateListTest, ListsWithOwnSlotsAreIndependent) {
+  unsigned slot1 = Searcher::allocateSlot(), slot2 = Searcher::allocateSlot();
+  StateList list1(slot1), list2(slot2);
+  auto a = makeState(), b = makeState();
+  list1.push_back(a.get());
+  list1.push_back(b.get());
+  list2.push_back(b.get());
+  list2.push_back(a.get());
+
+  list1.remove(a.get());
+  ASSERT_EQ((std::vector<ExecutionState *>{b.get()}), contents(list1, slot1));
+  ASSERT_EQ((std::vector<ExecutionState *>{b.get(), a.get()}),
+            contents(list2, slot2));
+}
+
+TEST(StateListTest, CopiedStateHasNoSlots) {
+  unsigned slot = Searcher::allocateSlot();
+  StateList list(slot);
+  auto a = makeState(), b = makeState();
+  list.push_back(a.get());
+  list.push_back(b.get());
+
+  // A branched state is not in any searcher yet, even if its parent is.
+  std::unique_ptr<ExecutionState> copy(new ExecutionState(*a));
+  ASSERT_TRUE(copy->searcherSlots.empty());
+
+  list.push_back(copy.get());
+  ASSERT_EQ((std::vector<ExecutionState *>{a.get(), b.get(), copy.get()}),
+            contents(list, slot));
+  list.remove(a.get());
+  ASSERT_EQ((std::vector<ExecutionState *>{b.get(), copy.get()}),
+            contents(list, slot));
+  list.remove(copy.get());
+  ASSERT_EQ(b.get(), list.back());
+}
+
+} // namespace
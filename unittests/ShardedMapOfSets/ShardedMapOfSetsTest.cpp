@@ -0,0 +1,96 @@
+#include "klee/ADT/ShardedMapOfSets.h"
+#include "gtest/gtest.h"
+
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace klee;
+
+namespace {
+
+struct IntHash {
+  unsigned operator()(int i) const { return i * 2654435761u; }
+};
+
+struct Any {
+  bool operator()(int) const { return true; }
+};
+
+struct IsEven {
+  bool operator()(int v) const { return v % 2 == 0; }
+};
+
+typedef ShardedMapOfSets<int, int, IntHash> IntMap;
+
+TEST(ShardedMapOfSetsTest, Lookup) {
+  IntMap map(4);
+  int res = 0;
+
+  ASSERT_FALSE(map.lookup({1, 2}, res));
+  map.insert({1, 2}, 12);
+  map.insert({1, 2, 3}, 123);
+  ASSERT_TRUE(map.lookup({1, 2}, res));
+  ASSERT_EQ(12, res);
+  ASSERT_TRUE(map.lookup({1, 2, 3}, res));
+  ASSERT_EQ(123, res);
+  ASSERT_FALSE(map.lookup({1}, res));
+
+  // Overwriting keeps a single entry.
+  map.insert({1, 2}, 21);
+  ASSERT_TRUE(map.lookup({1, 2}, res));
+  ASSERT_EQ(21, res);
+
+  map.clear();
+  ASSERT_FALSE(map.lookup({1, 2}, res));
+}
+
+TEST(ShardedMapOfSetsTest, SubsetsAndSupersets) {
+  IntMap map(8);
+  int res = 0;
+
+  map.insert({1, 3}, 13);
+  map.insert({2, 4, 6}, 246);
+  map.insert({1, 2, 3, 4}, 1234);
+
+  ASSERT_TRUE(map.findSubset({1, 3, 5}, Any(), res));
+  ASSERT_EQ(13, res);
+  ASSERT_FALSE(map.findSubset({1, 5}, Any(), res));
+  ASSERT_FALSE(map.findSubset({1, 3, 5}, IsEven(), res));
+
+  ASSERT_TRUE(map.findSuperset({4, 6}, Any(), res));
+  ASSERT_EQ(246, res);
+  ASSERT_TRUE(map.findSuperset({2, 3}, Any(), res));
+  ASSERT_EQ(1234, res);
+  ASSERT_FALSE(map.findSuperset({5}, Any(), res));
+  ASSERT_TRUE(map.findSuperset({1}, IsEven(), res));
+  ASSERT_EQ(1234, res);
+}
+
+TEST(ShardedMapOfSetsTest, ConcurrentAccess) {
+  IntMap map;
+  const int numThreads = 4, perThread = 200;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < numThreads; ++t) {
+    threads.emplace_back([&map, t]() {
+      for (int i = 0; i < perThread; ++i) {
+        int k = t * perThread + i;
+        map.insert({k, k + 1}, k);
+        int res;
+        map.findSubset({k, k + 1, k + 2}, Any(), res);
+        map.findSuperset({k}, Any(), res);
+      }
+    });
+  }
+  for (auto &thread : threads)
+    thread.join();
+
+  for (int k = 0; k < numThreads * perThread; ++k) {
+    int res = -1;
+    ASSERT_TRUE(map.lookup({k, k + 1}, res));
+    ASSERT_EQ(k, res);
+  }
+}
+
+}
@@ -0,0 +1,133 @@
+//===-- TimeoutPredictingSolverTest.cpp -----------------------------------===//
+//
+//                     The KLEE Symbolic Virtual Machine
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "gtest/gtest.h"
+
+#include "klee/Expr/ArrayCache.h"
+#include "klee/Expr/Constraints.h"
+#include "klee/Expr/Expr.h"
+#include "klee/Solver/Solver.h"
+#include "klee/Solver/SolverImpl.h"
+
+using namespace klee;
+
+namespace {
+
+/// Answers every query either with a timeout or with "valid", and remembers
+/// the timeout it was run with. With a time limit set, the query times out
+/// exactly when it is run with a shorter timeout.
+class ScriptedSolver : public SolverImpl {
+public:
+  bool timesOut = true;
+  time::Span timeNeeded;
+  unsigned calls = 0;
+  time::Span timeout;
+  time::Span lastTimeout;
+  bool lastTimedOut = false;
+
+  bool computeTruth(const Query &, bool &isValid) {
+    ++calls;
+    lastTimeout = timeout;
+    lastTimedOut = timesOut || (timeNeeded && timeout < timeNeeded);
+    isValid = true;
+    return !lastTimedOut;
+  }
+  bool computeValue(const Query &, ref<Expr> &) {
+    ++calls;
+    lastTimedOut = timesOut;
+    return !timesOut;
+  }
+  bool computeInitialValues(const Query &, const std::vector<const Array *> &,
+                            std::vector<std::vector<unsigned char> > &,
+                            bool &) {
+    ++calls;
+    lastTimedOut = timesOut;
+    return !timesOut;
+  }
+  SolverRunStatus getOperationStatusCode() {
+    return lastTimedOut ? SOLVER_RUN_STATUS_TIMEOUT
+                    : SOLVER_RUN_STATUS_SUCCESS_SOLVABLE;
+  }
+  void setCoreSolverTimeout(time::Span _timeout) { timeout = _timeout; }
+};
+
+class TimeoutPredictingSolverTest : public ::testing::Test {
+protected:
+  ArrayCache ac;
+  ConstraintManager constraints;
+  ref<Expr> expr;
+  ScriptedSolver *core;
+  Solver *solver;
+
+  void SetUp() {
+    const Array *array = ac.CreateArray("arr", 4);
+    expr = EqExpr::create(Expr::createTempRead(array, Expr::Int32),
+                          ConstantExpr::create(42, Expr::Int32));
+    core = new ScriptedSolver();
+    solver = createTimeoutPredictingSolver(new Solver(core));
+  }
+
+  void TearDown() { delete solver; }
+
+  bool query() {
+    bool isValid;
+    return solver->impl->computeTruth(Query(constraints, expr), isValid);
+  }
+};
+
+TEST_F(TimeoutPredictingSolverTest, NoPredictionWithoutTimeout) {
+  for (unsigned i = 0; i < 10; ++i)
+    EXPECT_FALSE(query());
+  EXPECT_EQ(10u, core->calls);
+}
+
+TEST_F(TimeoutPredictingSolverTest, PredictsRepeatedTimeouts) {
+  solver->setCoreSolverTimeout(time::seconds(10));
+  for (unsigned i = 0; i < 3; ++i)
+    EXPECT_FALSE(query());
+  EXPECT_EQ(3u, core->calls);
+
+  // Similar queries now fail without reaching the core solver.
+  EXPECT_FALSE(query());
+  EXPECT_EQ(3u, core->calls);
+  EXPECT_EQ(SolverImpl::SOLVER_RUN_STATUS_TIMEOUT,
+            solver->impl->getOperationStatusCode());
+}
+
+TEST_F(TimeoutPredictingSolverTest, BudgetsQuickQueries) {
+  solver->setCoreSolverTimeout(time::seconds(10));
+  core->timesOut = false;
+  for (unsigned i = 0; i < 8; ++i) {
+    EXPECT_TRUE(query());
+    EXPECT_EQ(time::seconds(10), core->lastTimeout);
+  }
+
+  EXPECT_TRUE(query());
+  EXPECT_LT(core->lastTimeout, time::seconds(10));
+  // The full timeout is restored after the query.
+  EXPECT_EQ(time::seconds(10), core->timeout);
+}
+
+TEST_F(TimeoutPredictingSolverTest, RetriesQueriesMissingTheBudget) {
+  solver->setCoreSolverTimeout(time::seconds(10));
+  core->timesOut = false;
+  for (unsigned i = 0; i < 8; ++i)
+    EXPECT_TRUE(query());
+
+  // The budget is now far below what the next query needs, but the query
+  // is still answered within the full timeout.
+  core->timeNeeded = time::seconds(5);
+  core->calls = 0;
+  EXPECT_TRUE(query());
+  EXPECT_EQ(2u, core->calls);
+  EXPECT_LT(time::seconds(5), core->lastTimeout);
+  EXPECT_EQ(time::seconds(10), core->timeout);
+}
+
+}
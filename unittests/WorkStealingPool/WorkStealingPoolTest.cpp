@@ -0,0 +1,66 @@
+#include "klee/ADT/WorkStealingPool.h"
+#include "gtest/gtest.h"
+
+#include <set>
+
+using namespace klee;
+
+namespace {
+
+TEST(WorkStealingPoolTest, OwnItemsAreTakenLastInFirstOut) {
+  WorkStealingPool<int> pool(2);
+  int res = 0;
+
+  ASSERT_TRUE(pool.empty());
+  ASSERT_FALSE(pool.take(0, res));
+
+  pool.push(0, 1);
+  pool.push(0, 2);
+  pool.push(0, 3);
+  ASSERT_EQ(3u, pool.size());
+  ASSERT_EQ(3u, pool.size(0));
+
+  ASSERT_TRUE(pool.take(0, res));
+  ASSERT_EQ(3, res);
+  ASSERT_TRUE(pool.take(0, res));
+  ASSERT_EQ(2, res);
+  ASSERT_EQ(1u, pool.size());
+}
+
+TEST(WorkStealingPoolTest, StealsOldestItemOfFullestOwner) {
+  WorkStealingPool<int> pool(3);
+  int res = 0;
+
+  pool.push(1, 10);
+  pool.push(2, 20);
+  pool.push(2, 21);
+  pool.push(2, 22);
+
+  ASSERT_TRUE(pool.take(0, res));
+  ASSERT_EQ(20, res);
+  ASSERT_TRUE(pool.take(0, res));
+  ASSERT_EQ(21, res);
+  // Both remaining owners have one item, either may be the victim.
+  ASSERT_TRUE(pool.take(0, res));
+  ASSERT_TRUE(res == 10 || res == 22);
+  ASSERT_TRUE(pool.take(0, res));
+  ASSERT_FALSE(pool.take(0, res));
+  ASSERT_TRUE(pool.empty());
+}
+
+TEST(WorkStealingPoolTest, Remove) {
+  WorkStealingPool<int> pool(2);
+  pool.push(0, 1);
+  pool.push(1, 2);
+  pool.push(1, 3);
+
+  ASSERT_TRUE(pool.remove(2));
+  ASSERT_FALSE(pool.remove(2));
+  ASSERT_EQ(2u, pool.size());
+
+  std::set<int> items;
+  pool.forEach([&items](int i) { items.insert(i); });
+  ASSERT_EQ((std::set<int>{1, 3}), items);
+}
+
+}